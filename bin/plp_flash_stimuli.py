@@ -17,6 +17,7 @@ import os
 import struct
 from elftools.elf.elffile import ELFFile
 import subprocess
+import stim_utils
 
 
 
@@ -77,11 +78,12 @@ class Binary(object):
 
 class FlashImage(object):
 
-    def __init__(self, raw=None, stimuli=None, verbose=True, archi=None, encrypt=False, aesKey=None, aesIv=None, flashType='spi', qpi=True):
+    def __init__(self, raw=None, stimuli=None, verbose=True, archi=None, encrypt=False, aesKey=None, aesIv=None, flashType='spi', qpi=True, sparse=None):
 
         self.bootBinary = None
         self.raw = raw
         self.stimuli = stimuli
+        self.sparse = sparse
         self.compList = []
         self.buff = []
         self.flashOffset = 0
@@ -398,6 +400,11 @@ class FlashImage(object):
             with open(self.raw, 'wb') as file:
                 file.write(bytes(self.buff))
 
+        # The sparse stimuli contain the image as seen by the DPI flash
+        # models, as a single record
+        if self.sparse != None:
+            stim_utils.write_sparse_stim(self.sparse, [(0, bytes(self.buff))])
+
         if self.stimuli != None:
 
             try:
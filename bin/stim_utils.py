@@ -24,6 +24,66 @@ import argparse
 
 
 
+# Sparse binary stimuli, loaded by the DPI flash and RAM models with a
+# single read, see Dpi_storage in dpi-models. The header is the magic, the
+# version and the number of records, each record is its address, its size
+# and the data.
+SPARSE_STIM_MAGIC = b'PULPSTIM'
+SPARSE_STIM_VERSION = 1
+
+def write_sparse_stim(filename, records):
+  """Write the list of (address, data) records to filename."""
+
+  try:
+    os.makedirs(os.path.dirname(filename))
+  except:
+    pass
+
+  with open(filename, 'wb') as file:
+    file.write(SPARSE_STIM_MAGIC)
+    file.write(struct.pack('<II', SPARSE_STIM_VERSION, len(records)))
+    for addr, data in records:
+      file.write(struct.pack('<II', addr, len(data)))
+      file.write(data)
+
+
+def merge_sparse_records(records):
+  """Merge overlapping or contiguous records, the last ones overwriting
+  the first ones, and return them sorted by address."""
+
+  merged = []
+
+  for addr, data in records:
+    start, end = addr, addr + len(data)
+    chunk = None
+
+    # Absorb all the records touching the new one
+    remaining = []
+    for rec_addr, rec_data in merged:
+      if rec_addr <= end and rec_addr + len(rec_data) >= start:
+        if chunk is None:
+          chunk = []
+        chunk.append((rec_addr, rec_data))
+      else:
+        remaining.append((rec_addr, rec_data))
+
+    if chunk is not None:
+      chunk_start = min([start] + [rec_addr for rec_addr, rec_data in chunk])
+      chunk_end = max([end] + [rec_addr + len(rec_data) for rec_addr, rec_data in chunk])
+      buffer = bytearray(chunk_end - chunk_start)
+      for rec_addr, rec_data in chunk:
+        buffer[rec_addr - chunk_start:rec_addr - chunk_start + len(rec_data)] = rec_data
+      buffer[start - chunk_start:end - chunk_start] = data
+      remaining.append((chunk_start, bytes(buffer)))
+    else:
+      remaining.append((addr, bytes(data)))
+
+    merged = remaining
+
+  return sorted(merged, key=lambda record: record[0])
+
+
+
 class stim(object):
 
 
@@ -101,9 +161,9 @@ class stim(object):
       for key in sorted(self.mem.keys()):
         file.write('%X_%0*X\n' % (int(key), width*2, self.mem.get(key)))
 
-  def __parse_binaries(self, width):
+  def __get_segments(self):
 
-    self.mem = {}
+    segments = []
 
     for binary in self.binaries:
 
@@ -130,18 +190,28 @@ class stim(object):
 
                       self.dump('  Handling section (base: 0x%x, size: 0x%x)' % (addr, size))
 
-                      self.__add_mem(addr, size, data, width)
+                      segments.append((addr, data))
 
                       if segment['p_filesz'] < segment['p_memsz']:
                           addr = segment['p_paddr'] + segment['p_filesz']
                           size = segment['p_memsz'] - segment['p_filesz']
                           self.dump('  Init section to 0 (base: 0x%x, size: 0x%x)' % (addr, size))
-                          self.__add_mem(addr, size, [0] * size, width)
+                          segments.append((addr, bytes(size)))
 
                     else:
 
                       self.dump('  Bypassing section (base: 0x%x, size: 0x%x)' % (addr, size))
 
+    return segments
+
+
+  def __parse_binaries(self, width):
+
+    self.mem = {}
+
+    for addr, data in self.__get_segments():
+      self.__add_mem(addr, len(data), data, width)
+
 
 
 
@@ -152,6 +222,13 @@ class stim(object):
     self.__gen_stim_slm(stim_file, 8)
 
 
+  def gen_stim_sparse(self, stim_file):
+
+    self.dump('  Generating to file: ' + stim_file)
+
+    write_sparse_stim(stim_file, merge_sparse_records(self.__get_segments()))
+
+
   def gen_stim_bin(self, stim_file):
 
     self.__parse_binaries(1)
@@ -539,6 +616,7 @@ if __name__ == "__main__":
 
   parser.add_argument("--binary", dest="binary", default=None, help="Specify input binary")
   parser.add_argument("--vectors", dest="vectors", default=None, help="Specify output vectors file")
+  parser.add_argument("--sparse", dest="sparse", default=None, help="Specify output sparse binary stimuli file")
 
   args = parser.parse_args()
 
@@ -552,3 +630,11 @@ if __name__ == "__main__":
     stim_gen.add_binary(args.binary)
 
     stim_gen.gen_stim_slm_64(args.vectors)
+
+  if args.sparse is not None:
+
+    stim_gen = stim(verbose=True)
+
+    stim_gen.add_binary(args.binary)
+
+    stim_gen.gen_stim_sparse(args.sparse)
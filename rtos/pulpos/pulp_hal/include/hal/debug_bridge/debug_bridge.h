@@ -39,7 +39,7 @@ static inline hal_bridge_t *hal_bridge_get()
 }
 
 
-#define HAL_DEBUG_STRUCT_INIT { PROTOCOL_VERSION_4, {0}, {0}, 0, 1, 0 ,0, {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0}, 0, 0, 0, 0, 0, 0, 0, 0, 0}
+#define HAL_DEBUG_STRUCT_INIT { PROTOCOL_VERSION_6, {0}, {0}, 0, 1, 0 ,0, {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0}, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0}
 
 
 static inline int hal_bridge_is_connected(hal_bridge_t *bridge) {
@@ -111,6 +111,17 @@ static inline void hal_bridge_fb_update(hal_bridge_req_t *req, uint64_t fb, unsi
   req->fb_update.posy = posy;
   req->fb_update.width = width;
   req->fb_update.height = height;
+  req->fb_update.dirty = 0;
+  req->fb_update.dirty_rows = 0;
+}
+
+// Same as hal_bridge_fb_update but only the bands of dirty_rows lines whose
+// bit is set in the dirty bitmap are transferred to the host.
+static inline void hal_bridge_fb_update_dirty(hal_bridge_req_t *req, uint64_t fb, unsigned int addr, int posx, int posy, int width, int height, uint8_t *dirty, int dirty_rows)
+{
+  hal_bridge_fb_update(req, fb, addr, posx, posy, width, height);
+  req->fb_update.dirty = (uint32_t)(long)dirty;
+  req->fb_update.dirty_rows = dirty_rows;
 }
 
 static inline void hal_bridge_target_status_sync(hal_bridge_req_t *req)
@@ -173,4 +184,55 @@ static inline void hal_debug_reset(hal_debug_struct_t *debug_struct) {
   *(volatile uint32_t *)&debug_struct->exit_status = 0x80000000 | 0x40000000;    // 0xC0000000: reset
 }
 
+static inline void hal_bridge_stream_init(hal_bridge_stream_t *stream, const char *name, void *buffer, uint32_t size)
+{
+  stream->name = (uint32_t)(long)name;
+  stream->buffer = (uint32_t)(long)buffer;
+  stream->size = size;
+  stream->write = 0;
+  stream->read = 0;
+  stream->dropped = 0;
+}
+
+// Makes the stream channels visible to the bridge, which opens their outputs
+// the first time it sees them. The array must stay valid until the end of
+// the application and can be registered only once.
+static inline void hal_bridge_streams_register(hal_debug_struct_t *debug_struct, hal_bridge_stream_t *streams, int nb_streams)
+{
+  *(volatile uint32_t *)&debug_struct->streams = (uint32_t)(long)streams;
+  // The bridge only looks at the array once it sees the number of streams
+  __asm__ __volatile__ ("" : : : "memory");
+  *(volatile uint32_t *)&debug_struct->nb_streams = nb_streams;
+}
+
+// Pushes data to a stream channel, returns 0 if it was written or -1 if it
+// was dropped because the channel is full.
+static inline int hal_bridge_stream_write(hal_bridge_stream_t *stream, const void *data, uint32_t size)
+{
+  const uint8_t *src = (const uint8_t *)data;
+  uint8_t *buffer = (uint8_t *)stream->buffer;
+  uint32_t write = stream->write;
+  uint32_t read = stream->read;
+  uint32_t space = read > write ? read - write - 1 : stream->size - write + read - 1;
+
+  if (size > space)
+  {
+    stream->dropped += size;
+    return -1;
+  }
+
+  for (uint32_t i=0; i<size; i++)
+  {
+    buffer[write] = src[i];
+    if (++write == stream->size)
+      write = 0;
+  }
+
+  // The data must be visible before the bridge sees the new index
+  __asm__ __volatile__ ("" : : : "memory");
+  stream->write = write;
+
+  return 0;
+}
+
 #endif
@@ -23,11 +23,27 @@
 
 #include <json.hpp>
 #include <map>
+#include <vector>
 
 #ifdef USE_DPI
 #include "questa/dpiheader.h"
 #endif
 
+// Highest trace level which is compiled in the models using DPI_TRACE,
+// messages above it are removed at compile time. Can be lowered from the
+// model flags, e.g. -DDPI_TRACE_MAX_LEVEL=2.
+#ifndef DPI_TRACE_MAX_LEVEL
+#define DPI_TRACE_MAX_LEVEL 4
+#endif
+
+// To be used instead of trace_msg on hot paths, the arguments are not even
+// evaluated when the level is disabled.
+#define DPI_TRACE(model, trace, level, ...)                                 \
+  do {                                                                      \
+    if ((level) <= DPI_TRACE_MAX_LEVEL && (model)->trace_is_enabled(level)) \
+      (model)->trace_msg(trace, level, __VA_ARGS__);                        \
+  } while(0)
+
 
 
 class Dpi_itf
@@ -118,14 +134,18 @@ class Ctrl_itf : public Dpi_itf
 
 class Dpi_handler {
 public:
-  Dpi_handler(void *arg0, void *arg1, int64_t time) : arg0(arg0), arg1(arg1), time(time) {}
   void *arg0;
   void *arg1;
   int64_t time;
+  // Creation order, to keep the order of handlers with the same time
+  uint64_t seq;
+  // Next free handler, when the handler is in the pool
   Dpi_handler *next;
 };
 
 
+class Dpi_trace_sink;
+
 class Dpi_model
 {
 public:
@@ -152,6 +172,9 @@ public:
 
 protected:
   void *trace_new(const char *name);
+  // Messages above the model trace level, given by the trace_level item of
+  // the model configuration, are dropped before being formatted
+  bool trace_is_enabled(int level) { return level <= this->trace_level; }
   void trace_msg(void *trace, int level, const char *format, ...);
   void print(const char *format, ...);
   void fatal(const char *format, ...);
@@ -161,7 +184,15 @@ private:
   js::config *config;
   std::map<std::string, Dpi_itf *> itfs;
   void *handle;
-  Dpi_handler *first_handler;
+  // Pending delayed handlers, as a binary heap ordered by time, and pool
+  // of handlers already executed, which are reused for the next ones
+  std::vector<Dpi_handler *> handlers;
+  Dpi_handler *free_handlers;
+  uint64_t handler_seq;
+  int trace_level;
+  // Binary trace file, given by the trace_file item of the model
+  // configuration, where messages are dumped unformatted, or NULL
+  Dpi_trace_sink *trace_sink;
 };
 
 typedef enum
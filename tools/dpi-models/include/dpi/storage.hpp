@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2018 ETH Zurich and University of Bologna
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __DPI_STORAGE_HPP__
+#define __DPI_STORAGE_HPP__
+
+#include <stdint.h>
+#include <string>
+
+// Sparse binary stimuli, as generated by stim_utils.py. The file starts with
+// the magic and the version, followed by the number of records as a 32 bits
+// word. Each record has the address and size as 32 bits words, followed by
+// the data bytes. Everything is little-endian.
+#define DPI_STIM_MAGIC   "PULPSTIM"
+#define DPI_STIM_VERSION 1
+
+// Memory array of the flash and RAM models, which is mapped instead of
+// being allocated and read. The pages are only loaded when accessed, and
+// the ones of the image file are shared through the page cache by all the
+// simulations using it, until they are written. This is also the case for
+// the erased part of the memory, which is mapped from a template file
+// kept in a directory private to the user.
+class Dpi_storage
+{
+public:
+  Dpi_storage() : data(NULL), size(0), is_shared(false) {}
+  ~Dpi_storage();
+
+  // Maps size bytes, initialized with the content of the image file if any,
+  // and with fill for the rest. Writes only modify a private copy, unless
+  // persist_file is given, in which case the memory is this file, which is
+  // created from the image the first time, and then keeps the content
+  // across simulations.
+  // Returns false and sets the error if the files could not be used, the
+  // memory is then only filled.
+  bool open(size_t size, uint8_t fill, std::string image, std::string persist_file="");
+
+  // Writes the content back to the persistent file
+  void sync();
+
+  // Writes the stimuli file into the memory. This can be either a sparse
+  // binary file or an SLM text file with one "@<address> <byte>" per line.
+  // The data outside the memory are ignored.
+  bool load_stim(std::string path);
+
+  unsigned char *get_data() { return data; }
+  std::string get_error() { return error; }
+
+private:
+  bool map_image(std::string image, uint8_t fill);
+  bool map_persist_file(std::string image, std::string path, uint8_t fill);
+  void fill_range(size_t offset, uint8_t fill);
+  bool map_fill(size_t offset, uint8_t fill);
+  bool load_stim_slm(FILE *file, std::string path);
+
+  unsigned char *data;
+  size_t size;
+  bool is_shared;
+  std::string error;
+};
+
+#endif
@@ -25,6 +25,8 @@
 #include <netinet/in.h>
 #include <stdint.h>
 #include <unistd.h>
+#include <vector>
+#include <algorithm>
 
 
 #include "dpi/models.hpp"
@@ -51,8 +53,11 @@ private:
   void proxy_listener();
   void proxy_loop(int sock);
   bool open_proxy();
+  bool recv_all(int sock, void *buffer, int size);
+  bool send_all(int sock, void *buffer, int size);
+  bool jtag_packed_req(int sock, proxy_req_t *req);
   void jtag_buff_cycle(int tdi, int tms, int trstn);
-  void jtag_buff_flush();
+  void jtag_buff_flush(bool wait_done);
   void dpi_task();
   static void dpi_task_stub(Proxy *proxy);
   void reset_req(int value, int duration);
@@ -68,9 +73,14 @@ private:
   int proxy_socket_in;
   bool listener_error;
 
+  // Cycles being executed by the DPI task
   jtag_cycle_t *jtag_buff = NULL;
   int jtag_buff_size = 0;
   int jtag_buff_current = 0;
+  // Cycles being received from the socket while the other buffer is executed
+  jtag_cycle_t *jtag_fill_buff = NULL;
+  int jtag_fill_size = 0;
+  int jtag_fill_current = 0;
   bool jtag_has_buff = false;
   bool has_req = false;
   bool has_str = false;
@@ -109,28 +119,38 @@ void Proxy::start()
 
 void Proxy::jtag_buff_cycle(int tdi, int tms, int trstn)
 {
-  if (jtag_buff_current >= jtag_buff_size) {
-    if (jtag_buff_size == 0) jtag_buff_size = 256;
-    else jtag_buff_size *= 2;
-    jtag_buff = (jtag_cycle_t *)realloc(jtag_buff, jtag_buff_size*sizeof(jtag_cycle_t));
+  if (jtag_fill_current >= jtag_fill_size) {
+    if (jtag_fill_size == 0) jtag_fill_size = 256;
+    else jtag_fill_size *= 2;
+    jtag_fill_buff = (jtag_cycle_t *)realloc(jtag_fill_buff, jtag_fill_size*sizeof(jtag_cycle_t));
   }
-  jtag_buff[jtag_buff_current].tdi = tdi;
-  jtag_buff[jtag_buff_current].tms = tms;
-  jtag_buff[jtag_buff_current].trstn = trstn;
-  jtag_buff_current++;
+  jtag_fill_buff[jtag_fill_current].tdi = tdi;
+  jtag_fill_buff[jtag_fill_current].tms = tms;
+  jtag_fill_buff[jtag_fill_current].trstn = trstn;
+  jtag_fill_current++;
 }
 
-void Proxy::jtag_buff_flush()
+// Hands the filled cycles over to the DPI task. If the caller does not need
+// TDO, it can go on receiving the next request while they are executed.
+void Proxy::jtag_buff_flush(bool wait_done)
 {
+  if (jtag_fill_current == 0) return;
+
   pthread_mutex_lock(&mutex);
   while(has_req || jtag_has_buff) pthread_cond_wait(&cond, &mutex);
+  std::swap(jtag_buff, jtag_fill_buff);
+  std::swap(jtag_buff_size, jtag_fill_size);
+  jtag_buff_current = jtag_fill_current;
+  jtag_fill_current = 0;
   jtag_has_buff = true;
   pthread_mutex_unlock(&mutex);
   raise_event_from_ext();
-  pthread_mutex_lock(&mutex);
-  while(jtag_has_buff) pthread_cond_wait(&cond, &mutex);
-  pthread_mutex_unlock(&mutex);
-  jtag_buff_current = 0;
+  if (wait_done)
+  {
+    pthread_mutex_lock(&mutex);
+    while(jtag_has_buff) pthread_cond_wait(&cond, &mutex);
+    pthread_mutex_unlock(&mutex);
+  }
 }
 
 void Proxy::reset_req(int value, int duration)
@@ -166,26 +186,120 @@ void Proxy::config_req(int value)
   pthread_mutex_unlock(&mutex);
 }
 
+bool Proxy::recv_all(int sock, void *buffer, int size)
+{
+  char *ptr = (char *)buffer;
+  while (size > 0)
+  {
+    int ret = ::recv(sock, ptr, size, 0);
+    if (ret <= 0)
+    {
+      if (ret < 0 && errno == EINTR) continue;
+      return false;
+    }
+    ptr += ret;
+    size -= ret;
+  }
+  return true;
+}
+
+bool Proxy::send_all(int sock, void *buffer, int size)
+{
+  char *ptr = (char *)buffer;
+  while (size > 0)
+  {
+    int ret = ::send(sock, ptr, size, 0);
+    if (ret < 0)
+    {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    ptr += ret;
+    size -= ret;
+  }
+  return true;
+}
+
+bool Proxy::jtag_packed_req(int sock, proxy_req_t *req)
+{
+  unsigned int bits = req->jtag_packed.bits;
+  int flags = req->jtag_packed.flags;
+  int trstn = req->jtag_packed.trstn;
+  std::vector<uint8_t> tdi((DEBUG_BRIDGE_JTAG_PACKED_CHUNK + 7) / 8);
+  std::vector<uint8_t> tms((DEBUG_BRIDGE_JTAG_PACKED_CHUNK + 7) / 8);
+  std::vector<uint8_t> tdo((DEBUG_BRIDGE_JTAG_PACKED_CHUNK + 7) / 8);
+
+  // The request is executed chunk by chunk so that its size is not limited
+  // by the buffers
+  for (unsigned int bit=0; bit<bits; bit+=DEBUG_BRIDGE_JTAG_PACKED_CHUNK)
+  {
+    unsigned int chunk_bits = std::min(bits - bit, (unsigned int)DEBUG_BRIDGE_JTAG_PACKED_CHUNK);
+    int chunk_bytes = (chunk_bits + 7) / 8;
+
+    if (!recv_all(sock, (void *)tdi.data(), chunk_bytes)) return false;
+    if (flags & DEBUG_BRIDGE_JTAG_PACKED_TMS)
+    {
+      if (!recv_all(sock, (void *)tms.data(), chunk_bytes)) return false;
+    }
+
+    for (unsigned int i=0; i<chunk_bits; i++)
+    {
+      int tdi_bit = (tdi[i / 8] >> (i % 8)) & 1;
+      int tms_bit = 0;
+      if (flags & DEBUG_BRIDGE_JTAG_PACKED_TMS)
+        tms_bit = (tms[i / 8] >> (i % 8)) & 1;
+      else if (flags & DEBUG_BRIDGE_JTAG_PACKED_TMS_LAST)
+        tms_bit = bit + i == bits - 1;
+      jtag_buff_cycle(tdi_bit, tms_bit, trstn);
+    }
+
+    jtag_buff_flush(flags & DEBUG_BRIDGE_JTAG_PACKED_TDO);
+
+    if (flags & DEBUG_BRIDGE_JTAG_PACKED_TDO)
+    {
+      ::memset((void *)tdo.data(), 0, chunk_bytes);
+      for (unsigned int i=0; i<chunk_bits; i++)
+      {
+        // Set TDO to 0 in case the platform reported another value than 0
+        // or 1 (e.g. X)
+        unsigned int value = jtag_buff[i].tdo;
+        tdo[i / 8] |= (value <= 1 ? value : 0) << (i % 8);
+      }
+      if (!send_all(sock, (void *)tdo.data(), chunk_bytes)) return false;
+    }
+  }
+
+  return true;
+}
+
 void Proxy::proxy_loop(int sock)
 {
   while(1) {
 
     proxy_req_t req;
 
-    int ret = recv(sock, (void *)&req, sizeof(req), 0);
-
-    if(ret != sizeof(req)) {
+    if (!recv_all(sock, (void *)&req, sizeof(req))) {
       return;
     }
 
-    if (req.type == DEBUG_BRIDGE_JTAG_REQ)
+    if (req.type == DEBUG_BRIDGE_HELLO_REQ)
+    {
+      proxy_req_t reply = { .type=DEBUG_BRIDGE_HELLO_REQ };
+      reply.hello.version = DEBUG_BRIDGE_PROXY_VERSION;
+      if (!send_all(sock, (void *)&reply, sizeof(reply))) return;
+    }
+    else if (req.type == DEBUG_BRIDGE_JTAG_PACKED_REQ)
+    {
+      if (!jtag_packed_req(sock, &req)) return;
+    }
+    else if (req.type == DEBUG_BRIDGE_JTAG_REQ)
     {
       uint8_t buffer[req.jtag.bits];
       uint8_t out_buffer[(req.jtag.bits + 7) / 8];
       uint8_t value = 0;
       uint8_t *out_ptr = out_buffer;
 
-      ::recv(sock, (void *)buffer, req.jtag.bits, 0);
+      if (!recv_all(sock, (void *)buffer, req.jtag.bits)) return;
 
 
       for (int i=0; i<req.jtag.bits; i++)
@@ -198,7 +312,7 @@ void Proxy::proxy_loop(int sock)
         jtag_buff_cycle(tdi, tms, trst);
       }
 
-      jtag_buff_flush();
+      jtag_buff_flush(req.jtag.tdo);
 
       if (req.jtag.tdo)
       {
@@ -210,7 +210,7 @@ long long Stim_txt::getDataFromFile()
 
     long long result = getSignedValue(data, width);
 
-    this->top->trace_msg(this->top->trace, 4, "Got new sample1 (value: 0x%x)", result);
+    DPI_TRACE(this->top, this->top->trace, 4, "Got new sample1 (value: 0x%x)", result);
     return result;
   } else {
     char *line = NULL;
@@ -223,7 +223,7 @@ long long Stim_txt::getDataFromFile()
     unsigned long long data = strtol(line, NULL, 16);
     long long result = getSignedValue(data, width);
 
-    this->top->trace_msg(this->top->trace, 4, "Got new sample2 (value: 0x%x)", result);
+    DPI_TRACE(this->top, this->top->trace, 4, "Got new sample2 (value: 0x%x)", result);
   
     return result;
   }
@@ -256,7 +256,7 @@ long long Stim_txt::getData(int64_t timestamp)
   float value = (float)lastData + (float)(nextData - lastData) * coeff;
 
 
-  top->trace_msg(this->top->trace, 4, "Interpolated new sample (value: %d, timestamp: %ld, prev_timestamp: %ld, next_timestamp: %ld, prev_value: %d, next_value: %d)", value, timestamp, lastDataTime, nextDataTime, lastData, nextData);
+  DPI_TRACE(top, this->top->trace, 4, "Interpolated new sample (value: %d, timestamp: %ld, prev_timestamp: %ld, next_timestamp: %ld, prev_value: %d, next_value: %d)", value, timestamp, lastDataTime, nextDataTime, lastData, nextData);
   
 
   //printf("%f %f %d %d %ld %ld %ld\n", coeff, value, lastData, nextData, lastDataTime, timestamp, nextDataTime);
@@ -376,7 +376,7 @@ void Microphone::setData(int64_t timestamp, int sck, int ws)
 
 void Microphone::edge(int64_t timestamp, int sck, int ws, int sd)
 {
-  this->trace_msg(this->trace, 4, "Edge (sck: %d, ws: %d)", sck, ws);
+  DPI_TRACE(this, this->trace, 4, "Edge (sck: %d, ws: %d)", sck, ws);
 
   if (ddr) {
 
@@ -19,6 +19,7 @@
  */
 
 #include "dpi/models.hpp"
+#include "dpi/storage.hpp"
 #include <stdint.h>
 #include <vector>
 
@@ -80,6 +81,7 @@ private:
   int current_write_addr;
   int current_size;
   int current_write_size;
+  Dpi_storage storage;
   unsigned char *data;
   int nb_bits;
   int nb_write_bits;
@@ -111,7 +113,38 @@ Spiram::Spiram(js::config *config, void *handle) : Dpi_model(config, handle)
   this->mem_size = config->get("mem_size")->get_int();
   verbose = true; //config->get("verbose")->get_bool();
   print("Creating SPIRAM model (mem_size: 0x%x)", this->mem_size);
-  data = new unsigned char[mem_size];
+
+  // The memory is mapped, so that only the accessed pages are allocated
+  js::config *stim_file_conf = config->get("stim_file");
+  if (stim_file_conf == NULL)
+  {
+    stim_file_conf = config->get("preload_file");
+  }
+  js::config *persist_file_conf = config->get("persist_file");
+
+  std::string stim_file = stim_file_conf ? stim_file_conf->get_str() : "";
+  std::string persist_file = persist_file_conf ? persist_file_conf->get_str() : "";
+
+  if (!this->storage.open(this->mem_size, 0, stim_file, persist_file))
+  {
+    print("Failed to preload memory (%s)", this->storage.get_error().c_str());
+  }
+  data = this->storage.get_data();
+  if (data == NULL)
+  {
+    fatal("Failed to allocate memory (%s)", this->storage.get_error().c_str());
+  }
+
+  // Either a sparse binary file or an SLM text file
+  js::config *slm_stim_file_conf = config->get("slm_stim_file");
+  if (slm_stim_file_conf != NULL)
+  {
+    if (!this->storage.load_stim(slm_stim_file_conf->get_str()))
+    {
+      print("Failed to load stimuli (%s)", this->storage.get_error().c_str());
+    }
+  }
+
   qspi0 = new Spiram_qspi_itf(this);
   create_itf("input", static_cast<Dpi_itf *>(qspi0));
 
@@ -183,7 +216,7 @@ void Spiram::cs_edge(int64_t timestamp, int cs)
 
   this->current_cs = cs;
 
-  this->trace_msg(this->trace, 3, "CS edge (timestamp: %ld, cs: %d)", timestamp, cs);
+  DPI_TRACE(this, this->trace, 3, "CS edge (timestamp: %ld, cs: %d)", timestamp, cs);
   if (cs == 1) {
     qspi0->set_data(3);
     this->state = STATE_GET_CMD;
@@ -200,7 +233,7 @@ void Spiram::edge(int64_t timestamp, int sdio0, int sdio1, int sdio2, int sdio3,
   if (this->check_refresh(timestamp))
     return;
 
-  this->trace_msg(this->trace, 4, "Edge (timestamp: %ld, data_0: %d, data_1: %d, data_2: %d, data_3: %d, mask: 0x%x)", timestamp, sdio0, sdio1, sdio2, sdio3, mask);
+  DPI_TRACE(this, this->trace, 4, "Edge (timestamp: %ld, data_0: %d, data_1: %d, data_2: %d, data_3: %d, mask: 0x%x)", timestamp, sdio0, sdio1, sdio2, sdio3, mask);
 
   handle_clk_high(timestamp, sdio0, sdio1, sdio2, sdio3, mask);
   handle_clk_low(timestamp, sdio0, sdio1, sdio2, sdio3, mask);
@@ -277,13 +310,13 @@ void Spiram::handle_clk_high(int64_t timestamp, int sdio0, int sdio1, int sdio2,
     if (this->qpi)
     {
       this->current_cmd = (this->current_cmd << 4) | (sdio0 << 0) | (sdio1 << 1) | (sdio2 << 2) | (sdio3 << 3);
-      this->trace_msg(this->trace, 4, "Received command bits (count: %d, pending: %x, bit0: %d, bit1: %d, bit2: %d, bit3: %d)", this->cmd_count, this->current_cmd, sdio0, sdio1, sdio2, sdio3);
+      DPI_TRACE(this, this->trace, 4, "Received command bits (count: %d, pending: %x, bit0: %d, bit1: %d, bit2: %d, bit3: %d)", this->cmd_count, this->current_cmd, sdio0, sdio1, sdio2, sdio3);
       this->cmd_count += 4;
     }
     else
     {
       this->current_cmd = (this->current_cmd << 1) | sdio0;
-      this->trace_msg(this->trace, 4, "Received command bit (count: %d, pending: %x, bit: %d)", this->cmd_count, this->current_cmd, sdio0);
+      DPI_TRACE(this, this->trace, 4, "Received command bit (count: %d, pending: %x, bit: %d)", this->cmd_count, this->current_cmd, sdio0);
       this->cmd_count++;
     }
     if (this->cmd_count == 8)
@@ -297,13 +330,13 @@ void Spiram::handle_clk_high(int64_t timestamp, int sdio0, int sdio1, int sdio2,
     if (this->qpi)
     {
       this->current_addr = (this->current_addr << 4) | (sdio0 << 0) | (sdio1 << 1) | (sdio2 << 2) | (sdio3 << 3);
-      this->trace_msg(this->trace, 4, "Received address bits (count: %d, pending: %x, bit0: %d, bit1: %d, bit2: %d, bit3: %d)", this->cmd_count, this->current_addr, sdio0, sdio1, sdio2, sdio3);
+      DPI_TRACE(this, this->trace, 4, "Received address bits (count: %d, pending: %x, bit0: %d, bit1: %d, bit2: %d, bit3: %d)", this->cmd_count, this->current_addr, sdio0, sdio1, sdio2, sdio3);
       this->cmd_count += 4;
     }
     else
     {
       this->current_addr = (this->current_addr << 1) | sdio0;
-      this->trace_msg(this->trace, 4, "Received address bit (count: %d, pending: %x, bit: %d)", this->cmd_count, this->current_addr, sdio0);
+      DPI_TRACE(this, this->trace, 4, "Received address bit (count: %d, pending: %x, bit: %d)", this->cmd_count, this->current_addr, sdio0);
       this->cmd_count++;
     }
     if (this->cmd_count == 24)
@@ -319,7 +352,7 @@ void Spiram::handle_clk_high(int64_t timestamp, int sdio0, int sdio1, int sdio2,
   }
   else if (this->state == STATE_WAIT_CYCLES)
   {
-    this->trace_msg(this->trace, 3, "Wait cycle (cycles: %d)", this->wait_cycles);
+    DPI_TRACE(this, this->trace, 3, "Wait cycle (cycles: %d)", this->wait_cycles);
     this->wait_cycles--;
     if (this->wait_cycles == 0)
     {
@@ -333,13 +366,13 @@ void Spiram::handle_clk_high(int64_t timestamp, int sdio0, int sdio1, int sdio2,
       if (this->qpi)
       {
         this->current_data = (this->current_data << 4) | (sdio0 << 0) | (sdio1 << 1) | (sdio2 << 2) | (sdio3 << 3);
-        this->trace_msg(this->trace, 4, "Received data bits (count: %d, pending: %x, bit0: %d, bit1: %d, bit2: %d, bit3: %d)", this->cmd_count, this->current_data, sdio0, sdio1, sdio2, sdio3);
+        DPI_TRACE(this, this->trace, 4, "Received data bits (count: %d, pending: %x, bit0: %d, bit1: %d, bit2: %d, bit3: %d)", this->cmd_count, this->current_data, sdio0, sdio1, sdio2, sdio3);
         this->cmd_count += 4;
       }
       else
       {
         this->current_data = (this->current_data << 1) | sdio0;
-        this->trace_msg(this->trace, 4, "Received data bit (count: %d, pending: %x, bit: %d)", this->cmd_count, this->current_data, sdio0);
+        DPI_TRACE(this, this->trace, 4, "Received data bit (count: %d, pending: %x, bit: %d)", this->cmd_count, this->current_data, sdio0);
         this->cmd_count++;
       }
       if (this->cmd_count == 8)
@@ -405,7 +438,7 @@ void Spiram::sck_edge(int64_t timestamp, int sck, int sdio0, int sdio1, int sdio
   if (this->check_refresh(timestamp))
     return;
 
-  this->trace_msg(this->trace, 4, "SCK edge (timestamp: %ld, sck: %d, data_0: %d, data_1: %d, data_2: %d, data_3: %d, mask: 0x%x)", timestamp, sck, sdio0, sdio1, sdio2, sdio3, mask);
+  DPI_TRACE(this, this->trace, 4, "SCK edge (timestamp: %ld, sck: %d, data_0: %d, data_1: %d, data_2: %d, data_3: %d, mask: 0x%x)", timestamp, sck, sdio0, sdio1, sdio2, sdio3, mask);
 
   if (prev_sck == 1 && !sck)
   {
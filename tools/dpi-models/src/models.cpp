@@ -22,6 +22,12 @@
 #include <stdio.h>
 #include <stdarg.h>
 #include <vector>
+#include <algorithm>
+#include <map>
+#include <unordered_map>
+#include <mutex>
+#include <string.h>
+#include <limits.h>
 
 #include <json.hpp>
 #include <dlfcn.h>
@@ -33,104 +39,337 @@ static std::vector<void *> tasks_arg;
 static std::vector<void *> handlers_cb;
 static std::vector<void *> handlers_arg;
 
-static void dpi_fatal_stub(void *handle, const char *format, ...)
+// Size of the stack buffer used to format messages, bigger ones are
+// formatted into a heap buffer
+#define DPI_MSG_SIZE 1024
+
+// Formats the message into buffer, which must have DPI_MSG_SIZE bytes, or
+// into big if it does not fit, and returns the formatted message
+static const char *dpi_vformat(char *buffer, std::vector<char> &big, const char *format, va_list ap)
 {
-  int size = 1024;
-  while(1)
+  va_list ap_copy;
+  va_copy(ap_copy, ap);
+  int size = vsnprintf(buffer, DPI_MSG_SIZE, format, ap);
+  if (size >= DPI_MSG_SIZE)
   {
-    char str[size];
-    va_list ap;
-    va_start(ap, format);
-    int iter_size = vsnprintf(str, size, format, ap);
-    va_end(ap);
-    if (iter_size <= size)
-    {
-      dpi_fatal(handle, str);
-      break;
-    }
-    size = iter_size;
+    big.resize(size + 1);
+    vsnprintf(big.data(), size + 1, format, ap_copy);
+    buffer = big.data();
   }
+  va_end(ap_copy);
+  return buffer;
+}
+
+static void dpi_fatal_stub(void *handle, const char *format, ...)
+{
+  char buffer[DPI_MSG_SIZE];
+  std::vector<char> big;
+  va_list ap;
+  va_start(ap, format);
+  dpi_fatal(handle, dpi_vformat(buffer, big, format, ap));
+  va_end(ap);
 }
 
 static void dpi_print_stub(void *handle, const char *format, ...)
 {
-  int size = 1024;
-  while(1)
+  char buffer[DPI_MSG_SIZE];
+  std::vector<char> big;
+  va_list ap;
+  va_start(ap, format);
+  dpi_print(handle, dpi_vformat(buffer, big, format, ap));
+  va_end(ap);
+}
+
+// Trace returned to the models, which wraps the one of the simulator
+class Dpi_trace
+{
+public:
+  void *handle;
+  uint32_t id;
+};
+
+// Binary trace file. Messages are dumped with their format and raw
+// arguments, and are only formatted when the file is decoded, with
+// dpi_trace_dump. The file starts with DPI_TRACE_MAGIC and the version, and
+// is then made of records starting with their type:
+//   'T' u32 trace id, u16 name size, name
+//   'F' u32 format id, u16 format size, format
+//   'M' i64 time, u32 trace id, u32 format id, u8 level, u8 nb args, and
+//       for each argument its type followed by its value: 'i' i64, 'u' u64,
+//       'd' double, 's' u16 size and string
+#define DPI_TRACE_MAGIC   "DPITRACE"
+#define DPI_TRACE_VERSION 1
+
+typedef enum {
+  DPI_TRACE_ARG_INT,
+  DPI_TRACE_ARG_LONG,
+  DPI_TRACE_ARG_UINT,
+  DPI_TRACE_ARG_ULONG,
+  DPI_TRACE_ARG_POINTER,
+  DPI_TRACE_ARG_DOUBLE,
+  DPI_TRACE_ARG_LONG_DOUBLE,
+  DPI_TRACE_ARG_STRING
+} Dpi_trace_arg_e;
+
+class Dpi_trace_format
+{
+public:
+  uint32_t id;
+  std::vector<Dpi_trace_arg_e> args;
+};
+
+class Dpi_trace_sink
+{
+public:
+  static Dpi_trace_sink *get(std::string path);
+
+  uint32_t dump_trace(const char *name);
+  void dump_msg(int64_t time, uint32_t trace_id, int level, const char *format, va_list ap);
+  void flush() { fflush(this->file); }
+
+private:
+  Dpi_trace_sink(FILE *file) : file(file), nb_traces(0) {}
+  void dump_str(const char *str);
+  Dpi_trace_format *get_format(const char *format);
+
+  FILE *file;
+  std::mutex mutex;
+  uint32_t nb_traces;
+  // Formats are identified by their address, as they are literals
+  std::unordered_map<const char *, Dpi_trace_format> formats;
+  std::vector<uint8_t> record;
+};
+
+// All the models configured with the same file share the same sink
+static std::map<std::string, Dpi_trace_sink *> trace_sinks;
+
+Dpi_trace_sink *Dpi_trace_sink::get(std::string path)
+{
+  auto it = trace_sinks.find(path);
+  if (it != trace_sinks.end())
+    return it->second;
+
+  FILE *file = fopen(path.c_str(), "wb");
+  if (file == NULL)
+    return NULL;
+
+  uint32_t version = DPI_TRACE_VERSION;
+  fwrite(DPI_TRACE_MAGIC, 1, 8, file);
+  fwrite(&version, 4, 1, file);
+
+  Dpi_trace_sink *sink = new Dpi_trace_sink(file);
+  trace_sinks[path] = sink;
+  return sink;
+}
+
+template<class T> static void dpi_trace_push(std::vector<uint8_t> &record, T value)
+{
+  uint8_t *data = (uint8_t *)&value;
+  record.insert(record.end(), data, data + sizeof(T));
+}
+
+void Dpi_trace_sink::dump_str(const char *str)
+{
+  uint16_t size = strnlen(str, 0xffff);
+  dpi_trace_push(this->record, size);
+  this->record.insert(this->record.end(), str, str + size);
+}
+
+uint32_t Dpi_trace_sink::dump_trace(const char *name)
+{
+  std::lock_guard<std::mutex> lock(this->mutex);
+  uint32_t id = this->nb_traces++;
+
+  this->record.clear();
+  this->record.push_back('T');
+  dpi_trace_push(this->record, id);
+  this->dump_str(name);
+  fwrite(this->record.data(), 1, this->record.size(), this->file);
+
+  return id;
+}
+
+Dpi_trace_format *Dpi_trace_sink::get_format(const char *format)
+{
+  auto it = this->formats.find(format);
+  if (it != this->formats.end())
+    return &it->second;
+
+  Dpi_trace_format *result = &this->formats[format];
+  result->id = this->formats.size() - 1;
+
+  // Walk the conversions of the format to get the types of the arguments,
+  // which are then used for all the messages with this format
+  for (const char *current = format; *current; current++)
   {
-    char str[size];
-    va_list ap;
-    va_start(ap, format);
-    int iter_size = vsnprintf(str, size, format, ap);
-    va_end(ap);
-    if (iter_size <= size)
+    if (*current != '%') continue;
+    current++;
+    if (*current == '%') continue;
+
+    int length = 0;
+    for (; *current && strchr("-+ #0123456789.*hlLqjzt", *current); current++)
     {
-      dpi_print(handle, str);
-      break;
+      if (*current == '*')
+        result->args.push_back(DPI_TRACE_ARG_INT);
+      else if (*current == 'l' || *current == 'q' || *current == 'j' || *current == 'z' || *current == 't')
+        length++;
+      else if (*current == 'L')
+        length = 3;
+    }
+
+    if (*current == 0) break;
+
+    switch (*current)
+    {
+      case 'd': case 'i':
+        result->args.push_back(length ? DPI_TRACE_ARG_LONG : DPI_TRACE_ARG_INT);
+        break;
+
+      case 'u': case 'x': case 'X': case 'o': case 'c':
+        result->args.push_back(length ? DPI_TRACE_ARG_ULONG : DPI_TRACE_ARG_UINT);
+        break;
+
+      case 'p':
+        result->args.push_back(DPI_TRACE_ARG_POINTER);
+        break;
+
+      case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+        result->args.push_back(length == 3 ? DPI_TRACE_ARG_LONG_DOUBLE : DPI_TRACE_ARG_DOUBLE);
+        break;
+
+      case 's':
+        result->args.push_back(DPI_TRACE_ARG_STRING);
+        break;
+
+      default:
+        // Unknown conversion, the next arguments can not be decoded
+        current = format + strlen(format) - 1;
+        break;
     }
-    size = iter_size;
   }
+
+  this->record.clear();
+  this->record.push_back('F');
+  dpi_trace_push(this->record, result->id);
+  this->dump_str(format);
+  fwrite(this->record.data(), 1, this->record.size(), this->file);
+
+  return result;
 }
 
-void Dpi_model::print(const char *format, ...)
+void Dpi_trace_sink::dump_msg(int64_t time, uint32_t trace_id, int level, const char *format, va_list ap)
 {
-  int size = 1024;
-  while(1)
+  std::lock_guard<std::mutex> lock(this->mutex);
+  Dpi_trace_format *trace_format = this->get_format(format);
+
+  this->record.clear();
+  this->record.push_back('M');
+  dpi_trace_push(this->record, time);
+  dpi_trace_push(this->record, trace_id);
+  dpi_trace_push(this->record, trace_format->id);
+  this->record.push_back(level);
+  this->record.push_back(trace_format->args.size());
+
+  for (Dpi_trace_arg_e arg: trace_format->args)
   {
-    char str[size];
-    va_list ap;
-    va_start(ap, format);
-    int iter_size = vsnprintf(str, size, format, ap);
-    va_end(ap);
-    if (iter_size <= size)
+    switch (arg)
     {
-      dpi_print(handle, str);
-      break;
+      case DPI_TRACE_ARG_INT:
+        this->record.push_back('i');
+        dpi_trace_push(this->record, (int64_t)va_arg(ap, int));
+        break;
+
+      case DPI_TRACE_ARG_LONG:
+        this->record.push_back('i');
+        dpi_trace_push(this->record, (int64_t)va_arg(ap, long long));
+        break;
+
+      case DPI_TRACE_ARG_UINT:
+        this->record.push_back('u');
+        dpi_trace_push(this->record, (uint64_t)va_arg(ap, unsigned int));
+        break;
+
+      case DPI_TRACE_ARG_ULONG:
+        this->record.push_back('u');
+        dpi_trace_push(this->record, (uint64_t)va_arg(ap, unsigned long long));
+        break;
+
+      case DPI_TRACE_ARG_POINTER:
+        this->record.push_back('u');
+        dpi_trace_push(this->record, (uint64_t)(uintptr_t)va_arg(ap, void *));
+        break;
+
+      case DPI_TRACE_ARG_DOUBLE:
+        this->record.push_back('d');
+        dpi_trace_push(this->record, va_arg(ap, double));
+        break;
+
+      case DPI_TRACE_ARG_LONG_DOUBLE:
+        this->record.push_back('d');
+        dpi_trace_push(this->record, (double)va_arg(ap, long double));
+        break;
+
+      case DPI_TRACE_ARG_STRING: {
+        const char *str = va_arg(ap, const char *);
+        this->record.push_back('s');
+        this->dump_str(str ? str : "(null)");
+        break;
+      }
     }
-    size = iter_size;
   }
+
+  fwrite(this->record.data(), 1, this->record.size(), this->file);
+}
+
+void Dpi_model::print(const char *format, ...)
+{
+  char buffer[DPI_MSG_SIZE];
+  std::vector<char> big;
+  va_list ap;
+  va_start(ap, format);
+  dpi_print(handle, dpi_vformat(buffer, big, format, ap));
+  va_end(ap);
 }
 
 void *Dpi_model::trace_new(const char *name)
 {
-  return dpi_trace_new(this->handle, name);
+  Dpi_trace *trace = new Dpi_trace();
+  trace->handle = dpi_trace_new(this->handle, name);
+  trace->id = this->trace_sink ? this->trace_sink->dump_trace(name) : 0;
+  return (void *)trace;
 }
 
-void Dpi_model::trace_msg(void *trace, int level, const char *format, ...)
+void Dpi_model::trace_msg(void *_trace, int level, const char *format, ...)
 {
-  int size = 1024;
-  while(1)
+  if (!this->trace_is_enabled(level))
+    return;
+
+  Dpi_trace *trace = (Dpi_trace *)_trace;
+  va_list ap;
+  va_start(ap, format);
+
+  if (this->trace_sink)
   {
-    char str[size];
-    va_list ap;
-    va_start(ap, format);
-    int iter_size = vsnprintf(str, size, format, ap);
-    va_end(ap);
-    if (iter_size <= size)
-    {
-      dpi_trace_msg(trace, level, str);
-      break;
-    }
-    size = iter_size;
+    this->trace_sink->dump_msg(dpi_time(this->handle), trace->id, level, format, ap);
   }
+  else
+  {
+    char buffer[DPI_MSG_SIZE];
+    std::vector<char> big;
+    dpi_trace_msg(trace->handle, level, dpi_vformat(buffer, big, format, ap));
+  }
+
+  va_end(ap);
 }
 
 void Dpi_model::fatal(const char *format, ...)
 {
-  int size = 1024;
-  while(1)
-  {
-    char str[size];
-    va_list ap;
-    va_start(ap, format);
-    int iter_size = vsnprintf(str, size, format, ap);
-    va_end(ap);
-    if (iter_size <= size)
-    {
-      dpi_fatal(handle, str);
-      break;
-    }
-    size = iter_size;
-  }
+  char buffer[DPI_MSG_SIZE];
+  std::vector<char> big;
+  va_list ap;
+  va_start(ap, format);
+  dpi_fatal(handle, dpi_vformat(buffer, big, format, ap));
+  va_end(ap);
 }
 
 void Dpi_model::create_task(void *arg1, void *arg2)
@@ -149,28 +388,32 @@ void Dpi_model::create_periodic_handler(int64_t period, void *arg1, void *arg2)
   dpi_create_periodic_handler(handle, handler_id, period);
 }
 
-void Dpi_model::create_delayed_handler(int64_t period, void *arg1, void *arg2)
+// Heap comparator, the first handler is the one with the lowest time and,
+// for the same time, the most recently created one, as it was with the
+// previous sorted list where new handlers were inserted first.
+static bool dpi_handler_after(Dpi_handler *a, Dpi_handler *b)
 {
+  if (a->time != b->time)
+    return a->time > b->time;
+  return a->seq < b->seq;
+}
 
-  Dpi_handler *handler = new Dpi_handler(arg1, arg2, period + dpi_time(this->handle));
-
-  int64_t full_time = period + dpi_time(this->handle);
-
-  Dpi_handler *current = this->first_handler;
-  Dpi_handler *prev = NULL;
-
-  while (current && current->time < full_time)
-  {
-    prev = current;
-    current = current->next;
-  }
+void Dpi_model::create_delayed_handler(int64_t period, void *arg1, void *arg2)
+{
+  Dpi_handler *handler = this->free_handlers;
 
-  if (prev)
-    prev->next = handler;
+  if (handler)
+    this->free_handlers = handler->next;
   else
-    this->first_handler = handler;
+    handler = new Dpi_handler();
+
+  handler->arg0 = arg1;
+  handler->arg1 = arg2;
+  handler->time = period + dpi_time(this->handle);
+  handler->seq = this->handler_seq++;
 
-  handler->next = current;
+  this->handlers.push_back(handler);
+  std::push_heap(this->handlers.begin(), this->handlers.end(), dpi_handler_after);
 
   this->raise_task_event();
 }
@@ -196,9 +439,7 @@ void Dpi_model::callback_task()
 {
   while(1)
   {
-    Dpi_handler *current = this->first_handler;
-
-    if (!current)
+    if (this->handlers.empty())
     {
       this->wait_task_event();
     }
@@ -206,30 +447,48 @@ void Dpi_model::callback_task()
     {
       int64_t time = dpi_time(this->handle);
 
-      while (current && time >= current->time)
+      while (!this->handlers.empty() && time >= this->handlers.front()->time)
       {
+        Dpi_handler *current = this->handlers.front();
+
         print("Executing delayed handler");
-        this->first_handler = current->next;
+        std::pop_heap(this->handlers.begin(), this->handlers.end(), dpi_handler_after);
+        this->handlers.pop_back();
 
-        ((void (*)(void *))current->arg0)(current->arg1);
+        // The handler may create new ones, which can then reuse this one
+        void (*callback)(void *) = (void (*)(void *))current->arg0;
+        void *arg = current->arg1;
+        current->next = this->free_handlers;
+        this->free_handlers = current;
 
-        delete current;
-        current = this->first_handler;
+        callback(arg);
       }
 
 
-      if (this->first_handler)
+      if (!this->handlers.empty())
       {
-        print("Waiting for next delayed handler (time: %ld)", this->first_handler->time);
-        this->wait_task_event_timeout(this->first_handler->time - time);
+        print("Waiting for next delayed handler (time: %ld)", this->handlers.front()->time);
+        this->wait_task_event_timeout(this->handlers.front()->time - time);
       }
     }
   }
 }
 
 Dpi_model::Dpi_model(js::config *config, void *handle)
- : config(config), handle(handle), first_handler(NULL)
+ : config(config), handle(handle), free_handlers(NULL), handler_seq(0),
+   trace_level(INT_MAX), trace_sink(NULL)
 {
+  js::config *trace_level = config ? config->get("trace_level") : NULL;
+  if (trace_level)
+    this->trace_level = trace_level->get_int();
+
+  js::config *trace_file = config ? config->get("trace_file") : NULL;
+  if (trace_file)
+  {
+    this->trace_sink = Dpi_trace_sink::get(trace_file->get_str());
+    if (this->trace_sink == NULL)
+      this->print("Failed to open trace file (path: %s)", trace_file->get_str().c_str());
+  }
 }
 
 void Dpi_model::start_all()
@@ -241,6 +500,8 @@ void Dpi_model::start_all()
 void Dpi_model::stop_all()
 {
   this->stop();
+  if (this->trace_sink)
+    this->trace_sink->flush();
 }
 
 void Dpi_model::wait(int64_t ns)
@@ -0,0 +1,366 @@
+/*
+ * Copyright (C) 2018 ETH Zurich and University of Bologna
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <vector>
+
+#include "dpi/storage.hpp"
+
+Dpi_storage::~Dpi_storage()
+{
+  if (this->data)
+  {
+    this->sync();
+    munmap(this->data, this->size);
+  }
+}
+
+bool Dpi_storage::open(size_t size, uint8_t fill, std::string image, std::string persist_file)
+{
+  // The whole memory is first reserved with anonymous pages, which are
+  // lazily allocated, and the files are then mapped on top of it
+  this->size = size;
+  this->data = (unsigned char *)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (this->data == MAP_FAILED)
+  {
+    this->data = NULL;
+    this->error = "failed to allocate memory: " + std::string(strerror(errno));
+    return false;
+  }
+
+  bool ok = true;
+
+  if (persist_file != "")
+  {
+    if (this->map_persist_file(image, persist_file, fill))
+      return true;
+    ok = false;
+  }
+
+  if (image != "")
+  {
+    if (this->map_image(image, fill))
+      return ok;
+    ok = false;
+  }
+
+  this->fill_range(0, fill);
+
+  return ok;
+}
+
+bool Dpi_storage::map_image(std::string image, uint8_t fill)
+{
+  int fd = ::open(image.c_str(), O_RDONLY);
+  if (fd < 0)
+  {
+    this->error = "unable to open " + image + ": " + strerror(errno);
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0)
+  {
+    this->error = "unable to stat " + image + ": " + strerror(errno);
+    close(fd);
+    return false;
+  }
+
+  size_t image_size = (size_t)st.st_size < this->size ? st.st_size : this->size;
+
+  if (image_size && mmap(this->data, image_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED)
+  {
+    this->error = "unable to map " + image + ": " + strerror(errno);
+    close(fd);
+    return false;
+  }
+
+  close(fd);
+
+  // Only the part after the image needs to be filled, the end of its last
+  // page is zero in the mapping
+  this->fill_range(image_size, fill);
+
+  return true;
+}
+
+// Appends size bytes of fill to the file
+static bool dpi_storage_fill(int fd, uint8_t fill, size_t size)
+{
+  unsigned char buffer[4096];
+  memset(buffer, fill, sizeof(buffer));
+
+  while (size > 0)
+  {
+    size_t iter_size = size < sizeof(buffer) ? size : sizeof(buffer);
+    if (write(fd, buffer, iter_size) != (ssize_t)iter_size)
+      return false;
+    size -= iter_size;
+  }
+
+  return true;
+}
+
+void Dpi_storage::fill_range(size_t offset, uint8_t fill)
+{
+  if (fill == 0 || offset >= this->size)
+    return;
+
+  // Only the end of the page containing offset is written, the next pages
+  // are mapped from the fill template so that they stay shared until they
+  // are written, as anonymous zero pages would be.
+  size_t page_size = sysconf(_SC_PAGESIZE);
+  size_t map_offset = (offset + page_size - 1) & ~(page_size - 1);
+  if (map_offset > this->size)
+    map_offset = this->size;
+
+  memset(this->data + offset, fill, map_offset - offset);
+
+  if (map_offset < this->size && !this->map_fill(map_offset, fill))
+    memset(this->data + map_offset, fill, this->size - map_offset);
+}
+
+bool Dpi_storage::map_fill(size_t offset, uint8_t fill)
+{
+  // The template has the size of the whole memory, so that it can be used
+  // whatever the size of the image. It is created once and then shared by
+  // the simulations of the same user through the page cache.
+  // It is kept in a directory private to the user, as its content becomes
+  // the memory content. Anything not looking like what this function
+  // created makes the caller fall back to a plain fill.
+  const char *tmp_dir = getenv("TMPDIR");
+  char name[64];
+  snprintf(name, sizeof(name), "/dpi_storage-%u", (unsigned int)getuid());
+  std::string dir = std::string(tmp_dir ? tmp_dir : "/tmp") + name;
+  struct stat st;
+
+  if (mkdir(dir.c_str(), 0700) != 0 && errno != EEXIST)
+    return false;
+
+  if (lstat(dir.c_str(), &st) != 0 || !S_ISDIR(st.st_mode) || st.st_uid != getuid() || (st.st_mode & 077) != 0)
+    return false;
+
+  snprintf(name, sizeof(name), "/fill_%02x_%zx", fill, this->size);
+  std::string path = dir + name;
+
+  int fd = ::open(path.c_str(), O_RDONLY | O_NOFOLLOW);
+
+  if (fd < 0 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_uid != getuid() || (size_t)st.st_size != this->size)
+  {
+    if (fd >= 0)
+      close(fd);
+
+    // Created under a temporary name so that other simulations never see
+    // it partially written
+    std::string tmp_path = path + ".XXXXXX";
+    fd = mkstemp(&tmp_path[0]);
+    if (fd < 0)
+      return false;
+
+    if (!dpi_storage_fill(fd, fill, this->size) || rename(tmp_path.c_str(), path.c_str()) != 0)
+    {
+      close(fd);
+      unlink(tmp_path.c_str());
+      return false;
+    }
+  }
+
+  bool ok = mmap(this->data + offset, this->size - offset, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, offset) != MAP_FAILED;
+
+  close(fd);
+
+  return ok;
+}
+
+bool Dpi_storage::map_persist_file(std::string image, std::string path, uint8_t fill)
+{
+  int fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd < 0)
+  {
+    this->error = "unable to open " + path + ": " + strerror(errno);
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0)
+  {
+    this->error = "unable to stat " + path + ": " + strerror(errno);
+    close(fd);
+    return false;
+  }
+
+  size_t file_size = st.st_size;
+
+  // A new file gets the content of the image, and the file is then
+  // extended to the memory size so that the whole memory can be mapped
+  if (file_size == 0 && image != "")
+  {
+    FILE *image_file = fopen(image.c_str(), "rb");
+    if (image_file == NULL)
+    {
+      this->error = "unable to open " + image + ": " + strerror(errno);
+      close(fd);
+      return false;
+    }
+
+    unsigned char buffer[4096];
+    while (file_size < this->size)
+    {
+      size_t iter_size = this->size - file_size < sizeof(buffer) ? this->size - file_size : sizeof(buffer);
+      iter_size = fread(buffer, 1, iter_size, image_file);
+      if (iter_size == 0 || write(fd, buffer, iter_size) != (ssize_t)iter_size)
+        break;
+      file_size += iter_size;
+    }
+
+    fclose(image_file);
+  }
+
+  if (file_size < this->size)
+  {
+    lseek(fd, 0, SEEK_END);
+    if (!dpi_storage_fill(fd, fill, this->size - file_size))
+    {
+      this->error = "unable to extend " + path + ": " + strerror(errno);
+      close(fd);
+      return false;
+    }
+  }
+
+  if (mmap(this->data, this->size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED)
+  {
+    this->error = "unable to map " + path + ": " + strerror(errno);
+    close(fd);
+    return false;
+  }
+
+  close(fd);
+  this->is_shared = true;
+
+  return true;
+}
+
+void Dpi_storage::sync()
+{
+  if (this->is_shared)
+    msync(this->data, this->size, MS_SYNC);
+}
+
+bool Dpi_storage::load_stim(std::string path)
+{
+  if (this->data == NULL)
+  {
+    this->error = "memory is not allocated";
+    return false;
+  }
+
+  FILE *file = fopen(path.c_str(), "rb");
+  if (file == NULL)
+  {
+    this->error = "unable to open " + path + ": " + strerror(errno);
+    return false;
+  }
+
+  char magic[8];
+  if (fread(magic, 1, 8, file) != 8 || memcmp(magic, DPI_STIM_MAGIC, 8) != 0)
+  {
+    rewind(file);
+    bool result = this->load_stim_slm(file, path);
+    fclose(file);
+    return result;
+  }
+
+  // The whole file is read at once and the records are then copied
+  fseek(file, 0, SEEK_END);
+  long file_size = ftell(file);
+  std::vector<uint8_t> buffer(file_size);
+  rewind(file);
+  bool read_ok = fread(buffer.data(), 1, file_size, file) == (size_t)file_size;
+  fclose(file);
+
+  uint32_t version, nb_records;
+  size_t offset = 16;
+
+  if (!read_ok || file_size < 16)
+  {
+    this->error = "unable to read " + path;
+    return false;
+  }
+
+  memcpy(&version, &buffer[8], 4);
+  memcpy(&nb_records, &buffer[12], 4);
+
+  if (version != DPI_STIM_VERSION)
+  {
+    this->error = "unsupported stimuli version in " + path;
+    return false;
+  }
+
+  for (uint32_t i=0; i<nb_records; i++)
+  {
+    uint32_t addr, size;
+
+    if (offset + 8 > buffer.size())
+      break;
+
+    memcpy(&addr, &buffer[offset], 4);
+    memcpy(&size, &buffer[offset + 4], 4);
+    offset += 8;
+
+    if (size > buffer.size() - offset)
+      break;
+
+    if (addr < this->size)
+    {
+      size_t copy_size = this->size - addr < size ? this->size - addr : size;
+      memcpy(this->data + addr, &buffer[offset], copy_size);
+    }
+
+    offset += size;
+  }
+
+  if (offset != buffer.size())
+  {
+    this->error = "truncated stimuli file " + path;
+    return false;
+  }
+
+  return true;
+}
+
+bool Dpi_storage::load_stim_slm(FILE *file, std::string path)
+{
+  while(1)
+  {
+    unsigned int addr, value;
+    int err;
+    if ((err = fscanf(file, "@%x %x\n", &addr, &value)) != 2) {
+      if (err == EOF) break;
+      this->error = "incorrect stimuli file " + path;
+      return false;
+    }
+    if (addr < this->size) this->data[addr] = value;
+  }
+
+  return true;
+}
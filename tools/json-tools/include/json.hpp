@@ -28,15 +28,93 @@
 #include <stdio.h>
 #include <vector>
 #include <map>
+#include <unordered_map>
+#include <mutex>
 #include "string.h"
+#include <stdint.h>
 
 namespace js {
 
+  // Path which is parsed once and can then be resolved many times, to be
+  // used for lookups done often, e.g.:
+  //   static js::config_path path("**/chip/name");
+  //   config->get(path);
+  class config_path
+  {
+
+  public:
+    explicit config_path(std::string path);
+
+    const std::string &get_str() const { return path; }
+    const std::vector<std::string> &get_names() const { return names; }
+
+  private:
+    std::string path;
+    std::vector<std::string> names;
+  };
+
+  // Memory from which a parsed configuration is allocated. The source text
+  // is kept here, either mapped from the file or copied once, and the string
+  // values point directly into it, while the nodes are allocated in large
+  // blocks. Everything lives as long as the configuration, which is never
+  // freed.
+  class config_arena
+  {
+
+  public:
+    ~config_arena();
+
+    void *alloc(size_t size);
+    char *map_file(std::string path, size_t *size);
+    char *copy_string(const std::string &str);
+
+  private:
+    std::vector<char *> blocks;
+    size_t block_used = 0;
+    size_t block_size = 0;
+    std::vector<std::pair<char *, size_t>> mappings;
+  };
+
+  class config;
+
+  // Children of an object node. They are kept in a flat array in their
+  // declaration order, which is the iteration order, and found by name
+  // through an index sorted by name.
+  class config_childs
+  {
+
+  public:
+    typedef std::pair<std::string, config *> value_type;
+    typedef std::vector<value_type>::const_iterator const_iterator;
+
+    const_iterator begin() const { return items.begin(); }
+    const_iterator end() const { return items.end(); }
+    size_t size() const { return items.size(); }
+    bool empty() const { return items.empty(); }
+
+    config *find(const std::string &name) const;
+    // As for JSON objects, the last value wins when a name is pushed twice
+    void push(std::string name, config *child);
+    // Must be called once all the children are pushed, before any find
+    void build_index();
+
+  private:
+    std::vector<value_type> items;
+    std::vector<unsigned int> index;
+  };
+
   class config
   {
 
   public:
 
+    // Nodes can also be allocated from an arena, in which case they must not
+    // be deleted individually
+    void *operator new(size_t size) { return ::operator new(size); }
+    void *operator new(size_t size, config_arena *arena) { return arena->alloc(size); }
+    void operator delete(void *ptr) { ::operator delete(ptr); }
+    void operator delete(void *, config_arena *) {}
+
     virtual std::string get_str() { return ""; }
     virtual long long int get_int() { return 0; }
     virtual long long int get_int(std::string name)
@@ -48,37 +126,62 @@ namespace js {
 
     virtual void dump(std::string indent="");
     virtual config *get(std::string) { return NULL; }
+    virtual config *get(const config_path &) { return NULL; }
     virtual config *get_elem(int) { return NULL; }
     virtual size_t get_size() { return 0; }
     virtual bool get_bool() { return false; }
     virtual config *get_from_list(std::vector<std::string>) {
       return NULL;
     }
+    // Resolves the path made of the names starting at pos
+    virtual config *get_from_path(const std::vector<std::string> &names, size_t pos) {
+      return pos == names.size() ? this : NULL;
+    }
 
     virtual int get_child_int(std::string) { return 0; }
     virtual bool get_child_bool(std::string) { return false; }
     virtual std::string get_child_str(std::string) { return ""; }
 
-    virtual std::vector<config *> get_elems() {
-      return std::vector<config *> ();
-    }
-    virtual std::map<std::string, config *> get_childs() {
-      return std::map<std::string, config *>();
-    }
-    config *create_config(jsmntok_t *tokens, int *_size);
+    // Both return references to the node storage, no copy is done
+    virtual const std::vector<config *> &get_elems();
+    virtual const config_childs &get_childs();
+
+    config *create_config(jsmntok_t *tokens, int *_size, config_arena *arena=NULL);
+  };
+
+  // Binary image of a configuration, which can be mapped and turned into
+  // nodes without any parsing. The image starts with the size, modification
+  // time and hash of the JSON file it was generated from, so that it is
+  // only used as long as the file has not changed. Names and string values
+  // are interned in a single table and directly used from the mapping.
+  class config_cache
+  {
+
+  public:
+    // Returns NULL if there is no valid image for this source file
+    static config *load(std::string cache_path, std::string source_path, config_arena *arena);
+    static bool save(config *config, std::string cache_path, std::string source_path, uint64_t source_hash);
 
-    std::map<std::string, config *> childs;
+    // Path of the image of a source file inside the cache directory
+    static std::string get_path(std::string cache_dir, std::string source_path);
+    static uint64_t hash(const char *buffer, size_t size);
+
+  private:
+    class writer;
   };
 
   class config_object : public config
   {
 
   public:
-    config_object(jsmntok_t *tokens, int *size=NULL);
+    config_object() {}
+    config_object(jsmntok_t *tokens, int *size=NULL, config_arena *arena=NULL);
 
     config *get(std::string name);
+    config *get(const config_path &path);
     config *get_from_list(std::vector<std::string> name_list);
-    std::map<std::string, config *> get_childs() { return childs; }
+    config *get_from_path(const std::vector<std::string> &names, size_t pos);
+    const config_childs &get_childs() { return childs; }
 
     int get_child_int(std::string name);
     bool get_child_bool(std::string name);
@@ -86,16 +189,26 @@ namespace js {
 
     void dump(std::string indent="");
 
+    config_childs childs;
+
+  private:
+    config *lookup(const std::string &path, const std::vector<std::string> *names);
+
+    // Results of the previous lookups done from this node, including the
+    // failed ones, the tree is never modified once parsed. Only allocated
+    // for the nodes which are queried.
+    std::unordered_map<std::string, config *> *lookup_cache = NULL;
   };
 
   class config_array : public config
   {
 
   public:
-    config_array(jsmntok_t *tokens, int *size=NULL);
+    config_array() {}
+    config_array(jsmntok_t *tokens, int *size=NULL, config_arena *arena=NULL);
     config *get_from_list(std::vector<std::string> name_list);
 
-    std::vector<config *> get_elems() { return elems; }
+    const std::vector<config *> &get_elems() { return elems; }
     config *get_elem(int index) { return elems[index]; }
 
     size_t get_size() { return elems.size(); }
@@ -103,6 +216,7 @@ namespace js {
     void dump(std::string indent="");
 
   private:
+    friend class config_cache;
     std::vector<config *> elems;
   };
 
@@ -112,15 +226,18 @@ namespace js {
 
   public:
     config_string(jsmntok_t *tokens);
+    config_string(const char *value) : value(value) {}
     config *get_from_list(std::vector<std::string> name_list);
     std::string get_str() { return value; }
-    long long int get_int() { return strtoll(value.c_str(), NULL, 0); }
-    bool get_bool() { return strcmp(value.c_str(), "True") == 0 ||  strcmp(value.c_str(), "true") == 0; }
+    long long int get_int() { return strtoll(value, NULL, 0); }
+    bool get_bool() { return strcmp(value, "True") == 0 ||  strcmp(value, "true") == 0; }
 
     void dump(std::string indent="");
 
   private:
-    std::string value;
+    friend class config_cache;
+    // Points to the source text, which lives as long as the configuration
+    const char *value;
   };
 
 
@@ -129,12 +246,14 @@ namespace js {
 
   public:
     config_number(jsmntok_t *tokens);
+    config_number(double value) : value(value) {}
     long long int get_int() { return (int)value; }
     config *get_from_list(std::vector<std::string> name_list);
 
     void dump(std::string indent="");
 
   private:
+    friend class config_cache;
     double value;
 
   };
@@ -144,17 +263,22 @@ namespace js {
 
   public:
     config_bool(jsmntok_t *tokens);
+    config_bool(bool value) : value(value) {}
     bool get_bool() { return (bool)value; }
     config *get_from_list(std::vector<std::string> name_list);
 
     void dump(std::string indent="");
 
   private:
+    friend class config_cache;
     bool value;
   };
 
   config *import_config_from_string(std::string config_string);
 
+  // If JSON_TOOLS_CACHE_DIR is set in the environment, the binary image of
+  // the file is taken from this directory when it is up to date, and is
+  // generated there otherwise.
   config *import_config_from_file(std::string config_path);
 
 }
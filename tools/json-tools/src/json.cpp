@@ -27,6 +27,52 @@
 #include "string.h"
 #include <streambuf>
 #include <stdlib.h>
+#include <cstddef>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Size of the blocks from which the configuration nodes are allocated
+#define CONFIG_ARENA_BLOCK_SIZE (64*1024)
+
+#define CONFIG_CACHE_MAGIC   0x4353534a   // JSSC
+#define CONFIG_CACHE_VERSION 1
+
+#define CONFIG_CACHE_NODE_OBJECT 0
+#define CONFIG_CACHE_NODE_ARRAY  1
+#define CONFIG_CACHE_NODE_STRING 2
+#define CONFIG_CACHE_NODE_NUMBER 3
+#define CONFIG_CACHE_NODE_BOOL   4
+
+// The image is made of the header, the nodes, the references and the
+// strings. The root is the first node, and the children of a node always
+// come after it. An object refers to nb_refs pairs of name and node
+// indexes, an array to nb_refs node indexes.
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t source_size;
+  int64_t  source_mtime_sec;
+  int64_t  source_mtime_nsec;
+  uint64_t source_hash;
+  uint32_t nb_nodes;
+  uint32_t nb_refs;
+  uint32_t strings_size;
+  uint32_t reserved;
+} config_cache_header_t;
+
+typedef struct {
+  uint32_t type;
+  uint32_t nb_refs;
+  union {
+    uint64_t refs;     // Index of the first reference for objects and arrays
+    uint64_t str;      // Offset in the string table for strings
+    double   number;
+    uint64_t boolean;
+  };
+} config_cache_node_t;
 
 std::vector<std::string> split(const std::string& s, char delimiter)
 {
@@ -40,7 +86,84 @@ std::vector<std::string> split(const std::string& s, char delimiter)
    return tokens;
 }
 
-js::config *js::config::create_config(jsmntok_t *tokens, int *_size)
+js::config_arena::~config_arena()
+{
+  for (auto block: this->blocks)
+  {
+    free(block);
+  }
+
+  for (auto mapping: this->mappings)
+  {
+    munmap(mapping.first, mapping.second);
+  }
+}
+
+void *js::config_arena::alloc(size_t size)
+{
+  size = (size + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
+
+  if (this->block_used + size > this->block_size)
+  {
+    size_t block_size = size > CONFIG_ARENA_BLOCK_SIZE ? size : CONFIG_ARENA_BLOCK_SIZE;
+    this->blocks.push_back((char *)malloc(block_size));
+    this->block_size = block_size;
+    this->block_used = 0;
+  }
+
+  void *result = this->blocks.back() + this->block_used;
+  this->block_used += size;
+  return result;
+}
+
+char *js::config_arena::map_file(std::string path, size_t *size)
+{
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) return NULL;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0)
+  {
+    close(fd);
+    return NULL;
+  }
+
+  // The file is mapped privately, so that the tokens can be terminated in
+  // place, followed by an anonymous page, so that there is always a 0
+  // after the last byte.
+  size_t page_size = sysconf(_SC_PAGESIZE);
+  size_t map_size = ((st.st_size + page_size - 1) & ~(page_size - 1)) + page_size;
+
+  char *buffer = (char *)mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (buffer == MAP_FAILED)
+  {
+    close(fd);
+    return NULL;
+  }
+
+  if (mmap(buffer, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED)
+  {
+    munmap(buffer, map_size);
+    close(fd);
+    return NULL;
+  }
+
+  close(fd);
+
+  this->mappings.push_back(std::make_pair(buffer, map_size));
+  *size = st.st_size;
+
+  return buffer;
+}
+
+char *js::config_arena::copy_string(const std::string &str)
+{
+  char *result = (char *)this->alloc(str.size() + 1);
+  memcpy(result, str.c_str(), str.size() + 1);
+  return result;
+}
+
+js::config *js::config::create_config(jsmntok_t *tokens, int *_size, config_arena *arena)
 {
   jsmntok_t *current = tokens;
   config *config = NULL;
@@ -51,31 +174,31 @@ js::config *js::config::create_config(jsmntok_t *tokens, int *_size)
       if (strcmp(current->str, "True") == 0 || strcmp(current->str, "False") == 0 ||
         strcmp(current->str, "true") == 0 || strcmp(current->str, "false") == 0)
       {
-        config = new config_bool(current);
+        config = arena ? new (arena) config_bool(current) : new config_bool(current);
       }
       else
       {
-        config = new config_number(current);
+        config = arena ? new (arena) config_number(current) : new config_number(current);
       }
       current++;
       break;
 
     case JSMN_OBJECT: {
       int size;
-      config = new config_object(current, &size);
+      config = arena ? new (arena) config_object(current, &size, arena) : new config_object(current, &size);
       current += size;
       break;
     }
 
     case JSMN_ARRAY: {
       int size;
-      config = new config_array(current, &size);
+      config = arena ? new (arena) config_array(current, &size, arena) : new config_array(current, &size);
       current += size;
       break;
     }
 
     case JSMN_STRING:
-      config = new config_string(current);
+      config = arena ? new (arena) config_string(current) : new config_string(current);
       current++;
       break;
 
@@ -95,6 +218,72 @@ void js::config::dump(std::string)
 {
 }
 
+const std::vector<js::config *> &js::config::get_elems()
+{
+  static const std::vector<config *> empty;
+  return empty;
+}
+
+const js::config_childs &js::config::get_childs()
+{
+  static const config_childs empty;
+  return empty;
+}
+
+void js::config_childs::push(std::string name, config *child)
+{
+  this->items.push_back(std::make_pair(name, child));
+}
+
+void js::config_childs::build_index()
+{
+  std::vector<value_type> &items = this->items;
+
+  this->index.resize(items.size());
+  for (unsigned int i=0; i<items.size(); i++)
+  {
+    this->index[i] = i;
+  }
+
+  std::stable_sort(this->index.begin(), this->index.end(), [&items](unsigned int a, unsigned int b) {
+    return items[a].first < items[b].first;
+  });
+
+  // Duplicated names keep the position of the first one and the value of
+  // the last one
+  bool has_duplicates = false;
+  for (unsigned int i=1; i<this->index.size(); i++)
+  {
+    if (items[this->index[i]].first == items[this->index[i-1]].first)
+    {
+      items[this->index[i-1]].second = items[this->index[i]].second;
+      items[this->index[i]].second = NULL;
+      this->index[i] = this->index[i-1];
+      has_duplicates = true;
+    }
+  }
+
+  if (has_duplicates)
+  {
+    items.erase(std::remove_if(items.begin(), items.end(), [](const value_type &item) { return item.second == NULL; }), items.end());
+    this->build_index();
+  }
+}
+
+js::config *js::config_childs::find(const std::string &name) const
+{
+  const std::vector<value_type> &items = this->items;
+
+  auto it = std::lower_bound(this->index.begin(), this->index.end(), name, [&items](unsigned int a, const std::string &name) {
+    return items[a].first < name;
+  });
+
+  if (it == this->index.end() || items[*it].first != name)
+    return NULL;
+
+  return items[*it].second;
+}
+
 js::config *js::config_string::get_from_list(std::vector<std::string> name_list)
 {
   if (name_list.size() == 0) return this;
@@ -103,7 +292,7 @@ js::config *js::config_string::get_from_list(std::vector<std::string> name_list)
 
 void js::config_string::dump(std::string)
 {
-  fprintf(stderr, "\"%s\"", this->value.c_str());
+  fprintf(stderr, "\"%s\"", this->value);
 }
 
 js::config *js::config_number::get_from_list(std::vector<std::string> name_list)
@@ -153,7 +342,7 @@ void js::config_object::dump(std::string indent)
   bool is_first = true;
 
   fprintf(stderr, "{\n");
-  for (auto x: this->childs)
+  for (auto &x: this->childs)
   {
     if (!is_first)
       fprintf(stderr, ",\n");
@@ -164,39 +353,52 @@ void js::config_object::dump(std::string indent)
   fprintf(stderr, "\n%s}\n", indent.c_str());
 }
 
+js::config_path::config_path(std::string path) : path(path), names(split(path, '/'))
+{
+}
+
 js::config *js::config_object::get_from_list(std::vector<std::string> name_list)
 {
-  if (name_list.size() == 0) return this;
+  return this->get_from_path(name_list, 0);
+}
+
+js::config *js::config_object::get_from_path(const std::vector<std::string> &names, size_t pos)
+{
+  size_t size = names.size();
+
+  if (pos == size) return this;
 
   js::config *result = NULL;
-  std::string name;
-  int name_pos = 0;
+  size_t name_pos = pos;
 
-  for (auto& x: name_list) {
-    if (x != "*" && x != "**")
-    {
-      name = x;
-      break;
-    }
+  while (name_pos < size && (names[name_pos] == "*" || names[name_pos] == "**"))
+  {
     name_pos++;
   }
 
+  // No wildcard, the child is directly found
+  if (name_pos == pos)
+  {
+    js::config *child = childs.find(names[pos]);
+    if (child == NULL) return NULL;
+    return child->get_from_path(names, pos + 1);
+  }
+
   for (auto& x: childs) {
 
-    if (name == x.first)
+    if (name_pos < size && names[name_pos] == x.first)
     {
-      result = x.second->get_from_list(std::vector<std::string>(name_list.begin () + name_pos + 1, name_list.begin () + name_list.size()));
-      if (name_pos == 0 || result != NULL) return result;
-
+      result = x.second->get_from_path(names, name_pos + 1);
+      if (result != NULL) return result;
     }
-    else if (name_list[0] == "*")
+    else if (names[pos] == "*")
     {
-      result = x.second->get_from_list(std::vector<std::string>(name_list.begin () + 1, name_list.begin () + name_list.size()));
+      result = x.second->get_from_path(names, pos + 1);
       if (result != NULL) return result;
     }
-    else if (name_list[0] == "**")
+    else if (names[pos] == "**")
     {
-      result = x.second->get_from_list(name_list);
+      result = x.second->get_from_path(names, pos);
       if (result != NULL) return result;
     }
   }
@@ -204,14 +406,44 @@ js::config *js::config_object::get_from_list(std::vector<std::string> name_list)
   return result;
 }
 
+// Lookups are short, a single lock for all the nodes is enough
+static std::mutex lookup_mutex;
+
+js::config *js::config_object::lookup(const std::string &path, const std::vector<std::string> *names)
+{
+  {
+    std::lock_guard<std::mutex> lock(lookup_mutex);
+    if (this->lookup_cache)
+    {
+      auto cached = this->lookup_cache->find(path);
+      if (cached != this->lookup_cache->end())
+        return cached->second;
+    }
+  }
+
+  js::config *result = names ? this->get_from_path(*names, 0) : this->get_from_path(split(path, '/'), 0);
+
+  std::lock_guard<std::mutex> lock(lookup_mutex);
+  if (this->lookup_cache == NULL)
+    this->lookup_cache = new std::unordered_map<std::string, config *>();
+  (*this->lookup_cache)[path] = result;
+
+  return result;
+}
+
 js::config *js::config_object::get(std::string name)
 {
-  return get_from_list(split(name, '/'));
+  return this->lookup(name, NULL);
+}
+
+js::config *js::config_object::get(const config_path &path)
+{
+  return this->lookup(path.get_str(), &path.get_names());
 }
 
 js::config_string::config_string(jsmntok_t *tokens)
 {
-  value = std::string(tokens->str);
+  value = tokens->str;
 }
 
 js::config_number::config_number(jsmntok_t *tokens)
@@ -224,7 +456,7 @@ js::config_bool::config_bool(jsmntok_t *tokens)
   value = strcmp(tokens->str, "True") == 0 || strcmp(tokens->str, "true") == 0;
 }
 
-js::config_array::config_array(jsmntok_t *tokens, int *_size)
+js::config_array::config_array(jsmntok_t *tokens, int *_size, config_arena *arena)
 {
   jsmntok_t *current = tokens;
   jsmntok_t *top = current++;
@@ -232,7 +464,7 @@ js::config_array::config_array(jsmntok_t *tokens, int *_size)
   for (int i=0; i<top->size; i++)
   {
     int child_size;
-    elems.push_back(create_config(current, &child_size));
+    elems.push_back(create_config(current, &child_size, arena));
     current += child_size;
   }
 
@@ -242,7 +474,7 @@ js::config_array::config_array(jsmntok_t *tokens, int *_size)
   }
 }
 
-js::config_object::config_object(jsmntok_t *tokens, int *_size)
+js::config_object::config_object(jsmntok_t *tokens, int *_size, config_arena *arena)
 {
   jsmntok_t *current = tokens;
   jsmntok_t *t = current++;
@@ -251,55 +483,359 @@ js::config_object::config_object(jsmntok_t *tokens, int *_size)
   {
     jsmntok_t *child_name = current++;
     int child_size;
-    config *child_config = create_config(current, &child_size);
+    config *child_config = create_config(current, &child_size, arena);
     current += child_size;
 
     if (child_config != NULL)
     {
-      childs[child_name->str] = child_config;
-
+      childs.push(child_name->str, child_config);
     }
   }
 
+  childs.build_index();
+
   if (_size) {
     *_size = current - tokens;
   }
 }
 
-js::config *js::import_config_from_file(std::string config_path)
+// Parses the text in place, the tokens are terminated inside the buffer
+// and the string values directly point to it.
+static js::config *import_config(js::config_arena *arena, char *buffer, size_t size)
 {
-  std::ifstream t(config_path);
-  std::string str((std::istreambuf_iterator<char>(t)),
-                   std::istreambuf_iterator<char>());
-  return import_config_from_string(str);
-
-}
-
-js::config *js::import_config_from_string(std::string config_str)
-{
-  const char *config_string = strdup(config_str.c_str());
   jsmn_parser parser;
-  
+
   jsmn_init(&parser);
-  int nb_tokens = jsmn_parse(&parser, config_string, strlen(config_string), NULL, 0);
+  int nb_tokens = jsmn_parse(&parser, buffer, size, NULL, 0);
+  if (nb_tokens <= 0) return NULL;
 
   std::vector<jsmntok_t> tokens(nb_tokens);
 
   jsmn_init(&parser);
-  nb_tokens = jsmn_parse(&parser, config_string, strlen(config_string), &(tokens[0]), nb_tokens);
+  nb_tokens = jsmn_parse(&parser, buffer, size, &(tokens[0]), nb_tokens);
+  if (nb_tokens <= 0) return NULL;
 
-  char *str = strdup(config_string);
   for (int i=0; i<nb_tokens; i++)
   {
     jsmntok_t *tok = &(tokens[i]);
-    tok->str = &str[tok->start];
-    str[tok->end] = 0;
-      //printf("%d %d %d %d: %s\n", tokens[i].type, tokens[i].start, tokens[i].end, tokens[i].size, tok->str);
+    tok->str = &buffer[tok->start];
+    buffer[tok->end] = 0;
+  }
+
+  return new (arena) js::config_object(&(tokens[0]), NULL, arena);
+}
+
+js::config *js::import_config_from_file(std::string config_path)
+{
+  js::config_arena *arena = new js::config_arena();
+  const char *cache_dir = getenv("JSON_TOOLS_CACHE_DIR");
+  std::string cache_path;
+
+  if (cache_dir != NULL && *cache_dir != 0)
+  {
+    cache_path = js::config_cache::get_path(cache_dir, config_path);
+    js::config *result = js::config_cache::load(cache_path, config_path, arena);
+    if (result != NULL)
+      return result;
+
+    // Drop what was mapped or allocated from an invalid image
+    delete arena;
+    arena = new js::config_arena();
+  }
+
+  size_t size;
+  char *buffer = arena->map_file(config_path, &size);
+  if (buffer == NULL)
+  {
+    delete arena;
+    return NULL;
+  }
+
+  // The hash must be computed before the text is modified by the parsing
+  uint64_t hash = cache_path.size() ? js::config_cache::hash(buffer, size) : 0;
+
+  js::config *result = import_config(arena, buffer, size);
+  if (result == NULL)
+  {
+    delete arena;
+    return NULL;
+  }
+
+  if (cache_path.size())
+    js::config_cache::save(result, cache_path, config_path, hash);
+
+  return result;
+}
+
+uint64_t js::config_cache::hash(const char *buffer, size_t size)
+{
+  // FNV-1a, on 64 bits words to go faster, followed by the remaining bytes
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  size_t i = 0;
+
+  for (; i + 8 <= size; i += 8)
+  {
+    uint64_t word;
+    memcpy(&word, &buffer[i], 8);
+    hash = (hash ^ word) * 0x100000001b3ULL;
+  }
+
+  for (; i < size; i++)
+  {
+    hash = (hash ^ (unsigned char)buffer[i]) * 0x100000001b3ULL;
+  }
+
+  return hash;
+}
+
+std::string js::config_cache::get_path(std::string cache_dir, std::string source_path)
+{
+  char *real_path = realpath(source_path.c_str(), NULL);
+  std::string path = real_path ? real_path : source_path;
+  free(real_path);
+
+  char name[32];
+  snprintf(name, 32, "%016llx.jsc", (unsigned long long)hash(path.c_str(), path.size()));
+
+  return cache_dir + "/" + name;
+}
+
+js::config *js::config_cache::load(std::string cache_path, std::string source_path, config_arena *arena)
+{
+  struct stat source_st;
+  if (stat(source_path.c_str(), &source_st) != 0)
+    return NULL;
+
+  size_t size;
+  char *buffer = arena->map_file(cache_path, &size);
+  if (buffer == NULL || size < sizeof(config_cache_header_t))
+    return NULL;
+
+  config_cache_header_t *header = (config_cache_header_t *)buffer;
+
+  if (header->magic != CONFIG_CACHE_MAGIC || header->version != CONFIG_CACHE_VERSION ||
+    header->source_size != (uint64_t)source_st.st_size || header->nb_nodes == 0)
+    return NULL;
+
+  // When only the modification time changed, e.g. because the file was
+  // copied, the image can still be used if the content is the same
+  if (header->source_mtime_sec != source_st.st_mtim.tv_sec ||
+    header->source_mtime_nsec != source_st.st_mtim.tv_nsec)
+  {
+    js::config_arena source_arena;
+    size_t source_size;
+    char *source = source_arena.map_file(source_path, &source_size);
+    if (source == NULL || hash(source, source_size) != header->source_hash)
+      return NULL;
+  }
+
+  size_t nodes_offset = sizeof(config_cache_header_t);
+  size_t refs_offset = nodes_offset + (size_t)header->nb_nodes * sizeof(config_cache_node_t);
+  size_t strings_offset = refs_offset + (size_t)header->nb_refs * sizeof(uint32_t);
+
+  if (strings_offset + header->strings_size != size || header->strings_size == 0 ||
+    buffer[size - 1] != 0)
+    return NULL;
+
+  config_cache_node_t *nodes = (config_cache_node_t *)&buffer[nodes_offset];
+  uint32_t *refs = (uint32_t *)&buffer[refs_offset];
+  const char *strings = &buffer[strings_offset];
+  std::vector<config *> configs(header->nb_nodes);
+
+  // Children come after their parent, so that they are all created when
+  // the nodes are created from the last one
+  for (int i=header->nb_nodes-1; i>=0; i--)
+  {
+    config_cache_node_t *node = &nodes[i];
+    config *config = NULL;
+
+    switch (node->type)
+    {
+      case CONFIG_CACHE_NODE_OBJECT: {
+        if (node->refs + (uint64_t)node->nb_refs * 2 > header->nb_refs) return NULL;
+
+        config_object *object = new (arena) config_object();
+        uint32_t *ref = &refs[node->refs];
+        for (unsigned int j=0; j<node->nb_refs; j++, ref += 2)
+        {
+          if (ref[0] >= header->strings_size || ref[1] <= (uint32_t)i || ref[1] >= header->nb_nodes) return NULL;
+          object->childs.push(&strings[ref[0]], configs[ref[1]]);
+        }
+        object->childs.build_index();
+        config = object;
+        break;
+      }
+
+      case CONFIG_CACHE_NODE_ARRAY: {
+        if (node->refs + node->nb_refs > header->nb_refs) return NULL;
+
+        config_array *array = new (arena) config_array();
+        uint32_t *ref = &refs[node->refs];
+        array->elems.reserve(node->nb_refs);
+        for (unsigned int j=0; j<node->nb_refs; j++, ref++)
+        {
+          if (*ref <= (uint32_t)i || *ref >= header->nb_nodes) return NULL;
+          array->elems.push_back(configs[*ref]);
+        }
+        config = array;
+        break;
+      }
+
+      case CONFIG_CACHE_NODE_STRING:
+        if (node->str >= header->strings_size) return NULL;
+        config = new (arena) config_string(&strings[node->str]);
+        break;
+
+      case CONFIG_CACHE_NODE_NUMBER:
+        config = new (arena) config_number(node->number);
+        break;
+
+      case CONFIG_CACHE_NODE_BOOL:
+        config = new (arena) config_bool((bool)node->boolean);
+        break;
+
+      default:
+        return NULL;
+    }
+
+    configs[i] = config;
+  }
+
+  return configs[0];
+}
+
+class js::config_cache::writer
+{
+
+public:
+  uint32_t add_string(const std::string &str)
+  {
+    auto it = this->string_offsets.find(str);
+    if (it != this->string_offsets.end())
+      return it->second;
+
+    uint32_t offset = this->strings.size();
+    this->strings.insert(this->strings.end(), str.c_str(), str.c_str() + str.size() + 1);
+    this->string_offsets[str] = offset;
+    return offset;
+  }
+
+  // Returns the index of the node, its children are dumped after it
+  uint32_t add_node(js::config *config)
+  {
+    uint32_t index = this->nodes.size();
+    config_cache_node_t node;
+    std::vector<uint32_t> node_refs;
+
+    memset(&node, 0, sizeof(node));
+    this->nodes.push_back(node);
+
+    if (js::config_object *object = dynamic_cast<js::config_object *>(config))
+    {
+      node.type = CONFIG_CACHE_NODE_OBJECT;
+      for (auto &x: object->get_childs())
+      {
+        node_refs.push_back(this->add_string(x.first));
+        node_refs.push_back(this->add_node(x.second));
+      }
+      node.nb_refs = object->get_childs().size();
+    }
+    else if (js::config_array *array = dynamic_cast<js::config_array *>(config))
+    {
+      node.type = CONFIG_CACHE_NODE_ARRAY;
+      for (auto x: array->get_elems())
+      {
+        node_refs.push_back(this->add_node(x));
+      }
+      node.nb_refs = array->get_elems().size();
+    }
+    else if (dynamic_cast<js::config_string *>(config))
+    {
+      node.type = CONFIG_CACHE_NODE_STRING;
+      node.str = this->add_string(config->get_str());
+    }
+    else if (dynamic_cast<js::config_bool *>(config))
+    {
+      node.type = CONFIG_CACHE_NODE_BOOL;
+      node.boolean = config->get_bool();
+    }
+    else
+    {
+      node.type = CONFIG_CACHE_NODE_NUMBER;
+      node.number = static_cast<js::config_number *>(config)->value;
+    }
+
+    if (node.type == CONFIG_CACHE_NODE_OBJECT || node.type == CONFIG_CACHE_NODE_ARRAY)
+    {
+      node.refs = this->refs.size();
+      this->refs.insert(this->refs.end(), node_refs.begin(), node_refs.end());
+    }
+
+    this->nodes[index] = node;
+
+    return index;
   }
 
+  std::vector<config_cache_node_t> nodes;
+  std::vector<uint32_t> refs;
+  std::vector<char> strings;
 
+private:
+  std::unordered_map<std::string, uint32_t> string_offsets;
+};
 
-  return new js::config_object(&(tokens[0]));
+bool js::config_cache::save(config *config, std::string cache_path, std::string source_path, uint64_t source_hash)
+{
+  struct stat st;
+  if (stat(source_path.c_str(), &st) != 0)
+    return false;
+
+  writer writer;
+  writer.add_node(config);
+
+  config_cache_header_t header;
+  memset(&header, 0, sizeof(header));
+  header.magic = CONFIG_CACHE_MAGIC;
+  header.version = CONFIG_CACHE_VERSION;
+  header.source_size = st.st_size;
+  header.source_mtime_sec = st.st_mtim.tv_sec;
+  header.source_mtime_nsec = st.st_mtim.tv_nsec;
+  header.source_hash = source_hash;
+  header.nb_nodes = writer.nodes.size();
+  header.nb_refs = writer.refs.size();
+  header.strings_size = writer.strings.size();
+
+  // The image is written to a temporary file which is then renamed, so that
+  // processes launched at the same time never see a partial image
+  std::string tmp_path = cache_path + "." + std::to_string(getpid());
+  FILE *file = fopen(tmp_path.c_str(), "wb");
+  if (file == NULL)
+    return false;
+
+  bool error = fwrite(&header, sizeof(header), 1, file) != 1 ||
+    fwrite(writer.nodes.data(), sizeof(config_cache_node_t), writer.nodes.size(), file) != writer.nodes.size() ||
+    fwrite(writer.refs.data(), sizeof(uint32_t), writer.refs.size(), file) != writer.refs.size() ||
+    fwrite(writer.strings.data(), 1, writer.strings.size(), file) != writer.strings.size();
+
+  if (fclose(file) != 0 || error || rename(tmp_path.c_str(), cache_path.c_str()) != 0)
+  {
+    unlink(tmp_path.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+js::config *js::import_config_from_string(std::string config_str)
+{
+  js::config_arena *arena = new js::config_arena();
+  char *buffer = arena->copy_string(config_str);
+
+  js::config *result = import_config(arena, buffer, config_str.size());
+  if (result == NULL)
+    delete arena;
+
+  return result;
 }
 
 int js::config_object::get_child_int(std::string name)
@@ -0,0 +1,433 @@
+/*
+ * Copyright (C) 2018 ETH Zurich and University of Bologna
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Checks the path lookups of js::config against the previous implementation
+ * and measures them, as well as a full walk of the tree.
+ *
+ * The previous implementation is kept here as a reference: it works on a
+ * mirror of the tree where object children are stored in a std::map, as
+ * they used to be, and copies the remaining names at each level. Lookups
+ * must give the same result when the reference goes through the children
+ * in declaration order. With the previous alphabetical order, only
+ * ambiguous "**" lookups can find another match, they are listed.
+ *
+ * Usage: bench_config [config.json]
+ * Without any file, a system-like configuration is generated.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "json.hpp"
+
+#define BENCH_LOOKUP_ITER 200
+
+// Same random sequence on every host, so that the generated configuration
+// and paths are always the same
+static uint32_t bench_seed = 1;
+
+static uint32_t bench_rand()
+{
+  bench_seed = bench_seed * 1103515245 + 12345;
+  return (bench_seed >> 16) & 0x7fff;
+}
+
+static double bench_now()
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+
+static void gen_comp(std::ostringstream &out, int depth, int id)
+{
+  out << "{\"vp_class\": \"comp_" << id << "\", \"size\": \"" << bench_rand() * 32
+      << "\", \"base\": \"0x" << std::hex << bench_rand() * 0x8000 << std::dec
+      << "\", \"enabled\": " << (bench_rand() % 2 ? "true" : "false")
+      << ", \"nb\": " << bench_rand() % 100 << ", \"list\": [1, 2, \"a\"]";
+
+  if (depth > 0)
+  {
+    int nb_subs = 2 + bench_rand() % 5;
+    for (int i=0; i<nb_subs; i++)
+    {
+      out << ", \"sub_" << i << "\": ";
+      gen_comp(out, depth - 1, i);
+    }
+  }
+
+  out << "}";
+}
+
+// Looks like a system configuration, with the chip described both inside
+// the system tree and at the top level, so that "**/chip" is ambiguous
+static std::string gen_config()
+{
+  std::ostringstream out;
+
+  out << "{\"system_tree\": {\"board\": {\"tb_comps\": {\"uart\": {\"baud\": 115200}}, \"tb_bindings\": [], "
+      << "\"chip\": {\"name\": \"gap8_revc\", \"soc\": ";
+  gen_comp(out, 5, 0);
+  out << "}}";
+
+  for (int i=0; i<30; i++)
+  {
+    out << ", \"extra_" << i << "\": ";
+    gen_comp(out, 3, i);
+  }
+
+  out << "}, \"chip\": {\"name\": \"gap8_revc\"}, \"debug_bridge\": {\"cable\": {\"type\": \"ftdi\"}}}";
+
+  return out.str();
+}
+
+
+
+// Paths found in the tree, mixing plain ones and ones with wildcards
+static void gen_paths(js::config *config, std::vector<std::string> &names, std::vector<std::string> &paths)
+{
+  for (auto &x: config->get_childs())
+  {
+    names.push_back(x.first);
+
+    std::string path;
+    for (auto &name: names)
+      path += (path.empty() ? "" : "/") + name;
+
+    uint32_t choice = bench_rand() % 100;
+    if (choice < 30)
+      paths.push_back(path);
+    else if (choice < 35)
+      paths.push_back("**/" + x.first);
+    else if (choice < 40 && names.size() > 1)
+      paths.push_back("**/" + names[names.size() - 2] + "/" + x.first);
+    else if (choice < 42 && names.size() > 1)
+      paths.push_back("*" + path.substr(names[0].size()));
+
+    gen_paths(x.second, names, paths);
+
+    names.pop_back();
+  }
+}
+
+
+
+// Node of the mirror tree, stored as before
+class ref_node
+{
+public:
+  ref_node(js::config *config, bool sorted);
+
+  js::config *get_from_list(std::vector<std::string> name_list);
+
+  js::config *config;
+  bool is_object;
+  std::vector<std::pair<std::string, ref_node *>> childs;
+};
+
+ref_node::ref_node(js::config *config, bool sorted) : config(config)
+{
+  this->is_object = dynamic_cast<js::config_object *>(config) != NULL;
+
+  if (sorted)
+  {
+    std::map<std::string, js::config *> map_childs(config->get_childs().begin(), config->get_childs().end());
+    for (auto &x: map_childs)
+      this->childs.push_back(std::make_pair(x.first, new ref_node(x.second, sorted)));
+  }
+  else
+  {
+    for (auto &x: config->get_childs())
+      this->childs.push_back(std::make_pair(x.first, new ref_node(x.second, sorted)));
+  }
+}
+
+// Previous implementation of config_object::get_from_list, unchanged
+js::config *ref_node::get_from_list(std::vector<std::string> name_list)
+{
+  if (name_list.size() == 0) return this->config;
+  if (!this->is_object) return NULL;
+
+  js::config *result = NULL;
+  std::string name;
+  int name_pos = 0;
+
+  for (auto& x: name_list) {
+    if (x != "*" && x != "**")
+    {
+      name = x;
+      break;
+    }
+    name_pos++;
+  }
+
+  for (auto& x: childs) {
+
+    if (name == x.first)
+    {
+      result = x.second->get_from_list(std::vector<std::string>(name_list.begin () + name_pos + 1, name_list.begin () + name_list.size()));
+      if (name_pos == 0 || result != NULL) return result;
+
+    }
+    else if (name_list[0] == "*")
+    {
+      result = x.second->get_from_list(std::vector<std::string>(name_list.begin () + 1, name_list.begin () + name_list.size()));
+      if (result != NULL) return result;
+    }
+    else if (name_list[0] == "**")
+    {
+      result = x.second->get_from_list(name_list);
+      if (result != NULL) return result;
+    }
+  }
+
+  return result;
+}
+
+static std::vector<std::string> split_path(const std::string &path)
+{
+  std::vector<std::string> names;
+  std::stringstream stream(path);
+  std::string name;
+  while (std::getline(stream, name, '/'))
+    names.push_back(name);
+  return names;
+}
+
+
+
+static int check_lookups(js::config *config, std::vector<std::string> &paths)
+{
+  ref_node decl_ref(config, false);
+  ref_node sorted_ref(config, true);
+  int errors = 0;
+  int reordered = 0;
+
+  for (auto &path: paths)
+  {
+    std::vector<std::string> names = split_path(path);
+    js::config *expected = decl_ref.get_from_list(names);
+    js::config *previous = sorted_ref.get_from_list(names);
+
+    // First lookup fills the cache, the second one is served from it
+    js::config *first = config->get(path);
+    js::config *cached = config->get(path);
+    js::config *compiled = config->get(js::config_path(path));
+
+    if (first != expected || cached != expected || compiled != expected)
+    {
+      fprintf(stderr, "Lookup mismatch: %s\n", path.c_str());
+      errors++;
+    }
+
+    if (previous != expected)
+    {
+      // The order of the children can only select another match
+      if (previous == NULL || expected == NULL)
+      {
+        fprintf(stderr, "Lookup mismatch with alphabetical order: %s\n", path.c_str());
+        errors++;
+      }
+      else
+      {
+        printf("Resolved differently than with alphabetical order: %s\n", path.c_str());
+        reordered++;
+      }
+    }
+  }
+
+  printf("Lookups checked: %d paths, %d resolved differently, %d errors\n", (int)paths.size(), reordered, errors);
+
+  return errors;
+}
+
+
+
+static void bench_lookups(js::config *config, std::string &config_string, std::vector<std::string> &paths)
+{
+  ref_node sorted_ref(config, true);
+  std::vector<std::vector<std::string>> names;
+  std::vector<js::config_path> compiled_paths;
+  int found = 0;
+
+  for (auto &path: paths)
+  {
+    names.push_back(split_path(path));
+    compiled_paths.push_back(js::config_path(path));
+  }
+
+  // Splitting is included, as it was done at each get
+  double start = bench_now();
+  for (int i=0; i<BENCH_LOOKUP_ITER; i++)
+  {
+    for (auto &path: paths)
+      found += sorted_ref.get_from_list(split_path(path)) != NULL;
+  }
+  double previous = (bench_now() - start) / BENCH_LOOKUP_ITER / paths.size();
+
+  // Fresh configuration, so that nothing is cached yet
+  js::config *uncached = js::import_config_from_string(config_string);
+  start = bench_now();
+  for (auto &path: compiled_paths)
+    found += uncached->get(path) != NULL;
+  double first = (bench_now() - start) / paths.size();
+
+  start = bench_now();
+  for (int i=0; i<BENCH_LOOKUP_ITER; i++)
+  {
+    for (auto &path: paths)
+      found += config->get(path) != NULL;
+  }
+  double cached = (bench_now() - start) / BENCH_LOOKUP_ITER / paths.size();
+
+  start = bench_now();
+  for (int i=0; i<BENCH_LOOKUP_ITER; i++)
+  {
+    for (auto &path: compiled_paths)
+      found += config->get(path) != NULL;
+  }
+  double compiled = (bench_now() - start) / BENCH_LOOKUP_ITER / paths.size();
+
+  printf("lookup, previous:                 %8.1f ns\n", previous * 1e9);
+  printf("get(config_path), first lookup:   %8.1f ns\n", first * 1e9);
+  printf("get(string), cached:              %8.1f ns\n", cached * 1e9);
+  printf("get(config_path), cached:         %8.1f ns\n", compiled * 1e9);
+
+  // Keeps the lookups from being optimized away
+  if (found == 0)
+    printf("No path found\n");
+}
+
+
+
+// Previous walk, children and elements used to be returned by copy
+static int walk_copy(js::config *config)
+{
+  int nb_nodes = 1;
+  std::map<std::string, js::config *> childs(config->get_childs().begin(), config->get_childs().end());
+  std::vector<js::config *> elems = config->get_elems();
+
+  for (auto &x: childs)
+    nb_nodes += walk_copy(x.second);
+  for (auto elem: elems)
+    nb_nodes += walk_copy(elem);
+
+  return nb_nodes;
+}
+
+static int walk(js::config *config)
+{
+  int nb_nodes = 1;
+
+  for (auto &x: config->get_childs())
+    nb_nodes += walk(x.second);
+  for (auto elem: config->get_elems())
+    nb_nodes += walk(elem);
+
+  return nb_nodes;
+}
+
+static int bench_walk(js::config *config)
+{
+  int nb_nodes = walk(config);
+
+  if (walk_copy(config) != nb_nodes)
+  {
+    fprintf(stderr, "Tree walks do not see the same nodes\n");
+    return 1;
+  }
+
+  double start = bench_now();
+  for (int i=0; i<10; i++)
+    walk_copy(config);
+  double previous = (bench_now() - start) / 10;
+
+  start = bench_now();
+  for (int i=0; i<10; i++)
+    walk(config);
+  double current = (bench_now() - start) / 10;
+
+  printf("tree walk (%d nodes), previous:   %8.2f ms\n", nb_nodes, previous * 1e3);
+  printf("tree walk (%d nodes), by ref:     %8.2f ms\n", nb_nodes, current * 1e3);
+
+  return 0;
+}
+
+
+
+int main(int argc, char **argv)
+{
+  std::string config_string;
+
+  if (argc > 1)
+  {
+    std::ifstream file(argv[1]);
+    if (!file)
+    {
+      fprintf(stderr, "Unable to open %s\n", argv[1]);
+      return 1;
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    config_string = buffer.str();
+  }
+  else
+  {
+    config_string = gen_config();
+  }
+
+  js::config *config = js::import_config_from_string(config_string);
+
+  std::vector<std::string> names;
+  std::vector<std::string> found_paths;
+  gen_paths(config, names, found_paths);
+
+  const char *fixed_paths[] = {
+    "**/chip", "**/chip/name", "**/tb_comps", "**/nonexistent", "system_tree/board/tb_comps",
+    "**/debug_bridge/cable/type", "**/soc/**/nb", "*/board/chip/name", "**"
+  };
+  for (auto path: fixed_paths)
+    found_paths.push_back(path);
+
+  // Each path is checked once
+  std::vector<std::string> paths;
+  std::set<std::string> known_paths;
+  for (auto &path: found_paths)
+  {
+    if (known_paths.insert(path).second)
+      paths.push_back(path);
+  }
+
+  printf("Configuration: %d bytes, %d paths\n", (int)config_string.size(), (int)paths.size());
+
+  if (check_lookups(config, paths))
+  {
+    fprintf(stderr, "Lookup check failed\n");
+    return 1;
+  }
+
+  bench_lookups(config, config_string, paths);
+
+  return bench_walk(config);
+}
@@ -0,0 +1,419 @@
+#!/usr/bin/env python3
+
+#
+# Copyright (C) 2018 ETH Zurich and University of Bologna
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+
+# Benchmark of the host side of the bridge, using the loopback cable so that
+# no board or platform is needed. It loads an image, runs the request loop on
+# the emulated debug structure, with this script playing the target runtime,
+# and drives the RSP server like GDB does. All transfers are checked, so that
+# it can also be used as a regression test.
+
+import argparse
+import os
+import socket
+import struct
+import sys
+import tempfile
+import time
+import json_tools as js
+from bridge.default_debug_bridge import debug_bridge
+
+
+L2_BASE          = 0x1c000000
+L2_SIZE          = 0x80000
+DEBUG_STRUCT_PTR = 0x1c000000
+DEBUG_STRUCT     = 0x1c000100
+CODE_BASE        = 0x1c008000
+CODE_SIZE        = 0x20000
+DATA_BASE        = 0x1c030000
+DATA_SIZE        = 0x10000
+BSS_SIZE         = 0x10000
+REQ_ADDR         = 0x1c060000
+NAME_ADDR        = 0x1c060100
+STREAMS_ADDR     = 0x1c061000
+STREAMS_BUFFER   = 0x1c062000
+FILE_BUFFER      = 0x1c100000
+FC_DBG_UNIT      = 0x1b300000
+
+# Offsets in hal_debug_struct_t and hal_bridge_req_t
+DS_EXIT_STATUS      = 12
+DS_FIRST_BRIDGE_REQ = 172
+DS_NB_STREAMS       = 192
+REQ_DONE            = 20
+REQ_ARGS            = 32
+
+HAL_BRIDGE_REQ_OPEN  = 2
+HAL_BRIDGE_REQ_READ  = 3
+HAL_BRIDGE_REQ_WRITE = 4
+HAL_BRIDGE_REQ_CLOSE = 5
+
+INSN_NOP = 0x00000013
+
+failures = 0
+
+
+def check(cond, msg):
+    global failures
+    if not cond:
+        print ('FAILED: %s' % msg)
+        failures += 1
+
+
+def report(name, value, unit):
+    print ('%-28s %10.1f %s' % (name, value, unit))
+
+
+def gen_elf(path, segments):
+    # Minimal 32 bits RISC-V ELF with only program headers, segments is a
+    # list of (addr, data, memsz)
+    ehsize = 52
+    phentsize = 32
+    offset = ehsize + phentsize * len(segments)
+
+    header = b'\x7fELF' + bytes([1, 1, 1]) + bytes(9)
+    header += struct.pack('<HHIIIIIHHHHHH', 2, 0xf3, 1, segments[0][0], ehsize, 0, 0,
+                          ehsize, phentsize, len(segments), 40, 0, 0)
+
+    phdrs = b''
+    for addr, data, memsz in segments:
+        phdrs += struct.pack('<IIIIIIII', 1, offset, addr, addr, len(data), memsz, 7, 4)
+        offset += len(data)
+
+    with open(path, 'wb') as file:
+        file.write(header + phdrs)
+        for addr, data, memsz in segments:
+            file.write(data)
+
+
+class Target_runtime(object):
+    # Plays the runtime side of the debug structure through the cable
+
+    def __init__(self, bridge):
+        self.bridge = bridge
+
+    def request(self, req_type, args):
+        data = struct.pack('<QIIIIII', 0, 0, 0, req_type, 0, 0, 0)
+        data += struct.pack('<%dI' % len(args), *args)
+        self.bridge.write(REQ_ADDR, len(data), data)
+        self.bridge.write_32(DEBUG_STRUCT + DS_FIRST_BRIDGE_REQ, REQ_ADDR)
+
+        while self.bridge.read_32(REQ_ADDR + REQ_DONE) == 0:
+            pass
+
+        return struct.unpack('<i', self.bridge.read_bytes(REQ_ADDR + REQ_ARGS + 4 * (len(args) - 1), 4))[0]
+
+    def open(self, path, flags, mode=0):
+        name = path.encode('utf-8') + b'\0'
+        self.bridge.write(NAME_ADDR, len(name), name)
+        return self.request(HAL_BRIDGE_REQ_OPEN, [len(name) - 1, NAME_ADDR, flags, mode, 0])
+
+    def read(self, file, ptr, size):
+        return self.request(HAL_BRIDGE_REQ_READ, [file, ptr, size, 0])
+
+    def write(self, file, ptr, size):
+        return self.request(HAL_BRIDGE_REQ_WRITE, [file, ptr, size, 0])
+
+    def close(self, file):
+        return self.request(HAL_BRIDGE_REQ_CLOSE, [file, 0])
+
+    def streams_register(self, streams):
+        # streams is a list of (name, buffer, size)
+        table = b''
+        names = b''
+        for name, buffer, size in streams:
+            table += struct.pack('<6I', STREAMS_ADDR + 0x100 + len(names), buffer, size, 0, 0, 0)
+            names += name.encode('utf-8') + b'\0'
+
+        self.bridge.write(STREAMS_ADDR + 0x100, len(names), names)
+        self.bridge.write(STREAMS_ADDR, len(table), table)
+        self.bridge.write(DEBUG_STRUCT + DS_NB_STREAMS, 8, struct.pack('<II', len(streams), STREAMS_ADDR))
+
+    def stream_write(self, index, data):
+        # Same algorithm as hal_bridge_stream_write, except that the data is
+        # written with at most two accesses. Returns False if it does not fit.
+        entry = STREAMS_ADDR + 24 * index
+        name, buffer, size, write, read = struct.unpack('<5I', self.bridge.read_bytes(entry, 20))
+        space = read - write - 1 if read > write else size - write + read - 1
+        if len(data) > space:
+            return False
+
+        first = min(len(data), size - write)
+        reqs = [(True, buffer + write, data[0:first])]
+        if first < len(data):
+            reqs.append((True, buffer, data[first:]))
+        self.bridge.access_vector(reqs)
+        self.bridge.write_32(entry + 12, (write + len(data)) % size)
+        return True
+
+    def stream_flushed(self, index):
+        entry = STREAMS_ADDR + 24 * index
+        write, read = struct.unpack('<II', self.bridge.read_bytes(entry + 12, 8))
+        return write == read
+
+    def exit(self, status):
+        self.bridge.write_32(DEBUG_STRUCT + DS_EXIT_STATUS, (1 << 31) | status)
+
+
+class Rsp_client(object):
+
+    def __init__(self, port):
+        for i in range(0, 100):
+            try:
+                self.socket = socket.create_connection(('localhost', port))
+                break
+            except ConnectionRefusedError:
+                time.sleep(0.01)
+        self.socket.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        self.buffer = b''
+        self.ack = True
+
+    def send(self, payload):
+        if type(payload) == str:
+            payload = payload.encode('utf-8')
+        checksum = sum(payload) & 0xff
+        self.socket.sendall(b'$' + payload + b'#%02x' % checksum)
+        return self.receive()
+
+    def receive(self):
+        while True:
+            start = self.buffer.find(b'$')
+            end = self.buffer.find(b'#', start)
+            if start != -1 and end != -1 and len(self.buffer) >= end + 3:
+                packet = self.buffer[start+1:end]
+                self.buffer = self.buffer[end+3:]
+                if self.ack:
+                    self.socket.sendall(b'+')
+                return packet.decode('utf-8')
+
+            data = self.socket.recv(65536)
+            if len(data) == 0:
+                raise Exception('RSP connection closed')
+            self.buffer += data
+
+    def no_ack_mode(self):
+        if self.send('QStartNoAckMode') == 'OK':
+            self.ack = False
+
+    def read_pc(self):
+        return struct.unpack('<I', bytes.fromhex(self.send('p20')))[0]
+
+    def close(self):
+        self.socket.sendall(b'$D#44')
+        self.socket.close()
+
+
+def bench_loader(bridge, args, tmpdir):
+    code = struct.pack('<I', INSN_NOP) * (CODE_SIZE // 4)
+    data = os.urandom(DATA_SIZE)
+    elf = os.path.join(tmpdir, 'bench.elf')
+    gen_elf(elf, [(CODE_BASE, code, len(code)), (DATA_BASE, data, DATA_SIZE + BSS_SIZE)])
+
+    # Make sure the BSS is really cleared
+    bridge.write(DATA_BASE + DATA_SIZE, BSS_SIZE, b'\xff' * BSS_SIZE)
+
+    start = time.time()
+    for i in range(0, args.iter):
+        check(bridge.load_elf(elf) == 0, 'ELF load')
+    duration = time.time() - start
+
+    check(bridge.read_bytes(CODE_BASE, len(code)) == code, 'code segment content')
+    check(bridge.read_bytes(DATA_BASE, DATA_SIZE + BSS_SIZE) == data + bytes(BSS_SIZE), 'data segment content')
+
+    report('load', (len(code) + DATA_SIZE + BSS_SIZE) * args.iter / duration / 1e6, 'MB/s')
+
+
+def bench_reqloop(bridge, args, tmpdir):
+    runtime = Target_runtime(bridge)
+    bridge.reqloop()
+
+    # Host file accesses, first with small requests like printf or fread on
+    # the target, then with large ones like a file transfer
+    data = os.urandom(args.file_size)
+    in_path = os.path.join(tmpdir, 'in.bin')
+    out_path = os.path.join(tmpdir, 'out.bin')
+    with open(in_path, 'wb') as file:
+        file.write(data)
+
+    file = runtime.open(in_path, os.O_RDONLY)
+    check(file >= 0, 'open input file')
+
+    nb_small = args.iter * 100
+    start = time.time()
+    for i in range(0, nb_small):
+        check(runtime.read(file, FILE_BUFFER, 64) == 64, 'small read')
+    report('reqloop small reads', nb_small / (time.time() - start), 'req/s')
+    check(bridge.read_bytes(FILE_BUFFER, 64) == data[64 * (nb_small - 1):64 * nb_small], 'small read content')
+    runtime.close(file)
+
+    file = runtime.open(in_path, os.O_RDONLY)
+    start = time.time()
+    check(runtime.read(file, FILE_BUFFER, len(data)) == len(data), 'large read')
+    report('reqloop file read', len(data) / (time.time() - start) / 1e6, 'MB/s')
+    check(bridge.read_bytes(FILE_BUFFER, len(data)) == data, 'large read content')
+    runtime.close(file)
+
+    file = runtime.open(out_path, os.O_WRONLY | os.O_CREAT | os.O_TRUNC, 0o644)
+    start = time.time()
+    check(runtime.write(file, FILE_BUFFER, len(data)) == len(data), 'large write')
+    report('reqloop file write', len(data) / (time.time() - start) / 1e6, 'MB/s')
+    runtime.close(file)
+    with open(out_path, 'rb') as file:
+        check(file.read() == data, 'large write content')
+
+    # Stream channels, the target side pushes data as fast as possible
+    runtime.streams_register([('bench', STREAMS_BUFFER, args.stream_size)])
+    chunk = os.urandom(1024)
+    nb_chunks = args.file_size // len(chunk)
+    start = time.time()
+    for i in range(0, nb_chunks):
+        while not runtime.stream_write(0, chunk):
+            pass
+    while not runtime.stream_flushed(0):
+        pass
+    report('reqloop stream', nb_chunks * len(chunk) / (time.time() - start) / 1e6, 'MB/s')
+
+    # Polling traffic of the idle loop
+    bridge.get_cable().reset_stats()
+    time.sleep(0.5)
+    report('reqloop idle polling', bridge.get_stats()['reqloop']['accesses'] / 0.5, 'access/s')
+
+    start = time.time()
+    runtime.exit(args.exit_status)
+    check(bridge.reqloop_close() == args.exit_status, 'exit status')
+    report('reqloop exit', (time.time() - start) * 1e3, 'ms')
+
+    with open(args.stream_output, 'rb') as file:
+        check(file.read() == chunk * nb_chunks, 'stream content')
+
+
+def bench_rsp(bridge, args):
+    bridge.gdb(args.rsp_port)
+    client = Rsp_client(args.rsp_port)
+
+    client.send('qSupported:multiprocess+;swbreak+;hwbreak+')
+    client.no_ack_mode()
+    check(client.send('?').startswith('S'), 'stop reason')
+
+    nb_reqs = args.iter * 100
+
+    start = time.time()
+    for i in range(0, nb_reqs):
+        check(len(client.send('g')) == 33 * 8, 'register read')
+    report('rsp register reads', nb_reqs / (time.time() - start), 'req/s')
+
+    start = time.time()
+    for i in range(0, nb_reqs):
+        addr = CODE_BASE + (i * 0x100) % CODE_SIZE
+        check(client.send('m%x,100' % addr) == '13000000' * 64, 'memory read')
+    report('rsp memory reads', nb_reqs / (time.time() - start), 'req/s')
+
+    pattern = os.urandom(256)
+    check(client.send('M%x,%x:%s' % (DATA_BASE, len(pattern), pattern.hex())) == 'OK', 'memory write')
+    check(client.send('m%x,%x' % (DATA_BASE, len(pattern))) == pattern.hex(), 'memory write content')
+    check(bridge.read_bytes(DATA_BASE, len(pattern)) == pattern, 'memory write through the cable')
+
+    # A write done behind GDB must be seen by the next read
+    bridge.write(DATA_BASE, len(pattern), bytes(len(pattern)))
+    check(client.send('m%x,%x' % (DATA_BASE, len(pattern))) == '00' * len(pattern), 'memory read after cable write')
+
+    pc = CODE_BASE
+    client.send('P20=%s' % struct.pack('<I', pc).hex())
+    start = time.time()
+    for i in range(0, nb_reqs // 10):
+        check(client.send('s') == 'S05', 'step stop reason')
+        pc += 4
+        check(client.read_pc() == pc, 'step pc')
+    report('rsp steps', nb_reqs // 10 / (time.time() - start), 'step/s')
+
+    # Continue until a breakpoint a bit further, several times
+    start = time.time()
+    for i in range(0, nb_reqs // 10):
+        bp = pc + 0x100
+        check(client.send('Z0,%x,4' % bp) == 'OK', 'breakpoint insertion')
+        check(client.send('c') == 'S05', 'breakpoint stop reason')
+        check(client.read_pc() == bp, 'breakpoint pc')
+        check(client.send('z0,%x,4' % bp) == 'OK', 'breakpoint removal')
+        pc = bp
+    report('rsp continue to breakpoint', nb_reqs // 10 / (time.time() - start), 'bp/s')
+
+    # Continue and interrupt
+    client.send('P20=%s' % struct.pack('<I', 0x1d000000).hex())
+    client.socket.sendall(b'$c#63')
+    time.sleep(0.05)
+    client.socket.sendall(b'\x03')
+    check(client.receive().startswith('S'), 'interrupt stop reason')
+
+    client.close()
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Benchmark the bridge through the loopback cable')
+    parser.add_argument('--latency-us', type=int, default=0, help='latency of each cable access or batch')
+    parser.add_argument('--byte-latency-ns', type=int, default=0, help='latency of each transferred byte')
+    parser.add_argument('--iter', type=int, default=10, help='number of iterations of each benchmark')
+    parser.add_argument('--file-size', type=int, default=4*1024*1024, help='size of the file and stream transfers')
+    parser.add_argument('--stream-size', type=int, default=64*1024, help='size of the stream ring buffer')
+    parser.add_argument('--rsp-port', type=int, default=19999, help='port of the RSP server')
+    parser.add_argument('--exit-status', type=int, default=7, help='exit status sent by the emulated runtime')
+    args = parser.parse_args()
+
+    with tempfile.TemporaryDirectory() as tmpdir:
+
+        args.stream_output = os.path.join(tmpdir, 'stream.bin')
+
+        config = js.import_config({
+            'chip': { 'name': 'loopback' },
+            'debug_bridge': {
+                'cable': {
+                    'type': 'loopback',
+                    'loopback': {
+                        'latency_us': args.latency_us,
+                        'byte_latency_ns': args.byte_latency_ns,
+                        'debug_struct_ptr': DEBUG_STRUCT_PTR,
+                        'debug_struct': DEBUG_STRUCT,
+                        'entry': CODE_BASE
+                    }
+                },
+                'streams': {
+                    'bench': args.stream_output
+                }
+            },
+            'soc': {
+                'fc': { 'cluster_id': 31 },
+                'fc_dbg_unit': { 'base': FC_DBG_UNIT },
+                'l2': { 'base': L2_BASE, 'size': L2_SIZE }
+            }
+        })
+
+        bridge = debug_bridge(config=config)
+
+        bench_loader(bridge, args, tmpdir)
+        bench_reqloop(bridge, args, tmpdir)
+        bench_rsp(bridge, args)
+
+        bridge.dump_stats()
+
+    if failures != 0:
+        print ('Benchmark checks failed: %d' % failures)
+        # The RSP server threads are never stopped
+        os._exit(1)
+
+    os._exit(0)
+
+
+if __name__ == '__main__':
+    main()
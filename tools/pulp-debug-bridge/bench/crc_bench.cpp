@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2018 ETH Zurich and University of Bologna
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Checks that the table-driven CRC of the adv debug bursts gives the same
+// results as the original per-bit routine, and compares their throughput.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <chrono>
+#include <vector>
+
+#include "cables/adv_dbg_itf/adv_dbg_itf.hpp"
+
+#define CRC_BENCH_SIZE (1024*1024)
+
+static int check_equivalence(std::vector<char> &data)
+{
+  int errors = 0;
+
+  // Random lengths in bits, including partial bytes, from random offsets
+  for (int i=0; i<20000; i++)
+  {
+    int bits = rand() % (8 * 4096 + 1);
+    int offset = rand() % 64;
+    uint32_t seed = rand() % 2 ? 0xFFFFFFFF : (uint32_t)rand();
+
+    uint32_t ref = Adv_dbg_itf::crc_compute_bitwise(seed, &data[offset], bits);
+    uint32_t crc = Adv_dbg_itf::crc_compute(seed, &data[offset], bits);
+
+    if (crc != ref)
+    {
+      fprintf(stderr, "CRC mismatch (offset: %d, bits: %d, seed: 0x%x, expected: 0x%x, got: 0x%x)\n", offset, bits, seed, ref, crc);
+      errors++;
+    }
+  }
+
+  // Chained chunks, as done for reads split in several bursts
+  for (int i=0; i<200; i++)
+  {
+    int size = rand() % (64 * 1024);
+    uint32_t ref = Adv_dbg_itf::crc_compute_bitwise(0xFFFFFFFF, &data[0], size * 8);
+    uint32_t crc = 0xFFFFFFFF;
+    int offset = 0;
+
+    while (offset < size)
+    {
+      int chunk = 1 + rand() % 4096;
+      if (chunk > size - offset)
+        chunk = size - offset;
+
+      crc = Adv_dbg_itf::crc_compute(crc, &data[offset], chunk * 8);
+      offset += chunk;
+    }
+
+    if (crc != ref)
+    {
+      fprintf(stderr, "Chained CRC mismatch (size: %d, expected: 0x%x, got: 0x%x)\n", size, ref, crc);
+      errors++;
+    }
+  }
+
+  return errors;
+}
+
+static double bench(uint32_t (*crc_compute)(uint32_t, char *, int), std::vector<char> &data, int iter)
+{
+  volatile uint32_t crc = 0xFFFFFFFF;
+
+  auto start = std::chrono::steady_clock::now();
+
+  for (int i=0; i<iter; i++)
+  {
+    crc = crc_compute(crc, &data[0], CRC_BENCH_SIZE * 8);
+  }
+
+  double duration = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  return (double)CRC_BENCH_SIZE * iter / duration / 1e6;
+}
+
+int main()
+{
+  std::vector<char> data(CRC_BENCH_SIZE + 64);
+
+  srand(1);
+  for (auto &byte: data)
+  {
+    byte = rand();
+  }
+
+  int errors = check_equivalence(data);
+  if (errors)
+  {
+    fprintf(stderr, "CRC check failed (errors: %d)\n", errors);
+    return 1;
+  }
+
+  printf("CRC check passed\n");
+
+  double bitwise = bench(Adv_dbg_itf::crc_compute_bitwise, data, 4);
+  double table = bench(Adv_dbg_itf::crc_compute, data, 128);
+
+  printf("crc bitwise: %8.1f MB/s\n", bitwise);
+  printf("crc table:   %8.1f MB/s (x%.1f)\n", table, table / bitwise);
+
+  return 0;
+}
@@ -26,6 +26,8 @@
 #define PROTOCOL_VERSION_2 2    // Added bridge to runtime requests
 #define PROTOCOL_VERSION_3 3    // Added field "connected" in target state to allow bridge to reconnect several times
 #define PROTOCOL_VERSION_4 4    // Added field "bridge_to_target" in requests as they are now released by the target
+#define PROTOCOL_VERSION_5 5    // Added dirty row bitmap to framebuffer update requests
+#define PROTOCOL_VERSION_6 6    // Added target to bridge stream channels
 
 #define HAL_PRINTF_BUF_SIZE 128
 
@@ -104,6 +106,10 @@ typedef struct hal_bridge_req_s {
       uint32_t posy;
       uint32_t width;
       uint32_t height;
+      // Optional bitmap of dirty row bands, one bit per group of dirty_rows
+      // lines of the updated area. 0 means the whole area must be refreshed.
+      uint32_t dirty;
+      uint32_t dirty_rows;
     } fb_update;
     struct {
       uint32_t is_write;
@@ -168,6 +174,19 @@ typedef struct hal_bridge_req_s {
   };
 } hal_bridge_req_t;
 
+// Target to bridge stream channel. This is a ring buffer written by the
+// target and drained by the bridge, each side only updates its own index so
+// that no synchronization is needed. The target never waits, data which does
+// not fit is dropped and accounted in dropped.
+typedef struct {
+  uint32_t name;                // Null-terminated channel name, used to find its output on host side
+  uint32_t buffer;
+  uint32_t size;
+  volatile uint32_t write;      // Updated by the target only
+  volatile uint32_t read;       // Updated by the bridge only
+  volatile uint32_t dropped;    // Number of bytes dropped by the target
+} __attribute__((packed)) hal_bridge_stream_t;
+
 typedef struct {
   volatile int32_t connected;
 } __attribute__((packed)) hal_target_state_t;
@@ -210,6 +229,10 @@ typedef struct {
   uint32_t notif_req_addr;
   uint32_t notif_req_value;
 
+  // Stream channels, array of hal_bridge_stream_t
+  uint32_t nb_streams;
+  uint32_t streams;
+
 } __attribute__((packed)) hal_debug_struct_t;
 
 #endif
\ No newline at end of file
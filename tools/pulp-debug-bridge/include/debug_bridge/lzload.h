@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2018 ETH Zurich and University of Bologna
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* 
+ * Authors: Germain Haugou, ETH (germain.haugou@iis.ee.ethz.ch)
+ */
+
+#ifndef __DEBUG_BRIDGE_LZLOAD_H__
+#define __DEBUG_BRIDGE_LZLOAD_H__
+
+// Interface between the bridge and the decompression stub used for
+// compressed loads. The stub is a position-independent raw image which
+// starts with a header giving the location of its mailbox. The bridge
+// writes compressed blocks into staging buffers and posts commands into
+// the mailbox slots, which the stub executes in order, alternating between
+// the slots so that the bridge can fill one while the other is executed.
+
+#define LZLOAD_MAGIC    0x444c5a4c    // "LZLD"
+#define LZLOAD_NB_SLOTS 2
+
+// Stack reserved inside the stub image
+#define LZLOAD_STACK_SIZE 512
+
+#ifndef __ASSEMBLER__
+
+#include <stdint.h>
+
+typedef enum {
+  LZLOAD_CMD_NONE = 0,     // Slot is free
+  LZLOAD_CMD_LZ4  = 1,     // Decompress an LZ4 block from src to dst
+  LZLOAD_CMD_FILL = 2,     // Set dst_size bytes at dst to 0
+  LZLOAD_CMD_DONE = 3      // Load is over, the stub stops in a loop
+} lzload_cmd_e;
+
+typedef enum {
+  LZLOAD_STATE_INIT  = 0,
+  LZLOAD_STATE_READY = 1,  // Stub is waiting for commands
+  LZLOAD_STATE_DONE  = 2   // Stub received the DONE command and can be halted
+} lzload_state_e;
+
+typedef struct {
+  uint32_t cmd;
+  uint32_t src;
+  uint32_t dst;
+  uint32_t src_size;
+  uint32_t dst_size;
+} lzload_slot_t;
+
+typedef struct {
+  uint32_t state;
+  // Number of commands which failed, e.g. corrupted block
+  uint32_t errors;
+  lzload_slot_t slots[LZLOAD_NB_SLOTS];
+} lzload_mailbox_t;
+
+typedef struct {
+  uint32_t jump;
+  uint32_t magic;
+  uint32_t mailbox_offset;
+} lzload_header_t;
+
+#endif
+
+#endif
@@ -27,12 +27,31 @@
 extern "C" {
 #endif
 
+// Version of the proxy protocol. It is exchanged through a HELLO request
+// when the bridge connects. A proxy which does not answer is considered
+// as version 1, which only knows the unpacked JTAG requests.
+#define DEBUG_BRIDGE_PROXY_VERSION 2
+
 typedef enum {
   DEBUG_BRIDGE_JTAG_REQ  = 0,
   DEBUG_BRIDGE_RESET_REQ = 1,
-  DEBUG_BRIDGE_CONFIG_REQ = 2
+  DEBUG_BRIDGE_CONFIG_REQ = 2,
+  DEBUG_BRIDGE_HELLO_REQ = 3,
+  DEBUG_BRIDGE_JTAG_PACKED_REQ = 4
 } proxy_req_type_e;
 
+// Packed JTAG requests (version 2) have one bit per cycle. The payload is
+// split into chunks of DEBUG_BRIDGE_JTAG_PACKED_CHUNK bits, each chunk
+// being made of the TDI bits followed by the TMS bits if they are present.
+// When TDO is requested, the proxy sends back the TDO bits of each chunk
+// as soon as the chunk is executed. Requests without TDO are not answered
+// so that the bridge can send several of them without waiting.
+#define DEBUG_BRIDGE_JTAG_PACKED_CHUNK    (64*1024)
+
+#define DEBUG_BRIDGE_JTAG_PACKED_TDO      (1<<0)  // TDO bits are sent back
+#define DEBUG_BRIDGE_JTAG_PACKED_TMS      (1<<1)  // TMS bits are in the payload
+#define DEBUG_BRIDGE_JTAG_PACKED_TMS_LAST (1<<2)  // TMS is only set on the last cycle
+
 typedef enum {
   DEBUG_BRIDGE_JTAG_TDI  = 0,
   DEBUG_BRIDGE_JTAG_TMS  = 1,
@@ -54,6 +73,14 @@ typedef struct {
     struct {
       int32_t value;
     } config;
+    struct {
+      int32_t version;
+    } hello;
+    struct {
+      uint32_t bits;
+      uint8_t  flags;
+      uint8_t  trstn;
+    } jtag_packed;
   };
 
 } proxy_req_t;
@@ -32,6 +32,9 @@ CONFREG_INIT = 0
 
 class gap_debug_bridge(debug_bridge):
 
+    lzload_dbg_ctrl_addr = 0x1B300000
+    lzload_npc_addr = 0x1B302000
+
     def __init__(self, config, binaries=[], verbose=False, fimages=[]):
         super(gap_debug_bridge, self).__init__(config=config, binaries=binaries, verbose=verbose)
 
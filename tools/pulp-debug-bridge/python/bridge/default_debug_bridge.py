@@ -22,6 +22,22 @@ import os.path
 import json_tools as js
 from elftools.elf.elffile import ELFFile
 import time
+from bridge.lzload import Lzload, Lzload_error
+
+
+def _buffer_ptr(buffer, size, writable=False):
+    # Returns an object which can be passed to the C API as a pointer to the
+    # buffer data. Objects supporting the buffer protocol (bytes, bytearray,
+    # memoryview, numpy arrays) are passed without any copy, other sequences
+    # like lists of integers are converted.
+    if isinstance(buffer, bytes) and not writable:
+        return buffer
+    try:
+        return (ctypes.c_char * size).from_buffer(buffer)
+    except TypeError:
+        if writable:
+            raise
+        return bytes(bytearray(buffer)[0:size])
 
 
 class Ctype_cable(object):
@@ -37,9 +53,16 @@ class Ctype_cable(object):
 
         self.module.cable_write.argtypes = \
             [ctypes.c_void_p, ctypes.c_int, ctypes.c_int, ctypes.c_char_p]
+        self.module.cable_write.restype = ctypes.c_int
 
         self.module.cable_read.argtypes = \
             [ctypes.c_void_p, ctypes.c_int, ctypes.c_int, ctypes.c_char_p]
+        self.module.cable_read.restype = ctypes.c_int
+
+        self.module.cable_access_vector.argtypes = \
+            [ctypes.c_void_p, ctypes.c_int, ctypes.POINTER(ctypes.c_int), ctypes.POINTER(ctypes.c_uint),
+             ctypes.POINTER(ctypes.c_int), ctypes.POINTER(ctypes.c_void_p)]
+        self.module.cable_access_vector.restype = ctypes.c_int
 
         self.module.cable_reg_write.argtypes = \
             [ctypes.c_void_p, ctypes.c_int, ctypes.c_char_p, ctypes.c_int]
@@ -72,6 +95,21 @@ class Ctype_cable(object):
             
         self.module.cable_unlock.argtypes = \
             [ctypes.c_void_p]
+
+        self.module.cable_stats_get.argtypes = \
+            [ctypes.c_void_p, ctypes.c_int, ctypes.POINTER(ctypes.c_uint64), ctypes.c_int,
+             ctypes.POINTER(ctypes.c_uint64), ctypes.c_int]
+        self.module.cable_stats_get.restype = ctypes.c_int
+
+        self.module.cable_stats_counter_name.argtypes = [ctypes.c_int]
+        self.module.cable_stats_counter_name.restype = ctypes.c_char_p
+
+        self.module.cable_stats_context_name.argtypes = [ctypes.c_int]
+        self.module.cable_stats_context_name.restype = ctypes.c_char_p
+
+        self.module.cable_stats_reset.argtypes = [ctypes.c_void_p]
+
+        self.module.cable_stats_dump.argtypes = [ctypes.c_void_p]
             
         self.module.bridge_get_error.argtypes = []
         self.module.bridge_get_error.restype = ctypes.c_char_p
@@ -97,22 +135,51 @@ class Ctype_cable(object):
         return self.instance
 
     def write(self, addr, size, buffer):
-        data = (ctypes.c_char * size).from_buffer(bytearray(buffer))
-        self.module.cable_write(self.instance, addr, size, data)
+        return self.module.cable_write(self.instance, addr, size, _buffer_ptr(buffer, size))
 
     def reg_write(self, addr, size, buffer, device=-1):
         data = (ctypes.c_char * size).from_buffer(bytearray(buffer))
         self.module.cable_reg_write(self.instance, addr, data, device)
 
-    def read(self, addr, size):
-        data = (ctypes.c_char * size)()
-        self.module.cable_read(self.instance, addr, size, data)
+    def read_into(self, addr, buffer, size=None):
+        if size is None:
+            size = memoryview(buffer).nbytes
+        return self.module.cable_read(self.instance, addr, size, _buffer_ptr(buffer, size, writable=True))
 
-        result = []
-        for elem in data:
-            result.append(elem)
+    def read_bytes(self, addr, size):
+        data = bytearray(size)
+        self.read_into(addr, data)
+        return bytes(data)
 
-        return result
+    def read(self, addr, size):
+        data = self.read_bytes(addr, size)
+        return [data[i:i+1] for i in range(size)]
+
+    def access_vector(self, reqs):
+        # Executes several accesses in one call, reqs being a list of
+        # (is_write, addr, buffer) or (is_write, addr, buffer, size) tuples.
+        # Read buffers must be writable buffer objects, they are filled in place.
+        nb_reqs = len(reqs)
+        is_write = (ctypes.c_int * nb_reqs)()
+        addrs = (ctypes.c_uint * nb_reqs)()
+        sizes = (ctypes.c_int * nb_reqs)()
+        buffers = (ctypes.c_void_p * nb_reqs)()
+
+        # Keep the pointed objects alive until the call returns
+        ptrs = []
+
+        for i, req in enumerate(reqs):
+            write, addr, buffer = req[0:3]
+            size = req[3] if len(req) > 3 else memoryview(buffer).nbytes
+            ptr = _buffer_ptr(buffer, size, writable=not write)
+            ptrs.append(ptr)
+
+            is_write[i] = 1 if write else 0
+            addrs[i] = addr
+            sizes[i] = size
+            buffers[i] = ctypes.cast(ptr, ctypes.c_void_p).value
+
+        return self.module.cable_access_vector(self.instance, nb_reqs, is_write, addrs, sizes, buffers)
 
     def reg_read(self, addr, size, device=-1):
         data = (ctypes.c_char * size)()
@@ -124,6 +191,38 @@ class Ctype_cable(object):
 
         return result
 
+    def get_stats(self):
+        # Returns the cable statistics as a dictionary of contexts (host,
+        # reqloop, gdb), each one with its counters and latency histogram
+        result = {}
+        counters = (ctypes.c_uint64 * 32)()
+        latency = (ctypes.c_uint64 * 64)()
+        ctx = 0
+
+        while True:
+            ctx_name = self.module.cable_stats_context_name(ctx)
+            if ctx_name is None:
+                break
+
+            nb_counters = self.module.cable_stats_get(self.instance, ctx, counters, 32, latency, 64)
+
+            stats = {}
+            for i in range(0, nb_counters):
+                stats[self.module.cable_stats_counter_name(i).decode('utf-8')] = counters[i]
+            # Histogram indexed by the upper bound of each bucket in us
+            stats['latency_us_hist'] = {1 << i: latency[i] for i in range(0, 64) if latency[i] != 0}
+
+            result[ctx_name.decode('utf-8')] = stats
+            ctx += 1
+
+        return result
+
+    def reset_stats(self):
+        self.module.cable_stats_reset(self.instance)
+
+    def dump_stats(self):
+        self.module.cable_stats_dump(self.instance)
+
     def chip_reset(self, value, duration=1000000):
         self.module.chip_reset(self.instance, value, duration)
 
@@ -155,6 +254,11 @@ class Ctype_cable(object):
 
 class debug_bridge(object):
 
+    # Debug unit registers used to run the decompression stub of compressed
+    # loads, to be overloaded by the chips supporting them
+    lzload_dbg_ctrl_addr = None
+    lzload_npc_addr = None
+
     def __init__(self, config, binaries=[], verbose=False):
         self.config = config
         self.cable = None
@@ -166,6 +270,7 @@ class debug_bridge(object):
         self.verbose = verbose
         self.gdb_handle = None
         self.cable_config = config.get('**/debug_bridge/cable')
+        self.progress = None
 
 
 
@@ -190,6 +295,9 @@ class debug_bridge(object):
         self.module.bridge_reqloop_flash_access.argtypes = [ctypes.c_void_p, ctypes.c_int, ctypes.c_uint, ctypes.c_uint, ctypes.c_int, ctypes.c_uint, ctypes.c_uint, ctypes.c_uint]
         self.module.bridge_reqloop_flash_access.restype = ctypes.c_int
         
+        self.module.bridge_reqloop_flash_write_diff.argtypes = [ctypes.c_void_p, ctypes.c_int, ctypes.c_uint, ctypes.c_uint, ctypes.c_uint, ctypes.c_char_p, ctypes.c_uint, ctypes.c_uint]
+        self.module.bridge_reqloop_flash_write_diff.restype = ctypes.c_int
+        
         self.module.bridge_reqloop_flash_erase.argtypes = [ctypes.c_void_p, ctypes.c_int, ctypes.c_uint, ctypes.c_uint, ctypes.c_uint, ctypes.c_int]
         self.module.bridge_reqloop_flash_erase.restype = ctypes.c_int
         
@@ -200,6 +308,7 @@ class debug_bridge(object):
         self.module.bridge_reqloop_flash_erase_chip.restype = ctypes.c_int
         
         self.module.bridge_reqloop_close.argtypes = [ctypes.c_void_p, ctypes.c_int]
+        self.module.bridge_reqloop_close.restype = ctypes.c_int
 
         self.module.bridge_init(config.dump_to_string().encode('utf-8'), verbose)
 
@@ -209,7 +318,7 @@ class debug_bridge(object):
         if self.cable_name is None:
             raise Exception("Trying to mount cable while no cable was specified")
 
-        if self.cable_name.split('@')[0] in ['ftdi', 'jtag-proxy']:
+        if self.cable_name.split('@')[0] in ['ftdi', 'jtag-proxy', 'loopback']:
             self.__mount_ctype_cable()
             pass
         else:
@@ -242,6 +351,8 @@ class debug_bridge(object):
         with open(binary, 'rb') as file:
             elffile = ELFFile(file)
 
+            segments = []
+
             for segment in elffile.iter_segments():
 
                 if segment['p_type'] == 'PT_LOAD':
@@ -253,17 +364,28 @@ class debug_bridge(object):
                     if self.verbose:
                         print ('Loading section (base: 0x%x, size: 0x%x)' % (addr, size))
 
-                    self.write(addr, size, data)
+                    fill = segment['p_memsz'] - segment['p_filesz']
+                    if fill > 0:
+                        print ('Init section to 0 (base: 0x%x, size: 0x%x)' % (addr + segment['p_filesz'], fill))
+                    else:
+                        fill = 0
+
+                    segments.append((addr, data, fill))
 
-                    if segment['p_filesz'] < segment['p_memsz']:
-                        addr = segment['p_paddr'] + segment['p_filesz']
-                        size = segment['p_memsz'] - segment['p_filesz']
-                        print ('Init section to 0 (base: 0x%x, size: 0x%x)' % (addr, size))
-                        self.write(
-                            addr,
-                            size,
-                            [0] * size
-                        )
+            if self.__load_compressed(segments) != 0:
+
+                # All segments are loaded in a single vectored access
+                reqs = []
+
+                for addr, data, fill in segments:
+                    if len(data) != 0:
+                        reqs.append((True, addr, data))
+
+                    if fill != 0:
+                        reqs.append((True, addr + len(data), bytes(fill)))
+
+                if len(reqs) != 0 and self.access_vector(reqs) != 0:
+                    return 1
 
 
             set_pc_addr_config = self.config.get('**/debug_bridge/set_pc_addr')
@@ -282,6 +404,27 @@ class debug_bridge(object):
 
         return 0
 
+    def __load_compressed(self, segments):
+        # Returns 0 if the segments were loaded through the decompression
+        # stub, otherwise they must be loaded normally
+        config = self.config.get('**/debug_bridge/lzload')
+        if config is None or not config.get_child_bool('enabled'):
+            return -1
+
+        try:
+            lzload = Lzload(self, config, self.lzload_dbg_ctrl_addr, self.lzload_npc_addr)
+            start = time.time()
+            raw_size, sent_size = lzload.load(segments)
+        except Lzload_error as e:
+            print ('Compressed load failed, falling back to normal load: %s' % str(e))
+            return -1
+
+        if self.verbose:
+            duration = time.time() - start
+            print ('Compressed load (size: 0x%x, sent: 0x%x, ratio: %.2f, time: %.3fs)' % (raw_size, sent_size, float(raw_size) / max(sent_size, 1), duration))
+
+        return 0
+
     def load(self, binaries=None):
         if binaries is None:
             binaries = self.binaries
@@ -322,9 +465,26 @@ class debug_bridge(object):
     def read(self, addr, size):
         return self.get_cable().read(addr, size)
 
+    def read_bytes(self, addr, size):
+        return self.get_cable().read_bytes(addr, size)
+
+    def read_into(self, addr, buffer, size=None):
+        return self.get_cable().read_into(addr, buffer, size)
+
     def write(self, addr, size, buffer):
         return self.get_cable().write(addr, size, buffer)
 
+    def access_vector(self, reqs):
+        return self.get_cable().access_vector(reqs)
+
+    def get_stats(self):
+        return self.get_cable().get_stats()
+
+    def dump_stats(self):
+        # Nothing to dump if the cable was never used
+        if self.cable is not None:
+            self.cable.dump_stats()
+
     def write_int(self, addr, value, size):
         return self.write(addr, size, value.to_bytes(size, byteorder='little'))
 
@@ -341,13 +501,7 @@ class debug_bridge(object):
         return self.write_int(addr, value, 1)
 
     def read_int(self, addr, size):
-        byte_array = None
-        for byte in self.read(addr, size):
-            if byte_array == None:
-                byte_array = byte
-            else:
-                byte_array += byte
-        return int.from_bytes(byte_array, byteorder='little')
+        return int.from_bytes(self.read_bytes(addr, size), byteorder='little')
 
     def read_reg_int(self, addr, size, device=-1):
         byte_array = None
@@ -402,6 +556,12 @@ class debug_bridge(object):
         if addr == 0:
             addr = self._get_binary_symbol_addr('debugStruct_ptr', binaries)
 
+        # The loopback cable can emulate the structure without any binary
+        if addr == 0:
+            ptr_config = self.config.get('**/debug_bridge/cable/loopback/debug_struct_ptr')
+            if ptr_config is not None:
+                addr = ptr_config.get_int()
+
         self.reqloop_handle = self.module.bridge_reqloop_open(
             self.get_cable().get_instance(), addr)
 
@@ -453,6 +613,15 @@ class debug_bridge(object):
 
 
 
+    def set_progress(self, callback):
+        # The callback is called as callback(step, done, total) during long
+        # operations like flash accesses
+        self.progress = callback
+
+    def _report_progress(self, step, done, total):
+        if self.progress is not None:
+            self.progress(step, done, total)
+
     def eeprom_access(self, flasher_init, itf, cs, is_write,eeprom_addr, filepath):
         self.__flasher_init(flasher_init)
 
@@ -475,12 +644,32 @@ class debug_bridge(object):
 
 
 
-    def flash_access(self, flasher_init, type, itf, cs, is_write,flash_addr, size, filepath):
+    def flash_access(self, flasher_init, type, itf, cs, is_write,flash_addr, size, filepath, diff=False, sector_size=0):
         self.__flasher_init(flasher_init)
 
+        if is_write and diff:
+            # Only the sectors which are different from the image are erased and programmed
+            try:
+                with open(filepath, 'rb') as file:
+                    buff = file.read()
+
+                self._report_progress('write', 0, len(buff))
+
+                if self.module.bridge_reqloop_flash_write_diff(self.reqloop_handle, type, itf, cs, flash_addr, buff, len(buff), sector_size):
+                    return -1
+
+                self._report_progress('write', len(buff), len(buff))
+
+                return 0
+
+            finally:
+                self.__flasher_deinit()
+
         addr = self.__alloc_buffer(1024)
 
         if is_write:
+            total = os.path.getsize(filepath)
+            done = 0
             with open(filepath, 'rb') as file:
                 while True:
                     buff = file.read(1024)
@@ -493,9 +682,12 @@ class debug_bridge(object):
                         if self.module.bridge_reqloop_flash_access(self.reqloop_handle, type, itf, cs, True, flash_addr, addr, buff_size):
                             return -1
                         flash_addr += 1024
+                        done += len(buff)
+                        self._report_progress('write', done, total)
                     else:
                         break
         else:
+            total = size
             with open(filepath, 'wb') as file:
                 while size > 0:
                     iter_size = 1024
@@ -503,11 +695,10 @@ class debug_bridge(object):
                         iter_size = size
                     if self.module.bridge_reqloop_flash_access(self.reqloop_handle, type, itf, cs, False, flash_addr, addr, iter_size):
                             return -1
-                    buff = self.read(addr, iter_size)
-                    for elem in buff:
-                        file.write(elem)
+                    file.write(self.read_bytes(addr, iter_size))
                     size -= iter_size
                     flash_addr += iter_size
+                    self._report_progress('read', total - size, total)
 
         self.__flasher_deinit()
 
@@ -516,6 +707,32 @@ class debug_bridge(object):
 
 
 
+    def flash_verify(self, flasher_init, type, itf, cs, flash_addr, filepath):
+        # Reads back the flash and compares it with the file, returns 0 if
+        # they are identical
+        self.__flasher_init(flasher_init)
+
+        addr = self.__alloc_buffer(1024)
+
+        with open(filepath, 'rb') as file:
+            expected = file.read()
+
+        for offset in range(0, len(expected), 1024):
+            chunk = expected[offset:offset + 1024]
+            if self.module.bridge_reqloop_flash_access(self.reqloop_handle, type, itf, cs, False, flash_addr + offset, addr, len(chunk)):
+                return -1
+
+            if self.read_bytes(addr, len(chunk)) != chunk:
+                print ('Flash verification failed (addr: 0x%x)' % (flash_addr + offset))
+                return -1
+
+            self._report_progress('verify', offset + len(chunk), len(expected))
+
+        self.__flasher_deinit()
+
+        return 0
+
+
     def flash_erase_sector(self, flasher_init, type, itf, cs, flash_addr):
         self.__flasher_init(flasher_init)
 
@@ -0,0 +1,146 @@
+#
+# Copyright (C) 2018 ETH Zurich and University of Bologna
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+
+# Authors: Germain Haugou, ETH (germain.haugou@iis.ee.ethz.ch)
+
+# Fleet mode, drives several boards from the same process, each one through
+# its own FTDI cable, selected by serial number. Each board gets its own
+# bridge and runs the same job in its own thread. The cable accesses release
+# the python lock so the boards really progress concurrently.
+
+import ctypes
+import threading
+import time
+import json_tools as js
+import bridge.debug_bridge as db
+
+
+def list_ftdi_serials(config):
+    # Returns the serial numbers of the FTDI cables currently connected
+    module = ctypes.CDLL('libpulpdebugbridge.so')
+    module.cable_ftdi_list.argtypes = [ctypes.c_char_p, ctypes.c_char_p, ctypes.c_int]
+    module.cable_ftdi_list.restype = ctypes.c_int
+    module.bridge_get_error.restype = ctypes.c_char_p
+
+    buffer = ctypes.create_string_buffer(4096)
+    if module.cable_ftdi_list(config.dump_to_string().encode('utf-8'), buffer, len(buffer)) < 0:
+        raise Exception(module.bridge_get_error().decode('utf-8'))
+
+    return buffer.value.decode('utf-8').split()
+
+
+class Fleet_board(object):
+
+    def __init__(self, serial, bridge):
+        self.serial = serial
+        self.bridge = bridge
+        self.step = 'waiting'
+        self.done = 0
+        self.total = 0
+        self.status = None
+        self.error = None
+        self.start_time = None
+        self.end_time = None
+
+        bridge.set_progress(self.__progress)
+
+    def __progress(self, step, done, total):
+        self.step = step
+        self.done = done
+        self.total = total
+
+    def get_duration(self):
+        if self.start_time is None:
+            return 0
+        if self.end_time is None:
+            return time.time() - self.start_time
+        return self.end_time - self.start_time
+
+    def get_state(self):
+        if self.status is not None:
+            state = 'OK' if self.status == 0 else 'FAILED'
+            if self.error is not None:
+                state += ' (%s)' % self.error
+            return state
+
+        if self.total != 0:
+            return '%s %3d%%' % (self.step, self.done * 100 // self.total)
+
+        return self.step
+
+    def run(self, job):
+        self.start_time = time.time()
+        self.step = 'running'
+        try:
+            self.status = job(self.bridge)
+        except Exception as e:
+            self.error = str(e)
+            self.status = -1
+        self.end_time = time.time()
+
+
+class Fleet(object):
+
+    def __init__(self, config, serials, binaries=[], verbose=False):
+        self.boards = []
+
+        for serial in serials:
+            # Each board gets a private copy of the configuration pointing
+            # to its cable
+            board_config = js.import_config(config.get_dict())
+            if board_config.get('**/debug_bridge') is None:
+                board_config.set('debug_bridge', {})
+            board_config.get('**/debug_bridge').set('cable/serial', serial)
+            bridge = db.get_bridge(config=board_config, binaries=binaries, verbose=verbose)
+            self.boards.append(Fleet_board(serial, bridge))
+
+    def dump_progress(self):
+        line = ''
+        for board in self.boards:
+            line += '[%s: %s %.1fs] ' % (board.serial, board.get_state(), board.get_duration())
+        print (line)
+
+    def dump_report(self):
+        print ('%-20s %-10s %s' % ('Board', 'Time', 'Status'))
+        for board in self.boards:
+            print ('%-20s %-10s %s' % (board.serial, '%.2fs' % board.get_duration(), board.get_state()))
+
+    def run(self, job, period=1.0):
+        # Executes job(bridge) on all boards concurrently, and returns 0 if
+        # it succeeded on all of them
+        start = time.time()
+        threads = []
+
+        for board in self.boards:
+            thread = threading.Thread(target=board.run, args=[job])
+            thread.daemon = True
+            thread.start()
+            threads.append(thread)
+
+        alive = threads
+        while len(alive) != 0:
+            self.dump_progress()
+            alive[0].join(period)
+            alive = [thread for thread in threads if thread.is_alive()]
+
+        self.dump_report()
+        print ('Fleet done in %.2fs' % (time.time() - start))
+
+        for board in self.boards:
+            if board.status != 0:
+                return -1
+
+        return 0
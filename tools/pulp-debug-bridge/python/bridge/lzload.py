@@ -0,0 +1,192 @@
+#
+# Copyright (C) 2018 ETH Zurich and University of Bologna
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+
+# Authors: Germain Haugou, ETH (germain.haugou@iis.ee.ethz.ch)
+
+# Compressed load. A small decompression stub (see stub/ and
+# include/debug_bridge/lzload.h) is loaded into L2 and started, then the
+# segments are streamed as LZ4 blocks into two staging buffers which the stub
+# expands in place, while the bridge fills the other buffer.
+
+import ctypes
+import os
+import os.path
+import struct
+import time
+
+LZLOAD_MAGIC = 0x444c5a4c
+
+LZLOAD_CMD_NONE = 0
+LZLOAD_CMD_LZ4 = 1
+LZLOAD_CMD_FILL = 2
+LZLOAD_CMD_DONE = 3
+
+LZLOAD_STATE_READY = 1
+LZLOAD_STATE_DONE = 2
+
+LZLOAD_NB_SLOTS = 2
+LZLOAD_SLOT_SIZE = 20
+LZLOAD_SLOTS_OFFSET = 8
+
+# Debug unit control bit which halts the core
+DBG_CTRL_HALT = 1 << 16
+
+
+class Lzload_error(Exception):
+    pass
+
+
+class Lzload(object):
+
+    def __init__(self, bridge, config, dbg_ctrl_addr=None, npc_addr=None):
+        self.bridge = bridge
+        self.verbose = bridge.verbose
+
+        self.stub = config.get_child_str('stub')
+        if self.stub is None and os.environ.get('PULP_SDK_INSTALL') is not None:
+            self.stub = os.path.join(os.environ.get('PULP_SDK_INSTALL'), 'bin', 'lzload-stub.bin')
+
+        self.stub_addr = self.__get_int(config, 'stub_addr', 0x1C077000)
+        self.buffer_addr = self.__get_int(config, 'buffer_addr', 0x1C078000)
+        self.buffer_size = self.__get_int(config, 'buffer_size', 0x8000)
+        self.dbg_ctrl_addr = self.__get_int(config, 'dbg_ctrl_addr', dbg_ctrl_addr)
+        self.npc_addr = self.__get_int(config, 'npc_addr', npc_addr)
+        self.timeout = self.__get_int(config, 'timeout', 1000) / 1000.0
+
+        self.block_size = self.buffer_size // LZLOAD_NB_SLOTS
+
+        self.module = bridge.module
+        self.module.bridge_lz4_compress.argtypes = \
+            [ctypes.c_char_p, ctypes.c_int, ctypes.c_char_p, ctypes.c_int]
+        self.module.bridge_lz4_compress.restype = ctypes.c_int
+
+    def __get_int(self, config, name, default):
+        value = config.get(name)
+        if value is None:
+            return default
+        return value.get_int()
+
+    def compress(self, data):
+        # Returns the LZ4 block or None if the data does not compress
+        dst = ctypes.create_string_buffer(len(data))
+        size = self.module.bridge_lz4_compress(data, len(data), dst, len(data))
+        if size < 0:
+            return None
+        return dst.raw[0:size]
+
+    def __check(self, segments):
+        if self.stub is None or not os.path.isfile(self.stub):
+            raise Lzload_error('decompression stub not found: %s' % self.stub)
+
+        if self.dbg_ctrl_addr is None or self.npc_addr is None:
+            raise Lzload_error('core control registers are not known for this target')
+
+        reserved = [(self.stub_addr, os.path.getsize(self.stub)), (self.buffer_addr, self.buffer_size)]
+
+        for addr, data, fill in segments:
+            size = len(data) + fill
+            for base, reserved_size in reserved:
+                if addr < base + reserved_size and base < addr + size:
+                    raise Lzload_error('segment 0x%x overlaps the stub area' % addr)
+
+    def __wait(self, addr, value, what):
+        start = time.time()
+        while self.bridge.read_32(addr) != value:
+            if time.time() - start > self.timeout:
+                raise Lzload_error('timeout while waiting for %s' % what)
+
+    def __post(self, slot, cmd, src, dst, src_size, dst_size, data=None):
+        slot_addr = self.mailbox + LZLOAD_SLOTS_OFFSET + slot * LZLOAD_SLOT_SIZE
+
+        # The slot is reused only once the stub has released it
+        self.__wait(slot_addr, LZLOAD_CMD_NONE, 'slot %d' % slot)
+
+        reqs = []
+        if data is not None:
+            reqs.append((True, src, data))
+        reqs.append((True, slot_addr + 4, struct.pack('<IIII', src, dst, src_size, dst_size)))
+        # Command is written last as it is what triggers the stub
+        reqs.append((True, slot_addr, struct.pack('<I', cmd)))
+
+        if self.bridge.access_vector(reqs) != 0:
+            raise Lzload_error('failed to post command')
+
+    def load(self, segments):
+        # segments is a list of (addr, data, fill) where fill is the number
+        # of bytes to be set to 0 after the data.
+        # Returns a tuple (raw bytes, bytes sent).
+        self.__check(segments)
+
+        with open(self.stub, 'rb') as file:
+            stub = file.read()
+
+        magic, mailbox_offset = struct.unpack('<II', stub[4:12])
+        if magic != LZLOAD_MAGIC:
+            raise Lzload_error('invalid decompression stub: %s' % self.stub)
+
+        self.mailbox = self.stub_addr + mailbox_offset
+
+        # The core must be halted while the stub is loaded, then it is
+        # started on it.
+        self.bridge.write_32(self.dbg_ctrl_addr, DBG_CTRL_HALT)
+        if self.bridge.write(self.stub_addr, len(stub), stub) != 0:
+            raise Lzload_error('failed to load decompression stub')
+        self.bridge.write_32(self.npc_addr, self.stub_addr)
+        self.bridge.write_32(self.dbg_ctrl_addr, 0)
+
+        # Whatever happens, the core must not keep running the stub, as the
+        # caller may then load the segments normally
+        try:
+            self.__wait(self.mailbox, LZLOAD_STATE_READY, 'decompression stub')
+
+            slot = 0
+            raw_size = 0
+            sent_size = 0
+
+            for addr, data, fill in segments:
+                for offset in range(0, len(data), self.block_size):
+                    block = data[offset:offset + self.block_size]
+                    compressed = self.compress(block)
+
+                    if compressed is None:
+                        # Incompressible blocks go directly to their destination
+                        if self.bridge.write(addr + offset, len(block), block) != 0:
+                            raise Lzload_error('failed to write block')
+                        sent_size += len(block)
+                    else:
+                        src = self.buffer_addr + slot * self.block_size
+                        self.__post(slot, LZLOAD_CMD_LZ4, src, addr + offset, len(compressed), len(block), compressed)
+                        slot = (slot + 1) % LZLOAD_NB_SLOTS
+                        sent_size += len(compressed)
+
+                    raw_size += len(block)
+
+                if fill != 0:
+                    self.__post(slot, LZLOAD_CMD_FILL, 0, addr + len(data), 0, fill)
+                    slot = (slot + 1) % LZLOAD_NB_SLOTS
+                    raw_size += fill
+
+            self.__post(slot, LZLOAD_CMD_DONE, 0, 0, 0, 0)
+            self.__wait(self.mailbox, LZLOAD_STATE_DONE, 'end of decompression')
+
+        finally:
+            self.bridge.write_32(self.dbg_ctrl_addr, DBG_CTRL_HALT)
+
+        errors = self.bridge.read_32(self.mailbox + 4)
+        if errors != 0:
+            raise Lzload_error('decompression stub reported %d errors' % errors)
+
+        return raw_size, sent_size
@@ -21,10 +21,74 @@
 #ifndef __CABLES_CABLE_HPP__
 #define __CABLES_CABLE_HPP__
 
+#include <vector>
+#include <atomic>
+#include <stdio.h>
+#include <stdint.h>
 #include "json.hpp"
 #include "cables/log.h"
 
 
+
+// Statistics are attributed to the thread doing the accesses, so that the
+// request loop and the GDB server can be told apart from the loader.
+typedef enum {
+  CABLE_STATS_CTX_HOST    = 0,
+  CABLE_STATS_CTX_REQLOOP = 1,
+  CABLE_STATS_CTX_GDB     = 2,
+  CABLE_STATS_NB_CTX      = 3
+} cable_stats_ctx_e;
+
+typedef enum {
+  CABLE_STATS_ACCESSES     = 0,
+  CABLE_STATS_READ_BYTES   = 1,
+  CABLE_STATS_WRITE_BYTES  = 2,
+  CABLE_STATS_BURSTS       = 3,
+  CABLE_STATS_RETRIES      = 4,
+  CABLE_STATS_ERRORS       = 5,
+  CABLE_STATS_ERROR_CHECKS = 6,
+  CABLE_STATS_SCANS        = 7,
+  CABLE_STATS_SCAN_BITS    = 8,
+  CABLE_STATS_FLUSHES      = 9,
+  CABLE_STATS_ACCESS_US    = 10,
+  CABLE_STATS_NB_COUNTERS  = 11
+} cable_stats_counter_e;
+
+// Access latencies are stored in power of 2 buckets, in microseconds
+#define CABLE_STATS_LATENCY_BUCKETS 24
+
+class Cable_stats
+{
+public:
+  Cable_stats();
+
+  static void set_context(int ctx) { current_ctx = ctx; }
+  static const char *get_context_name(int ctx);
+  static const char *get_counter_name(int counter);
+
+  void add(int counter, uint64_t value=1) { this->counters[current_ctx][counter] += value; }
+  void add_access(bool write, int size);
+  void add_latency(int64_t us);
+
+  uint64_t get(int ctx, int counter) { return this->counters[ctx][counter]; }
+  uint64_t get_latency(int ctx, int bucket) { return this->latency[ctx][bucket]; }
+
+  // Number of write accesses done by a context. Unlike the counters, it is
+  // never reset, so that it tells if another context modified the memory.
+  uint64_t get_writes(int ctx) { return this->writes[ctx]; }
+
+  void reset();
+  void dump(FILE *file);
+
+private:
+  static thread_local int current_ctx;
+
+  uint64_t counters[CABLE_STATS_NB_CTX][CABLE_STATS_NB_COUNTERS];
+  uint64_t latency[CABLE_STATS_NB_CTX][CABLE_STATS_LATENCY_BUCKETS];
+  std::atomic<uint64_t> writes[CABLE_STATS_NB_CTX];
+};
+
+
 class Cable_jtag_itf
 {
 public:
@@ -34,11 +98,14 @@ public:
   virtual bool stream_inout(char* instream, char* outstream, unsigned int n_bits, bool last) { printf ("i am stream_inout virtual fct in cable class\n"); return false; }
 
   virtual int flush() { return -1; }
+  // Flushes and waits until everything sent so far has reached the target,
+  // so that the transfer errors are reported to the caller which issued them
+  virtual int sync() { return flush(); }
   virtual bool jtag_reset(bool active) { printf("JTAG\n"); return false; }
 
   virtual void device_select(unsigned int i) {}
 
-  bool jtag_soft_reset();
+  virtual bool jtag_soft_reset();
   bool jtag_write_tms(int val);
   bool jtag_shift_ir();
   bool jtag_shift_dr();
@@ -51,11 +118,38 @@ public:
 
 
 
+class Cable_io_req
+{
+public:
+  Cable_io_req(bool write, unsigned int addr, int size, char *buffer) : write(write), addr(addr), size(size), buffer(buffer) {}
+
+  bool write;
+  unsigned int addr;
+  int size;
+  char *buffer;
+};
+
+
+
 class Cable_io_itf
 {
 public:
   virtual bool access(bool write, unsigned int addr, int size, char* buffer, int device=-1) { return false; }
   virtual bool reg_access(bool write, unsigned int addr, char* buffer, int device=-1) { return false; }
+
+  // Execute a list of accesses as a single batch. Read buffers are only
+  // guaranteed to be filled once the whole batch returns.
+  // Cables can overload it to keep the target selected between accesses
+  // and to check errors only once per batch.
+  virtual bool access_batch(std::vector<Cable_io_req> &reqs, int device=-1)
+  {
+    for (auto &req: reqs)
+    {
+      if (!this->access(req.write, req.addr, req.size, req.buffer, device))
+        return false;
+    }
+    return true;
+  }
 };
 
 
@@ -72,7 +166,7 @@ public:
 class Cable : public Cable_io_itf, public Cable_jtag_itf, public Cable_ctrl_itf
 {
 public:
-  Cable(js::config *config) : config(config) {}
+  Cable(js::config *config) : config(config), stats(&own_stats) {}
 
   virtual bool connect(js::config *config) { return true; }
 
@@ -82,8 +176,16 @@ public:
 
   js::config *get_config() { return this->config; }
 
+  Cable_stats *get_stats() { return this->stats; }
+
+  // Makes a cable account its activity into the statistics of another one,
+  // typically the low-level cable used by the adv debug interface
+  void set_stats(Cable_stats *stats) { this->stats = stats; }
+
 protected:  
   js::config *config;
+  Cable_stats own_stats;
+  Cable_stats *stats;
 
 };
 
@@ -22,6 +22,7 @@
 #include <string.h>
 #include <sys/time.h>
 #include <unistd.h>
+#include <chrono>
 
 #include "adv_dbg_itf.hpp"
 #ifdef __USE_FTDI__
@@ -30,6 +31,13 @@
 
 #define JTAG_SOC_AXIREG  4
 
+// The burst setup command has a 16 bits word counter
+#define ADBG_MAX_BURST_WORDS 0xffff
+
+// Burst payloads are streamed to the cable by chunks of this size so that
+// bursts can be much bigger than what the cable can shift in one go
+#define ADBG_STREAM_CHUNK 4096
+
 
 Adv_dbg_itf::Adv_dbg_itf(js::config *system_config, js::config *config, Log* log, Cable *m_dev) : Cable(system_config), log(log), m_dev(m_dev), bridge_config(config)
 {
@@ -38,6 +46,10 @@ Adv_dbg_itf::Adv_dbg_itf(js::config *system_config, js::config *config, Log* log
   pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
   pthread_mutex_init(&mutex, &attr);
 
+  // Scans and flushes done by the low-level cable are accounted with the
+  // accesses done through this interface
+  m_dev->set_stats(this->stats);
+
   js::config *conf = system_config->get("**/adv_dbg_unit/debug_ir");
 
   this->debug_ir = conf != NULL ? conf->get_int() : 0x4;
@@ -55,6 +67,22 @@ Adv_dbg_itf::Adv_dbg_itf(js::config *system_config, js::config *config, Log* log
   this->check_errors = conf != NULL ? conf->get_bool() : false;
   log->debug("Checking errors: %d\n", this->check_errors);
 
+
+  conf = system_config->get("**/adv_dbg_unit/axi_64bits");
+
+  this->axi_64bits = conf != NULL ? conf->get_bool() : false;
+  log->debug("Using 64 bits bursts: %d\n", this->axi_64bits);
+
+
+  conf = system_config->get("**/adv_dbg_unit/max_burst_size");
+
+  this->max_burst_size = conf != NULL ? conf->get_int() : ADBG_MAX_BURST_WORDS * 4;
+  if (this->max_burst_size > ADBG_MAX_BURST_WORDS * 4)
+    this->max_burst_size = ADBG_MAX_BURST_WORDS * 4;
+  if (this->max_burst_size < 8)
+    this->max_burst_size = 8;
+  log->debug("Using max burst size: %d\n", this->max_burst_size);
+
 }
 
 
@@ -119,10 +147,7 @@ bool Adv_dbg_itf::jtag_reset(bool active)
 
   pthread_mutex_lock(&mutex);
 
-  for (int i=0; i < m_jtag_devices.size(); i++)
-  {
-    m_jtag_devices[i].is_in_debug = false;
-  }
+  this->invalidate_debug();
   bool result = m_dev->jtag_reset(active);
 
   pthread_mutex_unlock(&mutex);
@@ -165,6 +190,9 @@ bool Adv_dbg_itf::chip_reset(bool active, int duration)
 
   pthread_mutex_lock(&mutex);
 
+  // The debug module selection may not survive the reset
+  this->invalidate_debug();
+
   if (!m_dev->chip_reset(active, duration)) { result = false; goto end; };
   // Wait some time so that we don't do any IO access after that while the chip
   // has not finished booting
@@ -364,106 +392,50 @@ bool Adv_dbg_itf::reg_access_pulp(bool write, unsigned int addr, char* buffer)
 
 bool Adv_dbg_itf::access(bool wr, unsigned int addr, int size, char* buffer, int device)
 {
-  bool result;
-
-  this->check_connection();
-
-  pthread_mutex_lock(&mutex);
-
-  if (device != -1)
-    this->device_select(device);
-  else if (m_jtag_device_default != m_jtag_device_sel)
-    this->device_select(m_jtag_device_default);
+  Cable_io_req req(wr, addr, size, buffer);
+  return this->access_reqs(&req, 1, device);
+}
 
-  jtag_debug();
 
-  if (wr)
-    result = write(addr, size, buffer);
-  else
-    result = read(addr, size, buffer);
 
-  pthread_mutex_unlock(&mutex);
+bool Adv_dbg_itf::access_batch(std::vector<Cable_io_req> &reqs, int device)
+{
+  if (reqs.size() == 0)
+    return true;
 
-  return result;
+  return this->access_reqs(&reqs[0], reqs.size(), device);
 }
 
 
 
-bool Adv_dbg_itf::write(unsigned int _addr, int _size, char* _buffer)
+bool Adv_dbg_itf::access_reqs(Cable_io_req *reqs, int nb_reqs, int device)
 {
+  bool retval = false;
   int count = 0;
-  do
-  {
-    unsigned int addr = _addr;
-    int size = _size;
-    char *buffer = _buffer;
 
-    bool retval = true;
-
-    if (addr & 0x1 && size >= 1) {
-      retval = retval && write_internal(8, addr, 1, buffer);
-      size   -= 1;
-      buffer += 1;
-      addr   += 1;
-    }
-
-    if (addr & 0x2 && size >= 2) {
-      retval = retval && write_internal(16, addr, 2, buffer);
-      size   -= 2;
-      buffer += 2;
-      addr   += 2;
-    }
+  this->check_connection();
 
-  #if 0
+  pthread_mutex_lock(&mutex);
 
-    // TODO add 64 bits support and make sure it is not used on pulp targets
+  auto start = std::chrono::steady_clock::now();
 
-    if (addr & 0x4 && size >= 4) {
-      retval = retval && write_internal(AXI_WRITE32, addr, 4, buffer);
-      size   -= 4;
-      buffer += 4;
-      addr   += 4;
-    }
+  if (device != -1)
+    this->device_select(device);
+  else if (m_jtag_device_default != m_jtag_device_sel)
+    this->device_select(m_jtag_device_default);
 
-    if (size >= 8) {
-      int local_size = size & (~0x7);
-      retval = retval && write_internal(AXI_WRITE64, addr, local_size, buffer);
-      size   -= local_size;
-      buffer += local_size;
-      addr   += local_size;
-    }
+  jtag_debug();
 
-  #else
-
-    if (size >= 4) {
-      int local_size = size & (~0x3);
-
-       while (local_size)
-       {
-         int iter_size = local_size;
-         if (iter_size > 1024) iter_size = 1024;
-
-         retval = retval && write_internal(32, addr, iter_size, buffer);
-         local_size   -= iter_size;
-         size   -= iter_size;
-         buffer += iter_size;
-         addr   += iter_size;
-       }
-     }
-  #endif
-
-    if (size >= 2) {
-      retval = retval && write_internal(16, addr, 2, buffer);
-      size   -= 2;
-      buffer += 2;
-      addr   += 2;
-    }
+  // The whole batch is executed with the debug module selected once, and the
+  // error register is only checked at the end, in which case the whole batch
+  // is replayed.
+  do
+  {
+    retval = true;
 
-    if (size >= 1) {
-      retval = retval && write_internal(8, addr, 1, buffer);
-      size   -= 1;
-      buffer += 1;
-      addr   += 1;
+    for (int i=0; i<nb_reqs; i++)
+    {
+      retval = retval && burst_access(reqs[i].write, reqs[i].addr, reqs[i].size, reqs[i].buffer);
     }
 
     if (this->check_errors)
@@ -473,115 +445,113 @@ bool Adv_dbg_itf::write(unsigned int _addr, int _size, char* _buffer)
       retval = retval && read_error_reg(&error_addr, &error);
 
       if (error) {
-        log->debug("advdbg reports: Failed to write to addr %X\n", error_addr);
+        log->debug("advdbg reports: Failed to access addr %X\n", error_addr);
+        retval = false;
         count++;
+        this->stats->add(CABLE_STATS_RETRIES);
         continue;
       }
     }
 
-    return retval;
+    break;
   } while (count < this->retry_count);
 
-  return false;
-}
+  // Write-only batches may still be buffered or in flight in the cable, wait
+  // until they reach the target so that their errors are reported here
+  if (m_dev->sync() < 0)
+    retval = false;
 
+  for (int i=0; i<nb_reqs; i++)
+  {
+    this->stats->add_access(reqs[i].write, reqs[i].size);
+  }
+  if (!retval)
+    this->stats->add(CABLE_STATS_ERRORS);
+  this->stats->add_latency(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
 
+  pthread_mutex_unlock(&mutex);
 
-bool Adv_dbg_itf::read(unsigned int _addr, int _size, char* _buffer)
-{
-  int count = 0;
-  do
-  {
-    unsigned int addr = _addr;
-    int size = _size;
-    char *buffer = _buffer;
+  return retval;
+}
 
-    bool retval = true;
 
-    if (addr & 0x1 && size >= 1) {
-      retval = retval && read_internal(8, addr, 1, buffer);
-      size   -= 1;
-      buffer += 1;
-      addr   += 1;
-    }
 
-    if (addr & 0x2 && size >= 2) {
-      retval = retval && read_internal(16, addr, 2, buffer);
-      size   -= 2;
-      buffer += 2;
-      addr   += 2;
-    }
+bool Adv_dbg_itf::burst_access(bool wr, unsigned int addr, int size, char* buffer)
+{
+  bool retval = true;
+
+  // Unaligned head
+  if (addr & 0x1 && size >= 1) {
+    retval = retval && (wr ? write_internal(8, addr, 1, buffer) : read_internal(8, addr, 1, buffer));
+    size   -= 1;
+    buffer += 1;
+    addr   += 1;
+  }
 
-  #if 0
+  if (addr & 0x2 && size >= 2) {
+    retval = retval && (wr ? write_internal(16, addr, 2, buffer) : read_internal(16, addr, 2, buffer));
+    size   -= 2;
+    buffer += 2;
+    addr   += 2;
+  }
 
-    // TODO add 64 bits support and make sure it is not used on pulp targets
+  // 64 bits bursts must be explicitly enabled as they are not supported by
+  // pulp targets
+  int bitwidth = 32;
 
+  if (this->axi_64bits)
+  {
     if (addr & 0x4 && size >= 4) {
-      retval = retval && read_internal(AXI_READ32, addr, 4, buffer);
+      retval = retval && (wr ? write_internal(32, addr, 4, buffer) : read_internal(32, addr, 4, buffer));
       size   -= 4;
       buffer += 4;
       addr   += 4;
     }
 
-    if (size >= 8) {
-      int local_size = size & (~0x7);
-      retval = retval && read_internal(AXI_READ64, addr, local_size, buffer);
-      size   -= local_size;
-      buffer += local_size;
-      addr   += local_size;
-    }
-    
-  #else
-
-    if (size >= 4) {
-      int local_size = size & (~0x3);
-
-      while (local_size)
-      {
-        int iter_size = local_size;
-        if (iter_size > 2048) iter_size = 2048  ;
-
-        retval = retval && read_internal(32, addr, iter_size, buffer);
-        local_size   -= iter_size;
-        size   -= iter_size;
-        buffer += iter_size;
-        addr   += iter_size;
-      }
-    }
+    bitwidth = 64;
+  }
 
-  #endif
+  // Aligned body, split into the biggest bursts the burst counter can handle
+  int bytewidth = bitwidth / 8;
+  int max_burst_size = (this->max_burst_size / bytewidth) * bytewidth;
 
-    if (size >= 2) {
-      retval = retval && read_internal(16, addr, 2, buffer);
-      size   -= 2;
-      buffer += 2;
-      addr   += 2;
-    }
+  int local_size = size & ~(bytewidth - 1);
 
-    if (size >= 1) {
-      retval = retval && read_internal(8, addr, 1, buffer);
-      size   -= 1;
-      buffer += 1;
-      addr   += 1;
-    }
+  while (local_size)
+  {
+    int iter_size = local_size;
+    if (iter_size > max_burst_size) iter_size = max_burst_size;
+
+    retval = retval && (wr ? write_internal(bitwidth, addr, iter_size, buffer) : read_internal(bitwidth, addr, iter_size, buffer));
+    local_size -= iter_size;
+    size       -= iter_size;
+    buffer     += iter_size;
+    addr       += iter_size;
+  }
 
-    if (this->check_errors)
-    {
-      uint32_t error_addr;
-      bool error = false;
-      retval = retval && read_error_reg(&error_addr, &error);
+  // Unaligned tail
+  if (size >= 4) {
+    retval = retval && (wr ? write_internal(32, addr, 4, buffer) : read_internal(32, addr, 4, buffer));
+    size   -= 4;
+    buffer += 4;
+    addr   += 4;
+  }
 
-      if (error) {
-        log->debug("advdbg reports: Failed to read from addr %X\n", error_addr);
-        count++;
-        continue;
-      }
-    }
+  if (size >= 2) {
+    retval = retval && (wr ? write_internal(16, addr, 2, buffer) : read_internal(16, addr, 2, buffer));
+    size   -= 2;
+    buffer += 2;
+    addr   += 2;
+  }
 
-    return retval;
-  } while (count < retry_count);
+  if (size >= 1) {
+    retval = retval && (wr ? write_internal(8, addr, 1, buffer) : read_internal(8, addr, 1, buffer));
+    size   -= 1;
+    buffer += 1;
+    addr   += 1;
+  }
 
-  return false;
+  return retval;
 }
 
 
@@ -591,6 +561,8 @@ bool Adv_dbg_itf::write_internal(int bitwidth, unsigned int addr, int size, char
     return false;
 
   jtag_device &dev = m_jtag_devices[m_jtag_device_sel];
+
+  this->stats->add(CABLE_STATS_BURSTS);
   
   if (dev.protocol == DEV_PROTOCOL_RISCV)
     return this->write_internal_riscv(bitwidth, addr, size, buffer);
@@ -675,9 +647,15 @@ bool Adv_dbg_itf::write_internal_pulp(int bitwidth, unsigned int addr, int size,
   }
 
   // send data
-  if (!m_dev->stream_inout(NULL, buffer, size * 8, false)) {
-    log->warning("ft2232: failed to write data to device\n");
-    return false;
+  for (int offset = 0; offset < size; offset += ADBG_STREAM_CHUNK)
+  {
+    int iter_size = size - offset;
+    if (iter_size > ADBG_STREAM_CHUNK) iter_size = ADBG_STREAM_CHUNK;
+
+    if (!m_dev->stream_inout(NULL, &buffer[offset], iter_size * 8, false)) {
+      log->warning("ft2232: failed to write data to device\n");
+      return false;
+    }
   }
 
   // send crc
@@ -724,6 +702,8 @@ bool Adv_dbg_itf::read_internal(int bitwidth, unsigned int addr, int size, char*
     return false;
 
   jtag_device &dev = m_jtag_devices[m_jtag_device_sel];
+
+  this->stats->add(CABLE_STATS_BURSTS);
   
   if (dev.protocol == DEV_PROTOCOL_RISCV)
     return this->read_internal_riscv(bitwidth, addr, size, buffer);
@@ -738,8 +718,8 @@ bool Adv_dbg_itf::read_internal_riscv(int bitwidth, unsigned int addr, int size,
 
 bool Adv_dbg_itf::read_internal_pulp(int bitwidth, unsigned int addr, int size, char* buffer)
 {
-  char recv[size];
-  char buf[size < 8 ? 8 : size];
+  char recv[ADBG_STREAM_CHUNK];
+  char buf[ADBG_STREAM_CHUNK];
   int nwords;
   uint32_t crc = 0xFFFFFFFF;
   ADBG_OPCODES opcode;
@@ -767,15 +747,6 @@ bool Adv_dbg_itf::read_internal_pulp(int bitwidth, unsigned int addr, int size,
       return false;
   }
 
-  int factor = 1;
-
-  // Increase the word size in case we have big burst with good multiple
-  if (size >= 256 && size % 256 == 0)
-  {
-    bytewidth = 256;
-    factor = bytewidth / 4;
-  }
-
   if (size % bytewidth != 0) {
     log->warning("Size is not aligned to selected bitwidth\n");
     return false;
@@ -797,8 +768,8 @@ bool Adv_dbg_itf::read_internal_pulp(int bitwidth, unsigned int addr, int size,
   buf[4] = addr >> 16;
   buf[3] = addr >>  8;
   buf[2] = addr >>  0;
-  buf[1] = (nwords * factor) >> 8;
-  buf[0] = (nwords * factor) >> 0;
+  buf[1] = nwords >> 8;
+  buf[0] = nwords >> 0;
 
   if (!m_dev->stream_inout(NULL, buf, 53, m_tms_on_last)) {
     log->warning("ft2232: failed to write opcode stream to device\n");
@@ -840,20 +811,22 @@ bool Adv_dbg_itf::read_internal_pulp(int bitwidth, unsigned int addr, int size,
   }
 
   // make sure we only send 0's to the device
-  memset(buf, 0, size);
+  memset(buf, 0, sizeof(buf));
 
-  // receive data
+  // receive data, the burst is a continuous stream so it can be received by
+  // chunks independently of the word size
   crc = 0xFFFFFFFF;
-  for (int i = 0; i < nwords; i++) {
-    if (!m_dev->stream_inout(recv, buf, bytewidth*8, false)) {
+  for (int offset = 0; offset < size; offset += ADBG_STREAM_CHUNK) {
+    int iter_size = size - offset;
+    if (iter_size > ADBG_STREAM_CHUNK) iter_size = ADBG_STREAM_CHUNK;
+
+    if (!m_dev->stream_inout(recv, buf, iter_size*8, false)) {
       log->warning("ft2232: failed to receive data from device\n");
       return false;
     }
 
-    memcpy(buffer, recv, bytewidth);
-    crc = crc_compute(crc, recv, bytewidth*8);
-
-    buffer = buffer + bytewidth;
+    memcpy(&buffer[offset], recv, iter_size);
+    crc = crc_compute(crc, recv, iter_size*8);
   }
 
   // receive crc
@@ -886,6 +859,8 @@ bool Adv_dbg_itf::read_error_reg(uint32_t *addr, bool *error)
   assert (addr != NULL);
   assert (error != NULL);
 
+  this->stats->add(CABLE_STATS_ERROR_CHECKS);
+
   jtag_axi_select();
 
   jtag_pad_before();
@@ -1035,7 +1010,20 @@ bool Adv_dbg_itf::jtag_debug()
   {
     jtag_soft_reset();
     dev.is_in_debug = jtag_set_selected_ir(this->debug_ir);
-    return dev.is_in_debug;
+    dev.is_axi_selected = false;
+  }
+
+  return dev.is_in_debug;
+}
+
+
+
+void Adv_dbg_itf::invalidate_debug()
+{
+  for (int i=0; i < m_jtag_devices.size(); i++)
+  {
+    m_jtag_devices[i].is_in_debug = false;
+    m_jtag_devices[i].is_axi_selected = false;
   }
 }
 
@@ -1046,6 +1034,9 @@ bool Adv_dbg_itf::jtag_dmi_select()
   char buf[1];
   buf[0] = 0x11;
 
+  if (m_jtag_device_sel < m_jtag_devices.size())
+    m_jtag_devices[m_jtag_device_sel].is_axi_selected = false;
+
   m_dev->jtag_write_tms(1); // select DR scan
   m_dev->jtag_write_tms(0); // capture DR scan
   m_dev->jtag_write_tms(0); // shift DR
@@ -1080,6 +1071,11 @@ bool Adv_dbg_itf::jtag_axi_select()
   m_dev->jtag_write_tms(0); // capture DR scan
   m_dev->jtag_write_tms(0); // shift DR
 
+  // The module stays selected until another module select command is sent
+  // or the IR is changed, so just stay in shift DR to issue the next command.
+  if (m_jtag_device_sel < m_jtag_devices.size() && m_jtag_devices[m_jtag_device_sel].is_axi_selected)
+    return true;
+
   jtag_pad_before();
 
   if (!m_dev->stream_inout(NULL, buf, 6, m_tms_on_last)) {
@@ -1096,6 +1092,9 @@ bool Adv_dbg_itf::jtag_axi_select()
 
   m_dev->flush();
 
+  if (m_jtag_device_sel < m_jtag_devices.size())
+    m_jtag_devices[m_jtag_device_sel].is_axi_selected = true;
+
   return true;
 }
 
@@ -1106,6 +1105,7 @@ void Adv_dbg_itf::add_device(int ir_len, int protocol)
   jtag_device device;
   device.index  = m_jtag_devices.size();
   device.is_in_debug = false;
+  device.is_axi_selected = false;
   device.ir_len = ir_len;
   device.protocol = protocol;
   m_jtag_devices.push_back(device);
@@ -1161,6 +1161,7 @@ bool Adv_dbg_itf::jtag_auto_discovery()
       device.id |= (recv_buf[i*4 + 0] & 0xFF) <<  0;
       device.index  = i;
       device.is_in_debug = false;
+      device.is_axi_selected = false;
       device.protocol = DEV_PROTOCOL_PULP;
       // TODO the detacted IR length is wrong when there are several taps
       device.ir_len = 4;
@@ -1290,10 +1291,7 @@ bool Adv_dbg_itf::jtag_soft_reset()
 {
   pthread_mutex_lock(&mutex);
 
-  for (int i=0; i < m_jtag_devices.size(); i++)
-  {
-    m_jtag_devices[i].is_in_debug = false;
-  }
+  this->invalidate_debug();
   bool result = m_dev->jtag_soft_reset();
 
   pthread_mutex_unlock(&mutex);
@@ -1306,7 +1304,34 @@ bool Adv_dbg_itf::jtag_soft_reset()
 
 #define ADBG_CRC_POLY 0xedb88320
 
-uint32_t Adv_dbg_itf::crc_compute(uint32_t crc, char* data_in, int length_bits)
+// Tables for the slice-by-8 CRC computation, the first one is the usual
+// byte-wise table of the reflected polynomial, the others give the
+// contribution of a byte which is 1 to 7 bytes further in the stream
+static uint32_t adbg_crc_table[8][256];
+
+static bool adbg_crc_table_init()
+{
+  for (int i = 0; i < 256; i++)
+  {
+    uint32_t crc = i;
+    for (int j = 0; j < 8; j++)
+      crc = (crc >> 1) ^ ((crc & 1) ? ADBG_CRC_POLY : 0);
+    adbg_crc_table[0][i] = crc;
+  }
+
+  for (int i = 0; i < 256; i++)
+  {
+    for (int j = 1; j < 8; j++)
+    {
+      uint32_t crc = adbg_crc_table[j-1][i];
+      adbg_crc_table[j][i] = (crc >> 8) ^ adbg_crc_table[0][crc & 0xff];
+    }
+  }
+
+  return true;
+}
+
+uint32_t Adv_dbg_itf::crc_compute_bitwise(uint32_t crc, char* data_in, int length_bits)
 {
   uint32_t d, c;
 
@@ -1321,6 +1346,49 @@ uint32_t Adv_dbg_itf::crc_compute(uint32_t crc, char* data_in, int length_bits)
   return crc;
 }
 
+uint32_t Adv_dbg_itf::crc_compute(uint32_t crc, char* data_in, int length_bits)
+{
+  static bool table_ready = adbg_crc_table_init();
+  const uint8_t *data = (const uint8_t *)data_in;
+  int length = length_bits / 8;
+
+  (void)table_ready;
+
+  // Bits are shifted LSB first, which is the reflected CRC32 without final
+  // xor, so full bytes can go through the tables, 8 bytes at a time
+  while (length >= 8)
+  {
+    uint32_t low = crc ^ (data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24));
+    uint32_t high = data[4] | (data[5] << 8) | (data[6] << 16) | ((uint32_t)data[7] << 24);
+
+    crc = adbg_crc_table[7][low & 0xff] ^ adbg_crc_table[6][(low >> 8) & 0xff] ^
+          adbg_crc_table[5][(low >> 16) & 0xff] ^ adbg_crc_table[4][low >> 24] ^
+          adbg_crc_table[3][high & 0xff] ^ adbg_crc_table[2][(high >> 8) & 0xff] ^
+          adbg_crc_table[1][(high >> 16) & 0xff] ^ adbg_crc_table[0][high >> 24];
+
+    data += 8;
+    length -= 8;
+  }
+
+  while (length > 0)
+  {
+    crc = (crc >> 8) ^ adbg_crc_table[0][(crc ^ *data) & 0xff];
+    data++;
+    length--;
+  }
+
+  // Remaining bits of the last partial byte
+  for (int i = 0; i < length_bits % 8; i++)
+  {
+    uint32_t d = ((*data >> i) & 0x1) ? 0xffffffff : 0;
+    uint32_t c = (crc & 0x1) ? 0xffffffff : 0;
+    crc = crc >> 1;
+    crc = crc ^ ((d ^ c) & ADBG_CRC_POLY);
+  }
+
+  return crc;
+}
+
 
 
 bool Adv_dbg_itf::jtag_pad_before()
@@ -1376,7 +1444,10 @@ bool Adv_dbg_itf::bit_inout(char* inbit, char outbit, bool last)
   // Invalidate debug mode in case the caller is sending raw bitstream as it might
   // change the IR
   if (m_jtag_device_sel < m_jtag_devices.size())
+  {
     m_jtag_devices[m_jtag_device_sel].is_in_debug = false;
+    m_jtag_devices[m_jtag_device_sel].is_axi_selected = false;
+  }
   bool result = m_dev->bit_inout(inbit, outbit, last);
 
   pthread_mutex_unlock(&mutex);
@@ -1393,7 +1464,10 @@ bool Adv_dbg_itf::stream_inout(char* instream, char* outstream, unsigned int n_b
   // Invalidate debug mode in case the caller is sending raw bitstream as it might
   // change the IR
   if (m_jtag_device_sel < m_jtag_devices.size())
+  {
     m_jtag_devices[m_jtag_device_sel].is_in_debug = false;
+    m_jtag_devices[m_jtag_device_sel].is_axi_selected = false;
+  }
   bool result = m_dev->stream_inout(instream, outstream, n_bits, last);
 
   pthread_mutex_unlock(&mutex);
@@ -1405,7 +1479,19 @@ int Adv_dbg_itf::flush()
 {
   pthread_mutex_lock(&mutex);
 
-  bool result = m_dev->flush();
+  // Like the low-level cables, a negative value reports an error
+  int result = m_dev->flush() < 0 ? -1 : 0;
+
+  pthread_mutex_unlock(&mutex);
+
+  return result;
+}
+
+int Adv_dbg_itf::sync()
+{
+  pthread_mutex_lock(&mutex);
+
+  int result = m_dev->sync() < 0 ? -1 : 0;
 
   pthread_mutex_unlock(&mutex);
 
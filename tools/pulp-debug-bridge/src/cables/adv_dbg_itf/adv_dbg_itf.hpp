@@ -35,6 +35,7 @@ struct jtag_device {
   unsigned int index;
   unsigned int ir_len;
   bool is_in_debug;
+  bool is_axi_selected;
   int protocol;
 };
 
@@ -49,6 +50,7 @@ class Adv_dbg_itf : public Cable  {
 
 
     bool access(bool write, unsigned int addr, int size, char* buffer, int device=-1);
+    bool access_batch(std::vector<Cable_io_req> &reqs, int device=-1);
     bool reg_access(bool write, unsigned int addr, char* buffer, int device=-1);
 
     void device_select(unsigned int i);
@@ -66,6 +68,12 @@ class Adv_dbg_itf : public Cable  {
     bool stream_inout(char* instream, char* outstream, unsigned int n_bits, bool last);
 
     int flush();
+    int sync();
+
+    // CRC of the burst payloads, crc_compute_bitwise is the original per-bit
+    // routine, kept as a reference for crc_compute
+    static uint32_t crc_compute(uint32_t crc, char* data_in, int length_bits);
+    static uint32_t crc_compute_bitwise(uint32_t crc, char* data_in, int length_bits);
 
 
   private:
@@ -91,6 +99,8 @@ class Adv_dbg_itf : public Cable  {
     int retry_count;
     int check_errors;
     int access_timeout;
+    int max_burst_size;
+    bool axi_64bits;
 
 
     std::vector<jtag_device> m_jtag_devices;
@@ -107,12 +117,13 @@ class Adv_dbg_itf : public Cable  {
     bool reg_access_read_riscv(bool write, unsigned int addr, char* buffer);
     bool reg_access_write_riscv(bool write, unsigned int addr, char* buffer);
 
-    bool write(unsigned int addr, int size, char* buffer);
+    bool access_reqs(Cable_io_req *reqs, int nb_reqs, int device);
+    bool burst_access(bool write, unsigned int addr, int size, char* buffer);
+
     bool write_internal(int bitwidth, unsigned int addr, int size, char* buffer);
     bool write_internal_pulp(int bitwidth, unsigned int addr, int size, char* buffer);
     bool write_internal_riscv(int bitwidth, unsigned int addr, int size, char* buffer);
 
-    bool read(unsigned int addr, int size, char* buffer);
     bool read_internal(int bitwidth, unsigned int addr, int size, char* buffer);
     bool read_internal_pulp(int bitwidth, unsigned int addr, int size, char* buffer);
     bool read_internal_riscv(int bitwidth, unsigned int addr, int size, char* buffer);
@@ -124,6 +135,7 @@ class Adv_dbg_itf : public Cable  {
     bool jtag_pad_after(bool tms);
 
     bool jtag_debug();
+    void invalidate_debug();
 
     int  ir_len_detect();
     int  dr_len_detect();
@@ -137,8 +149,6 @@ class Adv_dbg_itf : public Cable  {
     bool check_cable();
 
     bool jtag_dmi_select();
-
-    uint32_t crc_compute(uint32_t crc, char* data_in, int length_bits);
 };
 
 #endif
@@ -63,28 +63,51 @@
 //-----------------------------------------------------------------------------
 
 Ftdi::Ftdi(js::config *config, Log* log, FTDIDeviceID id) : Cable(config), log (log), m_id (id)
+{
+  m_params.send_buf = NULL;
+  m_params.recv_buf = NULL;
+
+  for (int i=0; i<FTDI_ASYNC_BUFFERS; i++)
+  {
+    async_buffers[i].buf = NULL;
+    async_buffers[i].tc = NULL;
+  }
+
+  get_descriptors(config, m_descriptors);
+}
+
+void Ftdi::get_descriptors(js::config *config, std::list<struct device_desc> &descriptors)
 {
   if (config->get("**/vendor") != NULL && config->get("**/product") != NULL)
   {
-    m_descriptors.push_back((struct device_desc){(unsigned int)config->get_child_int("**/vendor"), (unsigned int)config->get_child_int("**/product")});
+    descriptors.push_back((struct device_desc){(unsigned int)config->get_child_int("**/vendor"), (unsigned int)config->get_child_int("**/product")});
   }
   else
   {
     // add all our known devices to the map
-    m_descriptors.push_back((struct device_desc){0x15ba, 0x002a});
-    m_descriptors.push_back((struct device_desc){0x15ba, 0x002b});
+    descriptors.push_back((struct device_desc){0x15ba, 0x002a});
+    descriptors.push_back((struct device_desc){0x15ba, 0x002b});
 
-    m_descriptors.push_back((struct device_desc){0x0403, 0x6010}); // ftdi2232 Gapuino
-    m_descriptors.push_back((struct device_desc){0x1d6b, 0x0002}); // ftdi2232 Gapuino
+    descriptors.push_back((struct device_desc){0x0403, 0x6010}); // ftdi2232 Gapuino
+    descriptors.push_back((struct device_desc){0x1d6b, 0x0002}); // ftdi2232 Gapuino
   }
 }
 
 Ftdi::~Ftdi()
 {
+  if (m_params.send_buf)
+  {
+    flush();
+    ft2232_async_wait_all();
+  }
+
   ftdi_usb_close(&m_ftdic);
   ftdi_deinit(&m_ftdic);
 
-  if (m_params.send_buf) free(m_params.send_buf);
+  for (int i=0; i<FTDI_ASYNC_BUFFERS; i++)
+  {
+    if (async_buffers[i].buf) free(async_buffers[i].buf);
+  }
   if (m_params.recv_buf) free(m_params.recv_buf);
 }
 
@@ -97,23 +120,49 @@ Ftdi::connect(js::config *config)
   bool result;
   int err;
   const char *description = NULL;
+  const char *serial = NULL;
+  // Keep the strings for the whole function, the pointers above refer to them
+  std::string description_str;
+  std::string serial_str;
   js::config *user_gpios = config->get("user_gpios");
 
   if (config && config->get("description") != NULL)
   {
-    description = config->get("description")->get_str().c_str();
+    description_str = config->get("description")->get_str();
+    description = description_str.c_str();
   }
 
-  m_params.send_buf_len   = FTDX_MAXSEND;
+  if (config && config->get("serial") != NULL)
+  {
+    serial_str = config->get("serial")->get_str();
+    serial = serial_str.c_str();
+  }
+
+  // The send buffer is always one of the asynchronous buffers, only the
+  // first one is used in synchronous mode
+  for (int i=0; i<FTDI_ASYNC_BUFFERS; i++)
+  {
+    async_buffers[i].buf_len = FTDX_MAXSEND;
+    async_buffers[i].buf     = (char*)malloc(async_buffers[i].buf_len);
+    async_buffers[i].tc      = NULL;
+
+    if (!async_buffers[i].buf) {
+      log->error("ftdi2232: Can't allocate memory for ftdi context structures\n");
+      goto fail;
+    }
+  }
+
+  async_current           = 0;
+  m_params.send_buf_len   = async_buffers[0].buf_len;
   m_params.send_buffered  = 0;
-  m_params.send_buf       = (char*)malloc(m_params.send_buf_len);
+  m_params.send_buf       = async_buffers[0].buf;
   m_params.recv_buf_len   = FTDI_MAXRECV;
   m_params.to_recv        = 0;
   m_params.recv_write_idx = 0;
   m_params.recv_read_idx  = 0;
   m_params.recv_buf       = (char*)malloc(m_params.recv_buf_len);
 
-  if (!m_params.send_buf || !m_params.recv_buf) {
+  if (!m_params.recv_buf) {
     log->error("ftdi2232: Can't allocate memory for ftdi context structures\n");
     goto fail;
   }
@@ -136,7 +185,16 @@ Ftdi::connect(js::config *config)
   {
     //---------------------------------------------------------------------------
     // Device Selection
-    if (description == NULL) {
+    if (serial != NULL && description == NULL) {
+      // Several boards can be connected, only open the one with the
+      // requested serial number
+      log->user("Connecting to ftdi device with serial %s\n", serial);
+      error = -3;
+      for (std::list<struct device_desc>::iterator it = dev_desc.begin();
+           it != dev_desc.end() && error != 0; it++) {
+        error = ftdi_usb_open_desc(&m_ftdic, it->vid, it->pid, NULL, serial);
+      }
+    } else if (description == NULL) {
       std::list<struct device_desc> dev_available;
       struct device_desc dev;
 
@@ -201,6 +259,13 @@ Ftdi::connect(js::config *config)
 
   log->debug("Connected to libftdi driver.\n");
 
+#ifdef FTDI_ASYNC
+  // Asynchronous mode is enabled by default, it lets the USB transfers of
+  // MPSSE commands overlap with the generation of the next ones
+  this->async = config->get("async") == NULL || config->get_child_bool("async");
+  log->debug("Using asynchronous USB transfers: %d\n", this->async);
+#endif
+
   //---------------------------------------------------------------------------
   // Setup layout for different devices
 
@@ -256,9 +321,16 @@ Ftdi::connect(js::config *config)
   return true;
 
 fail:
-  if (m_params.send_buf) free(m_params.send_buf);
+  for (int i=0; i<FTDI_ASYNC_BUFFERS; i++)
+  {
+    if (async_buffers[i].buf) free(async_buffers[i].buf);
+    async_buffers[i].buf = NULL;
+  }
   if (m_params.recv_buf) free(m_params.recv_buf);
 
+  m_params.send_buf = NULL;
+  m_params.recv_buf = NULL;
+
   return false;
 }
 
@@ -325,22 +397,47 @@ Ftdi::ft2232_seq_reset() {
   return 0;
 }
 
+int
+Ftdi::sync() {
+  if (flush() < 0)
+    return -1;
+
+  // In asynchronous mode, the flush only submits the transfers
+  if (this->async && ft2232_async_wait_all() < 0)
+    return -1;
+
+  return 0;
+}
+
 int
 Ftdi::flush() {
-  unsigned int xferred;
+  int xferred;
   unsigned int recvd = 0;
 
   if (m_params.send_buffered == 0)
     return 0;
 
-  if ((xferred = ftdi_write_data(&m_ftdic, (uint8_t*)m_params.send_buf, m_params.send_buffered)) < 0) {
-    log->warning("ft2232: ftdi_write_data() failed\n");
-    return -1;
+  this->stats->add(CABLE_STATS_FLUSHES);
+
+  if (this->async)
+  {
+    // Just submit the commands, the completion is checked when the buffer is
+    // reused. Reads are still done synchronously below, as the USB endpoints
+    // keep the order, they will get the results of the submitted commands.
+    if ((xferred = ft2232_async_submit()) < 0)
+      return -1;
   }
+  else
+  {
+    if ((xferred = ftdi_write_data(&m_ftdic, (uint8_t*)m_params.send_buf, m_params.send_buffered)) < 0) {
+      log->warning("ft2232: ftdi_write_data() failed\n");
+      return -1;
+    }
 
-  if (xferred < m_params.send_buffered) {
-    log->warning("Written fewer bytes than requested.\n");
-    return -1;
+    if (xferred < m_params.send_buffered) {
+      log->warning("Written fewer bytes than requested.\n");
+      return -1;
+    }
   }
 
   m_params.send_buffered = 0;
@@ -441,6 +538,9 @@ int Ftdi::ft2232_write(char *buf, int len, int recv)
 
     if (m_params.send_buf)
       m_params.send_buf = (char*)realloc(m_params.send_buf, m_params.send_buf_len);
+
+    async_buffers[async_current].buf = m_params.send_buf;
+    async_buffers[async_current].buf_len = m_params.send_buf_len;
   }
 
   assert(m_params.send_buf);
@@ -458,6 +558,75 @@ int Ftdi::ft2232_write(char *buf, int len, int recv)
   return xferred < 0 ? -1 : len;
 }
 
+int Ftdi::ft2232_async_submit()
+{
+#ifdef FTDI_ASYNC
+  struct ftdi_async_buffer *buffer = &async_buffers[async_current];
+  int len = m_params.send_buffered;
+
+  buffer->size = len;
+  buffer->tc = ftdi_write_data_submit(&m_ftdic, (uint8_t*)buffer->buf, len);
+  if (buffer->tc == NULL) {
+    log->warning("ft2232: ftdi_write_data_submit() failed\n");
+    return -1;
+  }
+
+  // Switch to the next buffer, it can only be filled once its previous
+  // transfer is over
+  async_current = (async_current + 1) % FTDI_ASYNC_BUFFERS;
+
+  if (ft2232_async_wait(async_current) < 0)
+    return -1;
+
+  m_params.send_buf = async_buffers[async_current].buf;
+  m_params.send_buf_len = async_buffers[async_current].buf_len;
+
+  return len;
+#else
+  return -1;
+#endif
+}
+
+int Ftdi::ft2232_async_wait(int index)
+{
+#ifdef FTDI_ASYNC
+  struct ftdi_async_buffer *buffer = &async_buffers[index];
+
+  if (buffer->tc == NULL)
+    return 0;
+
+  int xferred = ftdi_transfer_data_done(buffer->tc);
+  buffer->tc = NULL;
+
+  if (xferred < 0) {
+    log->warning("ft2232: ftdi_transfer_data_done() failed\n");
+    return -1;
+  }
+
+  if (xferred < buffer->size) {
+    log->warning("Written fewer bytes than requested.\n");
+    return -1;
+  }
+
+  return xferred;
+#else
+  return 0;
+#endif
+}
+
+int Ftdi::ft2232_async_wait_all()
+{
+  int result = 0;
+
+  for (int i=0; i<FTDI_ASYNC_BUFFERS; i++)
+  {
+    if (ft2232_async_wait(i) < 0)
+      result = -1;
+  }
+
+  return result;
+}
+
 bool Ftdi::ft2232_mpsse_open()
 {
   char buf[3];
@@ -561,6 +730,36 @@ fail:
   return false;
 }
 
+int Ftdi::get_serials(js::config *config, std::vector<std::string> &serials)
+{
+  std::list<struct device_desc> descriptors;
+  struct ftdi_context ftdic;
+
+  get_descriptors(config, descriptors);
+
+  ftdi_init(&ftdic);
+
+  for (std::list<struct device_desc>::iterator it = descriptors.begin();
+       it != descriptors.end(); it++) {
+    struct ftdi_device_list* devlist;
+    int n = ftdi_usb_find_all(&ftdic, &devlist, it->vid, it->pid);
+
+    for (struct ftdi_device_list *dev = devlist; n > 0 && dev != NULL; dev = dev->next) {
+      char serial[128];
+      if (ftdi_usb_get_strings(&ftdic, dev->dev, NULL, 0, NULL, 0, serial, sizeof(serial)) == 0 && serial[0] != 0) {
+        serials.push_back(std::string(serial));
+      }
+    }
+
+    if (n > 0)
+      ftdi_list_free2(devlist);
+  }
+
+  ftdi_deinit(&ftdic);
+
+  return serials.size();
+}
+
 bool Ftdi::dev_try_open(unsigned int vid, unsigned int pid, unsigned int index) const
 {
   struct ftdi_context ftdic;
@@ -667,6 +866,9 @@ bool Ftdi::stream_in(char* instream, unsigned int n_bits, bool last)
 
 bool Ftdi::stream_inout(char* instream, char* outstream, unsigned int n_bits, bool last)
 {
+  this->stats->add(CABLE_STATS_SCANS);
+  this->stats->add(CABLE_STATS_SCAN_BITS, n_bits);
+
   if (outstream)
   {
     if (!stream_out_internal(outstream, n_bits, instream != NULL, last)) {
@@ -809,8 +1011,8 @@ int Ftdi::ft2232_write_bits(char *buf, int len, bool postread, bool with_tms)
       recv = recv + 1;
   }
 
-  if (flush() < 0)
-    return -1;
+  // No flush here, the bits are sent with the next commands, or when the
+  // caller needs to read something back.
 
   return recv;
 }
@@ -34,6 +34,10 @@ extern "C" {
 #define FTDX_MAXSEND_MPSSE (64 * 1024)
 #define FTDI_MAXRECV   ( 4 * 64)
 
+// Number of MPSSE command buffers used in asynchronous mode, one is filled
+// while the others are being transferred
+#define FTDI_ASYNC_BUFFERS 3
+
 struct ftdi_param {
   uint32_t  send_buf_len;
   uint32_t  send_buffered;
@@ -45,6 +49,13 @@ struct ftdi_param {
   char  *recv_buf;
 };
 
+struct ftdi_async_buffer {
+  char  *buf;
+  uint32_t  buf_len;
+  uint32_t  size;
+  struct ftdi_transfer_control *tc;
+};
+
 class Log;
 
 class Ftdi : public Cable {
@@ -61,6 +72,10 @@ class Ftdi : public Cable {
 
     bool connect(js::config *config);
 
+    // Returns the serial numbers of all the devices matching the known
+    // descriptors, so that several boards can be opened by serial number
+    static int get_serials(js::config *config, std::vector<std::string> &serials);
+
     bool bit_inout(char* inbit, char outbit, bool last);
 
     bool stream_inout(char* instream, char* outstream, unsigned int n_bits, bool last);
@@ -68,6 +83,7 @@ class Ftdi : public Cable {
     bool jtag_reset(bool active);
 
     int flush();
+    int sync();
 
 
 
@@ -104,7 +120,11 @@ class Ftdi : public Cable {
     int ft2232_seq_reset();
     int ft2232_read(char* buf, int len);
     int ft2232_write(char *buf, int len, int recv);
+    int ft2232_async_submit();
+    int ft2232_async_wait(int index);
+    int ft2232_async_wait_all();
     bool dev_try_open(unsigned int vid, unsigned int pid, unsigned int index) const;
+    static void get_descriptors(js::config *config, std::list<struct device_desc> &descriptors);
 
     std::list<struct device_desc> m_descriptors;
     std::vector<int> user_gpios;
@@ -112,6 +132,9 @@ class Ftdi : public Cable {
     Log* log;
     FTDIDeviceID m_id;
     struct ftdi_param m_params;
+    struct ftdi_async_buffer async_buffers[FTDI_ASYNC_BUFFERS];
+    int async_current = 0;
+    bool async = false;
     struct ftdi_context m_ftdic;
     unsigned int bits_value;
     unsigned int bits_direction;
@@ -29,13 +29,23 @@
 #include <arpa/inet.h>
 #include <fcntl.h>
 #include <string.h>
+#include <algorithm>
 #include <sys/select.h>
+#include <netinet/tcp.h>
 
 #include "cables/log.h"
 #include "jtag-proxy.hpp"
 #include "debug_bridge/proxy.hpp"
 
-Jtag_proxy::Jtag_proxy(Log* log) : Cable(NULL)
+// Timeout for the proxy to answer the version request, after which it is
+// considered as an old proxy
+#define JTAG_PROXY_HELLO_TIMEOUT_US 1000000
+
+// Queued requests are sent when they reach this size, even if nothing
+// needs to be read back
+#define JTAG_PROXY_TX_THRESHOLD (64*1024)
+
+Jtag_proxy::Jtag_proxy(Log* log) : Cable(NULL), log(log), version(1), pending_bits(0), pending_tms_count(0)
 {
 }   
 
@@ -75,9 +85,194 @@ bool Jtag_proxy::connect(js::config *config)
             strerror(errno));
     return false;
   }
+
+  // Requests are already gathered before being sent, don't delay them more
+  int flag = 1;
+  setsockopt(m_socket, IPPROTO_TCP, TCP_NODELAY, (void *)&flag, sizeof(flag));
+
+  return negotiate();
+}
+
+bool Jtag_proxy::negotiate()
+{
+  proxy_req_t req = { .type=DEBUG_BRIDGE_HELLO_REQ };
+  req.hello.version = DEBUG_BRIDGE_PROXY_VERSION;
+
+  if (::send(m_socket, (void *)&req, sizeof(req), 0) != sizeof(req)) return false;
+
+  fd_set rfds;
+  struct timeval tv;
+  FD_ZERO(&rfds);
+  FD_SET(m_socket, &rfds);
+  tv.tv_sec = JTAG_PROXY_HELLO_TIMEOUT_US / 1000000;
+  tv.tv_usec = JTAG_PROXY_HELLO_TIMEOUT_US % 1000000;
+
+  version = 1;
+
+  if (select(m_socket+1, &rfds, NULL, NULL, &tv) > 0)
+  {
+    proxy_req_t reply;
+    if (!recv_all((void *)&reply, sizeof(reply))) return false;
+    if (reply.type == DEBUG_BRIDGE_HELLO_REQ)
+    {
+      version = reply.hello.version < DEBUG_BRIDGE_PROXY_VERSION ? reply.hello.version : DEBUG_BRIDGE_PROXY_VERSION;
+    }
+  }
+
+  log->debug("Using JTAG proxy protocol version %d\n", version);
+
+  return true;
+}
+
+bool Jtag_proxy::recv_all(void *buffer, int size)
+{
+  char *ptr = (char *)buffer;
+  while (size > 0)
+  {
+    int ret = ::recv(m_socket, ptr, size, 0);
+    if (ret <= 0)
+    {
+      if (ret < 0 && errno == EINTR) continue;
+      return false;
+    }
+    ptr += ret;
+    size -= ret;
+  }
   return true;
 }
 
+bool Jtag_proxy::send_queued()
+{
+  uint8_t *ptr = tx_buf.data();
+  size_t size = tx_buf.size();
+
+  if (size != 0)
+    this->stats->add(CABLE_STATS_FLUSHES);
+
+  while (size > 0)
+  {
+    int ret = ::send(m_socket, (void *)ptr, size, 0);
+    if (ret < 0)
+    {
+      if (errno == EINTR) continue;
+      tx_buf.clear();
+      return false;
+    }
+    ptr += ret;
+    size -= ret;
+  }
+
+  tx_buf.clear();
+  return true;
+}
+
+void Jtag_proxy::queue_req(proxy_req_t *req)
+{
+  tx_buf.insert(tx_buf.end(), (uint8_t *)req, (uint8_t *)req + sizeof(*req));
+}
+
+void Jtag_proxy::pending_append(const uint8_t *tdi, unsigned int n_bits, bool last)
+{
+  unsigned int new_bits = pending_bits + n_bits;
+
+  pending_tdi.resize((new_bits + 7) / 8, 0);
+  pending_tms.resize((new_bits + 7) / 8, 0);
+
+  if (tdi)
+  {
+    if ((pending_bits % 8) == 0)
+    {
+      ::memcpy(&pending_tdi[pending_bits / 8], tdi, (n_bits + 7) / 8);
+      // Bits after the stream must stay at 0 as the next one is ORed
+      if (n_bits % 8)
+        pending_tdi[(new_bits - 1) / 8] &= (1 << (n_bits % 8)) - 1;
+    }
+    else
+    {
+      for (unsigned int i=0; i<n_bits; i++)
+      {
+        unsigned int pos = pending_bits + i;
+        pending_tdi[pos / 8] |= ((tdi[i / 8] >> (i % 8)) & 1) << (pos % 8);
+      }
+    }
+  }
+
+  if (last)
+  {
+    pending_tms[(new_bits - 1) / 8] |= 1 << ((new_bits - 1) % 8);
+    pending_tms_count++;
+  }
+
+  pending_bits = new_bits;
+}
+
+void Jtag_proxy::queue_pending(int trstn)
+{
+  if (pending_bits == 0) return;
+
+  proxy_req_t req = { .type=DEBUG_BRIDGE_JTAG_PACKED_REQ };
+  req.jtag_packed.bits = pending_bits;
+  req.jtag_packed.flags = 0;
+  req.jtag_packed.trstn = trstn;
+
+  // Most streams only set TMS on the last cycle to leave the shift state,
+  // in this case the TMS bits are not sent
+  bool tms_last = (pending_tms[(pending_bits - 1) / 8] >> ((pending_bits - 1) % 8)) & 1;
+  if (pending_tms_count > 1 || (pending_tms_count == 1 && !tms_last))
+    req.jtag_packed.flags |= DEBUG_BRIDGE_JTAG_PACKED_TMS;
+  else if (tms_last)
+    req.jtag_packed.flags |= DEBUG_BRIDGE_JTAG_PACKED_TMS_LAST;
+
+  queue_req(&req);
+
+  for (unsigned int bit=0; bit<pending_bits; bit+=DEBUG_BRIDGE_JTAG_PACKED_CHUNK)
+  {
+    unsigned int start = bit / 8;
+    unsigned int end = (std::min(bit + DEBUG_BRIDGE_JTAG_PACKED_CHUNK, pending_bits) + 7) / 8;
+    tx_buf.insert(tx_buf.end(), pending_tdi.begin() + start, pending_tdi.begin() + end);
+    if (req.jtag_packed.flags & DEBUG_BRIDGE_JTAG_PACKED_TMS)
+      tx_buf.insert(tx_buf.end(), pending_tms.begin() + start, pending_tms.begin() + end);
+  }
+
+  pending_tdi.clear();
+  pending_tms.clear();
+  pending_bits = 0;
+  pending_tms_count = 0;
+}
+
+bool Jtag_proxy::proxy_stream_packed(char* instream, char* outstream, unsigned int n_bits, bool last)
+{
+  if (n_bits == 0) return true;
+
+  if (instream == NULL)
+  {
+    // Nothing to read back, just accumulate the cycles, they will be sent
+    // with the next request which needs an answer or with the next flush
+    pending_append((uint8_t *)outstream, n_bits, last);
+
+    if (pending_bits >= DEBUG_BRIDGE_JTAG_PACKED_CHUNK)
+      queue_pending(1);
+
+    if (tx_buf.size() >= JTAG_PROXY_TX_THRESHOLD)
+      return send_queued();
+
+    return true;
+  }
+
+  // The cycles before are sent as a separate request so that only the TDO
+  // bits of this stream are sent back, everything goes out in one send
+  queue_pending(1);
+  pending_append((uint8_t *)outstream, n_bits, last);
+
+  int tx_size = tx_buf.size();
+  queue_pending(1);
+  ((proxy_req_t *)&tx_buf[tx_size])->jtag_packed.flags |= DEBUG_BRIDGE_JTAG_PACKED_TDO;
+
+  if (!send_queued()) return false;
+
+  return recv_all((void *)instream, (n_bits + 7) / 8);
+}
+
 bool Jtag_proxy::bit_inout(char* inbit, char outbit, bool last)
 {
   return stream_inout(inbit, &outbit, 1, last);
@@ -126,7 +321,7 @@ bool Jtag_proxy::proxy_stream(char* instream, char* outstream, unsigned int n_bi
   {
 
     ::memset((void *)instream, 0, (n_bits + 7) / 8);
-    if (::recv(m_socket, (void *)instream, (n_bits + 7) / 8, 0) != (n_bits + 7) / 8) return false;
+    if (!recv_all((void *)instream, (n_bits + 7) / 8)) return false;
 
   }
   return true;
@@ -134,18 +329,34 @@ bool Jtag_proxy::proxy_stream(char* instream, char* outstream, unsigned int n_bi
 
 bool Jtag_proxy::stream_inout(char* instream, char* outstream, unsigned int n_bits, bool last)
 {
+  this->stats->add(CABLE_STATS_SCANS);
+  this->stats->add(CABLE_STATS_SCAN_BITS, n_bits);
+
+  if (version >= 2)
+    return proxy_stream_packed(instream, outstream, n_bits, last);
+
   return proxy_stream(instream, outstream, n_bits, last, DEBUG_BRIDGE_JTAG_TDI);
 }
 
 bool Jtag_proxy::jtag_reset(bool active)
 {
   int value = !active;
+
+  if (version >= 2)
+  {
+    queue_pending(1);
+    pending_append(NULL, 1, false);
+    queue_pending(value);
+    return send_queued();
+  }
+
   return proxy_stream(NULL, (char *)&value, 1, 0, DEBUG_BRIDGE_JTAG_TRST);
 }
 
 int Jtag_proxy::flush()
 {
-  return true;
+  queue_pending(1);
+  return send_queued() ? 0 : -1;
 }
 
 bool Jtag_proxy::chip_reset(bool active, int duration)
@@ -153,15 +364,18 @@ bool Jtag_proxy::chip_reset(bool active, int duration)
   proxy_req_t req = { .type=DEBUG_BRIDGE_RESET_REQ };
   req.reset.active = active;
   req.reset.duration = duration;
-  ::send(m_socket, (void *)&req, sizeof(req), 0);
 
-  return true;
+  queue_pending(1);
+  queue_req(&req);
+  return send_queued();
 }
 
 bool Jtag_proxy::chip_config(uint32_t config)
 {
   proxy_req_t req = { .type=DEBUG_BRIDGE_CONFIG_REQ };
   req.config.value = config;
-  ::send(m_socket, (void *)&req, sizeof(req), 0);
-  return true;
+
+  queue_pending(1);
+  queue_req(&req);
+  return send_queued();
 }
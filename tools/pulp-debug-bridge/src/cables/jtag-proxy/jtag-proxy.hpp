@@ -21,8 +21,10 @@
 
 #include "cables/adv_dbg_itf/adv_dbg_itf.hpp"
 #include "cable.hpp"
+#include "debug_bridge/proxy.hpp"
 
 #include <stdint.h>
+#include <vector>
 
 class Jtag_proxy : public Cable {
   public:
@@ -46,8 +48,27 @@ class Jtag_proxy : public Cable {
 
   private:
 
+    Log *log;
     int m_socket;
+    int version;
 
+    // Requests which are not yet sent to the proxy
+    std::vector<uint8_t> tx_buf;
+
+    // Write-only cycles which are not yet put into a request, so that the
+    // small TMS moves can be merged with the streams around them
+    std::vector<uint8_t> pending_tdi;
+    std::vector<uint8_t> pending_tms;
+    unsigned int pending_bits;
+    unsigned int pending_tms_count;
+
+    bool negotiate();
     bool proxy_stream(char* instream, char* outstream, unsigned int n_bits, bool last, int bit);
+    bool proxy_stream_packed(char* instream, char* outstream, unsigned int n_bits, bool last);
+    void pending_append(const uint8_t *tdi, unsigned int n_bits, bool last);
+    void queue_pending(int trstn);
+    void queue_req(proxy_req_t *req);
+    bool send_queued();
+    bool recv_all(void *buffer, int size);
 
 };
\ No newline at end of file
@@ -115,6 +115,8 @@ bool Cable_jtag_itf::jtag_set_reg(unsigned int reg, int width, unsigned int valu
   if (!jtag_shift_dr()) return false;
   if (!jtag_shift(width, (char *)&value)) return false;
   if (!jtag_idle()) return false;
+  // Cables may buffer output bits, make sure the register is really updated
+  if (sync() < 0) return false;
   return true;
 }
 
@@ -124,5 +126,6 @@ bool Cable_jtag_itf::jtag_get_reg(unsigned int reg, int width, unsigned int *out
   if (!jtag_shift_dr()) return false;
   if (!stream_inout((char *)out_value, (char *)&value, width, 1)) return false;
   if (!jtag_idle()) return false;
+  flush();
   return true;
 }
@@ -0,0 +1,471 @@
+/*
+ * Copyright (C) 2018 ETH Zurich and University of Bologna
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* 
+ * Authors: Germain Haugou, ETH (germain.haugou@iis.ee.ethz.ch)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+#include <stddef.h>
+#include <algorithm>
+
+#include "loopback.hpp"
+#include "debug_bridge/debug_bridge.h"
+
+#define LOOPBACK_PAGE_BITS 12
+#define LOOPBACK_PAGE_SIZE (1 << LOOPBACK_PAGE_BITS)
+
+// Core debug unit registers, same layout as the one used by the GDB server
+#define LOOPBACK_DBG_SIZE      0x8000
+#define LOOPBACK_DBG_CTRL      0x0
+#define LOOPBACK_DBG_HIT       0x4
+#define LOOPBACK_DBG_IE        0x8
+#define LOOPBACK_DBG_CAUSE     0xC
+#define LOOPBACK_DBG_GPR       0x400
+#define LOOPBACK_DBG_NPC       0x2000
+#define LOOPBACK_DBG_PPC       0x2004
+#define LOOPBACK_DBG_CSR       0x4000
+#define LOOPBACK_DBG_CSR_HARTID 0xF14
+
+#define LOOPBACK_DBG_CTRL_HALT (1 << 16)
+#define LOOPBACK_DBG_CTRL_STEP (1 << 0)
+#define LOOPBACK_DBG_CAUSE_BP  0x3
+
+#define LOOPBACK_INSN_EBREAK   0x00100073
+#define LOOPBACK_INSN_C_EBREAK 0x9002
+
+// Number of instructions a running core goes through each time its state
+// is checked
+#define LOOPBACK_CORE_RUN_INSNS 1024
+
+
+Loopback::Loopback(js::config *system_config, js::config *config, Log* log) : Cable(system_config), log(log)
+{
+  pthread_mutexattr_t attr;
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(&mutex, &attr);
+
+  js::config *loopback_config = config != NULL ? config->get("loopback") : NULL;
+  js::config *conf;
+
+  conf = loopback_config != NULL ? loopback_config->get("latency_us") : NULL;
+  this->latency_us = conf != NULL ? conf->get_int() : 0;
+  log->debug("Using loopback access latency: %d us\n", this->latency_us);
+
+  conf = loopback_config != NULL ? loopback_config->get("byte_latency_ns") : NULL;
+  this->byte_latency_ns = conf != NULL ? conf->get_int() : 0;
+  log->debug("Using loopback byte latency: %d ns\n", this->byte_latency_ns);
+
+  // The debug structure is only created when asked, as the reqloop considers
+  // the runtime is there as soon as the pointer is set
+  js::config *ptr_conf = loopback_config != NULL ? loopback_config->get("debug_struct_ptr") : NULL;
+  conf = loopback_config != NULL ? loopback_config->get("debug_struct") : NULL;
+  if (ptr_conf != NULL && conf != NULL)
+  {
+    this->debug_struct_init(ptr_conf->get_int(), conf->get_int());
+  }
+
+  // Debug unit of the fabric controller, found the same way as the GDB
+  // server does
+  js::config *fc_config = system_config != NULL ? system_config->get("**/soc/fc") : NULL;
+  js::config *dbg_config = system_config != NULL ? system_config->get("**/fc_dbg_unit/base") : NULL;
+  if (fc_config != NULL && dbg_config != NULL)
+  {
+    uint32_t hartid = fc_config->get("cluster_id") != NULL ? fc_config->get_child_int("cluster_id") << 5 : 0;
+    conf = loopback_config != NULL ? loopback_config->get("entry") : NULL;
+    uint32_t entry = conf != NULL ? conf->get_int() : 0;
+
+    log->debug("Emulating core debug unit (base: 0x%x, hartid: 0x%x, entry: 0x%x)\n", (uint32_t)dbg_config->get_int(), hartid, entry);
+    this->cores.push_back(new Loopback_core(dbg_config->get_int(), hartid, entry));
+  }
+}
+
+
+
+Loopback::~Loopback()
+{
+  for (auto &page: this->pages)
+  {
+    delete[] page.second;
+  }
+
+  for (auto core: this->cores)
+  {
+    delete core;
+  }
+}
+
+
+
+void Loopback::debug_struct_init(uint32_t ptr_addr, uint32_t addr)
+{
+  hal_debug_struct_t debug_struct;
+
+  log->debug("Creating loopback debug structure (ptr: 0x%x, addr: 0x%x)\n", ptr_addr, addr);
+
+  memset((void *)&debug_struct, 0, sizeof(debug_struct));
+  debug_struct.protocol_version = PROTOCOL_VERSION_6;
+  debug_struct.target.connected = 1;
+  // Notifications are written to a word of the structure itself, which is
+  // never read back
+  debug_struct.notif_req_addr = addr + offsetof(hal_debug_struct_t, debug_step);
+
+  this->mem_access(true, addr, sizeof(debug_struct), (uint8_t *)&debug_struct);
+  this->mem_access(true, ptr_addr, 4, (uint8_t *)&addr);
+}
+
+
+
+uint8_t *Loopback::get_page(uint32_t addr)
+{
+  uint32_t index = addr >> LOOPBACK_PAGE_BITS;
+  auto it = this->pages.find(index);
+
+  if (it != this->pages.end())
+    return it->second;
+
+  uint8_t *page = new uint8_t[LOOPBACK_PAGE_SIZE];
+  memset(page, 0, LOOPBACK_PAGE_SIZE);
+  this->pages[index] = page;
+  return page;
+}
+
+
+
+void Loopback::mem_access(bool write, uint32_t addr, int size, uint8_t *buffer)
+{
+  while (size > 0)
+  {
+    uint32_t offset = addr & (LOOPBACK_PAGE_SIZE - 1);
+    int iter_size = LOOPBACK_PAGE_SIZE - offset;
+    if (iter_size > size) iter_size = size;
+
+    uint8_t *page = this->get_page(addr);
+
+    if (write)
+      memcpy(&page[offset], buffer, iter_size);
+    else
+      memcpy(buffer, &page[offset], iter_size);
+
+    addr += iter_size;
+    buffer += iter_size;
+    size -= iter_size;
+  }
+}
+
+
+
+uint16_t Loopback::mem_fetch16(uint32_t addr)
+{
+  // Fetching must not allocate pages, as running cores go through the memory
+  auto it = this->pages.find(addr >> LOOPBACK_PAGE_BITS);
+  if (it == this->pages.end())
+    return 0;
+
+  uint16_t value;
+  memcpy(&value, &it->second[addr & (LOOPBACK_PAGE_SIZE - 1)], 2);
+  return value;
+}
+
+
+
+Loopback_core *Loopback::get_core(uint32_t addr)
+{
+  for (auto core: this->cores)
+  {
+    if (addr >= core->base && addr - core->base < LOOPBACK_DBG_SIZE)
+      return core;
+  }
+  return NULL;
+}
+
+
+
+uint32_t *Loopback::core_reg(Loopback_core *core, uint32_t offset)
+{
+  switch (offset)
+  {
+    case LOOPBACK_DBG_CTRL:  return &core->ctrl;
+    case LOOPBACK_DBG_HIT:   return &core->hit;
+    case LOOPBACK_DBG_IE:    return &core->ie;
+    case LOOPBACK_DBG_CAUSE: return &core->cause;
+    case LOOPBACK_DBG_NPC:   return &core->npc;
+    case LOOPBACK_DBG_PPC:   return &core->ppc;
+    case LOOPBACK_DBG_CSR + LOOPBACK_DBG_CSR_HARTID * 4: return &core->hartid;
+  }
+
+  if (offset >= LOOPBACK_DBG_GPR && offset < LOOPBACK_DBG_GPR + 32 * 4)
+    return &core->gpr[(offset - LOOPBACK_DBG_GPR) / 4];
+
+  return NULL;
+}
+
+
+
+// Goes over the instruction at NPC and returns false if it is a breakpoint,
+// in which case the core is halted on it
+bool Loopback::core_exec(Loopback_core *core)
+{
+  uint32_t pc = core->npc;
+  uint32_t insn = this->mem_fetch16(pc);
+  int size = 2;
+
+  if ((insn & 0x3) == 0x3)
+  {
+    insn |= this->mem_fetch16(pc + 2) << 16;
+    size = 4;
+  }
+
+  core->ppc = pc;
+
+  if (insn == LOOPBACK_INSN_EBREAK || insn == LOOPBACK_INSN_C_EBREAK)
+  {
+    core->cause = LOOPBACK_DBG_CAUSE_BP;
+    core->ctrl |= LOOPBACK_DBG_CTRL_HALT;
+    return false;
+  }
+
+  core->npc = pc + size;
+  return true;
+}
+
+
+
+void Loopback::core_run(Loopback_core *core)
+{
+  if (core->ctrl & LOOPBACK_DBG_CTRL_HALT)
+    return;
+
+  // Memory which was never written behaves as an infinite loop
+  for (int i=0; i<LOOPBACK_CORE_RUN_INSNS; i++)
+  {
+    if (this->pages.find(core->npc >> LOOPBACK_PAGE_BITS) == this->pages.end())
+      return;
+
+    if (!this->core_exec(core))
+      return;
+  }
+}
+
+
+
+void Loopback::core_write(Loopback_core *core, uint32_t offset, uint32_t value)
+{
+  if (offset == LOOPBACK_DBG_CTRL)
+  {
+    bool was_halted = core->ctrl & LOOPBACK_DBG_CTRL_HALT;
+    core->ctrl = value;
+
+    if (value & LOOPBACK_DBG_CTRL_HALT)
+    {
+      // Halt request, the core does not report any hit or exception
+      if (!was_halted)
+        core->cause = 0;
+    }
+    else if (value & LOOPBACK_DBG_CTRL_STEP)
+    {
+      // Single-step, the core stops right after the instruction
+      core->cause = 0;
+      if (this->core_exec(core))
+        core->hit = 1;
+      core->ctrl |= LOOPBACK_DBG_CTRL_HALT;
+    }
+    return;
+  }
+
+  uint32_t *reg = this->core_reg(core, offset);
+  if (reg != NULL && reg != &core->hartid)
+    *reg = value;
+}
+
+
+
+void Loopback::core_access(Loopback_core *core, bool write, uint32_t addr, int size, uint8_t *buffer)
+{
+  // Registers are accessed as 32 bits words, partial accesses only update
+  // or return the corresponding bytes
+  while (size > 0)
+  {
+    uint32_t offset = (addr - core->base) & ~3;
+    int byte = addr & 3;
+    int iter_size = std::min(size, 4 - byte);
+
+    if (offset == LOOPBACK_DBG_CTRL)
+      this->core_run(core);
+
+    uint32_t *reg = this->core_reg(core, offset);
+    uint32_t value = reg != NULL ? *reg : 0;
+
+    if (write)
+    {
+      memcpy((uint8_t *)&value + byte, buffer, iter_size);
+      this->core_write(core, offset, value);
+    }
+    else
+    {
+      memcpy(buffer, (uint8_t *)&value + byte, iter_size);
+    }
+
+    addr += iter_size;
+    buffer += iter_size;
+    size -= iter_size;
+  }
+}
+
+
+
+void Loopback::wait(int64_t bytes)
+{
+  int64_t duration_ns = (int64_t)this->latency_us * 1000 + bytes * this->byte_latency_ns;
+
+  if (duration_ns > 0)
+    std::this_thread::sleep_for(std::chrono::nanoseconds(duration_ns));
+}
+
+
+
+bool Loopback::connect(js::config *config)
+{
+  return true;
+}
+
+
+
+bool Loopback::access(bool write, unsigned int addr, int size, char* buffer, int device)
+{
+  Cable_io_req req(write, addr, size, buffer);
+  std::vector<Cable_io_req> reqs(1, req);
+  return this->access_batch(reqs, device);
+}
+
+
+
+bool Loopback::access_batch(std::vector<Cable_io_req> &reqs, int device)
+{
+  int64_t bytes = 0;
+
+  pthread_mutex_lock(&mutex);
+
+  auto start = std::chrono::steady_clock::now();
+
+  for (auto &req: reqs)
+  {
+    Loopback_core *core = this->get_core(req.addr);
+    if (core != NULL)
+      this->core_access(core, req.write, req.addr, req.size, (uint8_t *)req.buffer);
+    else
+      this->mem_access(req.write, req.addr, req.size, (uint8_t *)req.buffer);
+    this->stats->add_access(req.write, req.size);
+    bytes += req.size;
+  }
+
+  // The latency is paid once per batch like on a real cable
+  this->wait(bytes);
+
+  this->stats->add_latency(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+
+  pthread_mutex_unlock(&mutex);
+
+  return true;
+}
+
+
+
+bool Loopback::reg_access(bool write, unsigned int addr, char* buffer, int device)
+{
+  pthread_mutex_lock(&mutex);
+
+  if (write)
+    memcpy(&this->regs[addr], buffer, 4);
+  else
+    memcpy(buffer, &this->regs[addr], 4);
+
+  pthread_mutex_unlock(&mutex);
+
+  return true;
+}
+
+
+
+bool Loopback::bit_inout(char* inbit, char outbit, bool last)
+{
+  return stream_inout(inbit, &outbit, 1, last);
+}
+
+
+
+bool Loopback::stream_inout(char* instream, char* outstream, unsigned int n_bits, bool last)
+{
+  this->stats->add(CABLE_STATS_SCANS);
+  this->stats->add(CABLE_STATS_SCAN_BITS, n_bits);
+
+  if (instream != NULL)
+  {
+    if (outstream != NULL)
+      memcpy(instream, outstream, (n_bits + 7) / 8);
+    else
+      memset(instream, 0, (n_bits + 7) / 8);
+  }
+
+  return true;
+}
+
+
+
+bool Loopback::jtag_reset(bool active)
+{
+  return true;
+}
+
+
+
+int Loopback::flush()
+{
+  return 0;
+}
+
+
+
+bool Loopback::chip_reset(bool active, int duration)
+{
+  return true;
+}
+
+
+
+bool Loopback::chip_config(uint32_t config)
+{
+  return true;
+}
+
+
+
+void Loopback::lock()
+{
+  pthread_mutex_lock(&mutex);
+}
+
+
+
+void Loopback::unlock()
+{
+  pthread_mutex_unlock(&mutex);
+}
@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2018 ETH Zurich and University of Bologna
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* 
+ * Authors: Germain Haugou, ETH (germain.haugou@iis.ee.ethz.ch)
+ */
+
+#ifndef __CABLES_LOOPBACK_LOOPBACK_HPP__
+#define __CABLES_LOOPBACK_LOOPBACK_HPP__
+
+#include <map>
+#include <vector>
+#include <pthread.h>
+#include <stdint.h>
+
+#include "cables/log.h"
+#include "cable.hpp"
+
+// Model of a core debug unit, with just enough behavior for the GDB server
+// to halt, step and resume the core. A running core goes through the
+// instructions in memory without executing them, until it finds a
+// breakpoint.
+class Loopback_core
+{
+public:
+  Loopback_core(uint32_t base, uint32_t hartid, uint32_t npc) : base(base), hartid(hartid), npc(npc) {}
+
+  uint32_t base;
+  uint32_t hartid;
+  uint32_t ctrl = 0;
+  uint32_t hit = 0;
+  uint32_t ie = 0;
+  uint32_t cause = 0;
+  uint32_t npc;
+  uint32_t ppc = 0;
+  uint32_t gpr[32] = { 0 };
+};
+
+// Cable simulating the target in host memory, so that the bridge can be
+// exercised and measured without any board or RTL platform. Memory accesses
+// are served from a sparse memory, JTAG scans just loop TDI back to TDO.
+// The debug unit of the fabric controller described by the system
+// configuration is emulated, so that the GDB server can also be used.
+class Loopback : public Cable {
+  public:
+
+    Loopback(js::config *system_config, js::config *config, Log* log);
+    ~Loopback();
+
+    bool connect(js::config *config);
+    void lock();
+    void unlock();
+
+    bool access(bool write, unsigned int addr, int size, char* buffer, int device=-1);
+    bool access_batch(std::vector<Cable_io_req> &reqs, int device=-1);
+    bool reg_access(bool write, unsigned int addr, char* buffer, int device=-1);
+
+    bool bit_inout(char* inbit, char outbit, bool last);
+    bool stream_inout(char* instream, char* outstream, unsigned int n_bits, bool last);
+    bool jtag_reset(bool active);
+    int flush();
+
+    bool chip_reset(bool active, int duration);
+    bool chip_config(uint32_t config);
+
+  private:
+
+    Log *log;
+    pthread_mutex_t mutex;
+
+    // Latency added to each access or batch of accesses, to model the cable
+    int latency_us;
+    // Latency added for each byte transferred
+    int byte_latency_ns;
+
+    std::map<uint32_t, uint8_t *> pages;
+    std::map<uint32_t, uint32_t> regs;
+    std::vector<Loopback_core *> cores;
+
+    uint8_t *get_page(uint32_t addr);
+    void mem_access(bool write, uint32_t addr, int size, uint8_t *buffer);
+    uint16_t mem_fetch16(uint32_t addr);
+    Loopback_core *get_core(uint32_t addr);
+    void core_access(Loopback_core *core, bool write, uint32_t addr, int size, uint8_t *buffer);
+    uint32_t *core_reg(Loopback_core *core, uint32_t offset);
+    void core_write(Loopback_core *core, uint32_t offset, uint32_t value);
+    bool core_exec(Loopback_core *core);
+    void core_run(Loopback_core *core);
+    void debug_struct_init(uint32_t ptr_addr, uint32_t addr);
+    void wait(int64_t bytes);
+};
+
+#endif
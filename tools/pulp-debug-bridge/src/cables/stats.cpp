@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2018 ETH Zurich and University of Bologna
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* 
+ * Authors: Germain Haugou, ETH (germain.haugou@iis.ee.ethz.ch)
+ */
+
+#include <string.h>
+#include "cable.hpp"
+
+
+thread_local int Cable_stats::current_ctx = CABLE_STATS_CTX_HOST;
+
+static const char *stats_ctx_names[CABLE_STATS_NB_CTX] = {
+  "host", "reqloop", "gdb"
+};
+
+static const char *stats_counter_names[CABLE_STATS_NB_COUNTERS] = {
+  "accesses", "read_bytes", "write_bytes", "bursts", "retries", "errors",
+  "error_checks", "scans", "scan_bits", "flushes", "access_us"
+};
+
+
+Cable_stats::Cable_stats()
+{
+  for (int ctx=0; ctx<CABLE_STATS_NB_CTX; ctx++)
+  {
+    this->writes[ctx] = 0;
+  }
+
+  this->reset();
+}
+
+const char *Cable_stats::get_context_name(int ctx)
+{
+  if (ctx < 0 || ctx >= CABLE_STATS_NB_CTX) return NULL;
+  return stats_ctx_names[ctx];
+}
+
+const char *Cable_stats::get_counter_name(int counter)
+{
+  if (counter < 0 || counter >= CABLE_STATS_NB_COUNTERS) return NULL;
+  return stats_counter_names[counter];
+}
+
+void Cable_stats::reset()
+{
+  memset(this->counters, 0, sizeof(this->counters));
+  memset(this->latency, 0, sizeof(this->latency));
+}
+
+void Cable_stats::add_access(bool write, int size)
+{
+  if (write)
+    this->writes[current_ctx]++;
+
+  this->add(CABLE_STATS_ACCESSES);
+  this->add(write ? CABLE_STATS_WRITE_BYTES : CABLE_STATS_READ_BYTES, size);
+}
+
+void Cable_stats::add_latency(int64_t us)
+{
+  int bucket = 0;
+  while (bucket < CABLE_STATS_LATENCY_BUCKETS - 1 && (1LL << bucket) <= us)
+    bucket++;
+
+  this->latency[current_ctx][bucket]++;
+  this->add(CABLE_STATS_ACCESS_US, us);
+}
+
+void Cable_stats::dump(FILE *file)
+{
+  for (int ctx=0; ctx<CABLE_STATS_NB_CTX; ctx++)
+  {
+    uint64_t *counters = this->counters[ctx];
+
+    if (counters[CABLE_STATS_ACCESSES] == 0 && counters[CABLE_STATS_SCANS] == 0)
+      continue;
+
+    fprintf(file, "Cable statistics (%s):\n", stats_ctx_names[ctx]);
+
+    for (int i=0; i<CABLE_STATS_NB_COUNTERS; i++)
+    {
+      fprintf(file, "  %-14s %llu\n", stats_counter_names[i], (unsigned long long)counters[i]);
+    }
+
+    if (counters[CABLE_STATS_ACCESSES] != 0)
+    {
+      fprintf(file, "  %-14s %llu\n", "bytes/access",
+        (unsigned long long)((counters[CABLE_STATS_READ_BYTES] + counters[CABLE_STATS_WRITE_BYTES]) / counters[CABLE_STATS_ACCESSES]));
+
+      fprintf(file, "  access latency:\n");
+      for (int i=0; i<CABLE_STATS_LATENCY_BUCKETS; i++)
+      {
+        if (this->latency[ctx][i] == 0) continue;
+        if (i == CABLE_STATS_LATENCY_BUCKETS - 1)
+          fprintf(file, "    >= %7lld us %llu\n", 1LL << (i - 1), (unsigned long long)this->latency[ctx][i]);
+        else
+          fprintf(file, "    < %8lld us %llu\n", 1LL << i, (unsigned long long)this->latency[ctx][i]);
+      }
+    }
+  }
+}
@@ -39,17 +39,17 @@ Breakpoints::insert(unsigned int addr) {
   struct bp_insn bp;
 
   bp.addr = addr;
-  retval = top->cable->access(false, addr, 4, (char*)&bp.insn_orig);
+  retval = top->target->mem_read(addr, 4, (char*)&bp.insn_orig);
   bp.is_compressed = INSN_IS_COMPRESSED(bp.insn_orig);
 
   breakpoints.push_back(bp);
 
   if (bp.is_compressed) {
     data_bp = INSN_BP_COMPRESSED;
-    retval = retval && top->cable->access(true, addr, 2, (char*)&data_bp);
+    retval = retval && top->target->mem_write(addr, 2, (char*)&data_bp);
   } else {
     data_bp = INSN_BP;
-    retval = retval && top->cable->access(true, addr, 4, (char*)&data_bp);
+    retval = retval && top->target->mem_write(addr, 4, (char*)&data_bp);
   }
 
   this->top->target->flush();
@@ -71,9 +71,9 @@ Breakpoints::remove(unsigned int addr) {
       breakpoints.erase(it);
 
       if (is_compressed)
-        retval = top->cable->access(true, addr, 2, (char*)&data);
+        retval = top->target->mem_write(addr, 2, (char*)&data);
       else
-        retval = top->cable->access(true, addr, 4, (char*)&data);
+        retval = top->target->mem_write(addr, 4, (char*)&data);
 
       this->top->target->flush();
 
@@ -116,10 +116,10 @@ Breakpoints::enable(unsigned int addr) {
     if (it->addr == addr) {
       if (it->is_compressed) {
         data = INSN_BP_COMPRESSED;
-        retval = top->cable->access(1, addr, 2, (char*)&data);
+        retval = top->target->mem_write(addr, 2, (char*)&data);
       } else {
         data = INSN_BP;
-        retval = top->cable->access(1, addr, 4, (char*)&data);
+        retval = top->target->mem_write(addr, 4, (char*)&data);
       }
 
       return true;
@@ -139,9 +139,9 @@ Breakpoints::disable(unsigned int addr) {
   for (std::list<struct bp_insn>::iterator it = breakpoints.begin(); it != breakpoints.end(); it++) {
     if (it->addr == addr) {
       if (it->is_compressed)
-        retval = top->cable->access(1, addr, 2, (char*)&it->insn_orig);
+        retval = top->target->mem_write(addr, 2, (char*)&it->insn_orig);
       else
-        retval = top->cable->access(1, addr, 4, (char*)&it->insn_orig);
+        retval = top->target->mem_write(addr, 4, (char*)&it->insn_orig);
 
       return true;
       //return retval && m_cache->flush();
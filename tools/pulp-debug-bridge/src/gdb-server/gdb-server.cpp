@@ -42,6 +42,7 @@ int Gdb_server::stop(bool kill)
     rsp->close(kill);
     rsp = NULL;
   }
+  return 0;
 }
 
 void Gdb_server::print(const char *format, ...)
@@ -53,6 +53,7 @@ class Target;
 class Target_cluster_common;
 class Target_cluster;
 class Target_core;
+class Target_mem_cache;
 
 static int first_free_thread_id = 0;
 
@@ -84,25 +85,31 @@ public:
   bool write(uint32_t addr, uint32_t wdata);
   bool csr_read(unsigned int i, uint32_t *data);
   int get_thread_id() { return thread_id; }
+  uint32_t get_dbg_unit_addr() { return dbg_unit_addr; }
   void get_name(char* str, size_t len) {
     snprintf(str, len, "Cluster %02d - Core %01d", this->cluster_id, this->core_id);
   }
   bool is_stopped();
+  bool is_running() { return this->is_on && !this->stopped; }
+  void set_stopped(bool stopped);
   void read_ppc(uint32_t *ppc);
 
   bool stop();
   bool halt();
+  bool get_halt_req(std::vector<Cable_io_req> &reqs);
   void prepare_resume(bool step=false);
-  void commit_resume();
+  void commit_resume(std::vector<Cable_io_req> &reqs);
   void set_step_mode(bool new_step);
-  void commit_step_mode();
   void resume();
+  void resume(std::vector<Cable_io_req> &reqs);
   void flush();
 
   bool gpr_read_all(uint32_t *data);
   bool gpr_read(unsigned int i, uint32_t *data);
   bool gpr_write(unsigned int i, uint32_t data);
 
+  void invalidate_cache();
+
 private:
   Gdb_server *top;
   bool is_on = false;
@@ -111,11 +118,16 @@ private:
   int cluster_id;
   int core_id;
   int thread_id;
-  bool ppc_is_cached = false;
-  uint32_t ppc_cached;
+  // Registers read while the core is stopped, dropped as soon as it can execute again
+  bool gpr_is_cached = false;
+  uint32_t gpr_cached[32];
+  std::map<uint32_t, uint32_t> regs_cached;
   bool stopped = false;
   bool step = false;
   bool commit_step = false;
+  // Values written by batched requests, which must stay valid until the batch is executed
+  uint32_t ctrl_value;
+  uint32_t hit_value;
 };
 
 
@@ -130,21 +142,29 @@ public:
   void halt();
   void resume(bool step=false, int tid=-1);
   void resume_all();
+  bool check_stopped();
   bool wait(int socket_client);
   void flush();
 
   void update_power();
 
+  bool mem_read(uint32_t addr, int size, char *data);
+  bool mem_write(uint32_t addr, int size, char *data);
+  void invalidate_mem_cache();
+
   std::vector<Target_core *> get_threads() { return cores; }
   Target_core *get_thread(int thread_id) { return cores_from_threadid[thread_id]; }
   Target_core *get_thread_from_id(int id) { return cores[id]; }
 
 
 private:
+  bool is_all_stopped();
+
   Gdb_server *top;
   std::vector<Target_cluster_common *> clusters;
   std::vector<Target_core *> cores;
   std::map<int, Target_core *> cores_from_threadid;
+  Target_mem_cache *mem_cache;
 };
 
 
@@ -208,11 +228,14 @@ class Rsp {
 
     bool send(int socket_client, const char* data, size_t len);
     bool send_str(int socket_client, const char* data);
+    bool send_raw(int socket_client, const char* data, size_t len);
+    bool recv_char(int socket_client, char *c);
+    bool recv_pending() { return rx_pos < rx_len; }
 
     bool cont(int socket_client, char* data, size_t len); // continue, reserved keyword, thus not used as function name
     bool resume(int socket_client, bool step);
     bool resume(int socket_client, int tid, bool step);
-    bool wait(int socket_client, Target_core *core=NULL);
+    bool wait(int socket_client);
     bool step(int socket_client, char* data, size_t len);
 
     // internal helper functions
@@ -236,6 +259,15 @@ class Rsp {
     int thread_sel;
     Target_core *main_core = NULL;
 
+    // Per-connection packet buffers, reused from one packet to another
+    std::vector<char> rx_buf;
+    int rx_pos = 0;
+    int rx_len = 0;
+    std::vector<char> tx_buf;
+    std::vector<char> pkt_buf;
+    // Set once GDB has accepted QStartNoAckMode, packets are then no longer acknowledged
+    bool no_ack = false;
+
 
 
     bool wait_client();
@@ -55,7 +55,12 @@ enum target_signal {
   TARGET_SIGNAL_PWR  = 32
 };
 
-#define PACKET_MAX_LEN 4096
+// Maximum size of the packet payload we accept from GDB, advertised with
+// PacketSize so that memory transfers are done in big chunks
+#define PACKET_MAX_LEN (64*1024)
+#define PACKET_RX_BUF_SIZE 4096
+
+static const char hex_digits[] = "0123456789abcdef";
 
 
 Rsp::Rsp(Gdb_server *top, int socket_port) : top(top), socket_port(socket_port)
@@ -64,6 +69,9 @@ Rsp::Rsp(Gdb_server *top, int socket_port) : top(top), socket_port(socket_port)
 
   m_thread_init = main_core->get_thread_id();
   thread_sel = m_thread_init;
+
+  rx_buf.resize(PACKET_RX_BUF_SIZE);
+  pkt_buf.resize(PACKET_MAX_LEN + 1);
 }
 
 bool Rsp::v_packet(int socket_client, char* data, size_t len)
@@ -148,7 +156,16 @@ bool Rsp::query(int socket_client, char* data, size_t len)
 
   if (strncmp ("qSupported", data, strlen ("qSupported")) == 0)
   {
-    return this->send_str(socket_client,  "PacketSize=256");
+    snprintf(reply, 256, "PacketSize=%x;QStartNoAckMode+", PACKET_MAX_LEN);
+    return this->send_str(socket_client, reply);
+  }
+  else if (strncmp ("QStartNoAckMode", data, strlen ("QStartNoAckMode")) == 0)
+  {
+    // The reply is still acknowledged, acks are dropped only after it
+    if (!this->send_str(socket_client, "OK"))
+      return false;
+    this->no_ack = true;
+    return true;
   }
   else if (strncmp ("qTStatus", data, strlen ("qTStatus")) == 0)
   {
@@ -216,6 +233,12 @@ bool Rsp::query(int socket_client, char* data, size_t len)
     return this->send_str(socket_client,  "");
   }
 
+  else if (data[0] == 'Q')
+  {
+    // Unsupported set packet, an empty reply tells GDB to not use it
+    return this->send_str(socket_client,  "");
+  }
+
   top->log->print(LOG_ERROR, "Unknown query packet\n");
 
   return false;
@@ -261,26 +284,30 @@ bool Rsp::pc_read(int socket_client, unsigned int* pc)
 
 bool Rsp::mem_read(int socket_client, char* data, size_t len)
 {
-  unsigned char buffer[512];
-  char reply[512];
   uint32_t addr;
   uint32_t length;
-  uint32_t rdata;
-  int i;
 
   if (sscanf(data, "%x,%x", &addr, &length) != 2) {
     top->log->print(LOG_ERROR, "Could not parse packet\n");
     return false;
   }
 
-  top->cable->access(false, addr, length, (char *)buffer);
+  // GDB is supposed to respect PacketSize, a shorter reply is allowed anyway
+  if (length > PACKET_MAX_LEN / 2)
+    length = PACKET_MAX_LEN / 2;
+
+  std::vector<unsigned char> buffer(length);
+  std::vector<char> reply(length * 2);
 
-  for(i = 0; i < length; i++) {
-    rdata = buffer[i];
-    snprintf(&reply[i * 2], 3, "%02x", rdata);
+  if (!top->target->mem_read(addr, length, (char *)buffer.data()))
+    return this->send_str(socket_client, "E01");
+
+  for(uint32_t i = 0; i < length; i++) {
+    reply[i * 2] = hex_digits[buffer[i] >> 4];
+    reply[i * 2 + 1] = hex_digits[buffer[i] & 0xf];
   }
 
-  return this->send(socket_client, reply, length*2);
+  return this->send(socket_client, reply.data(), length*2);
 }
 
 
@@ -295,7 +322,7 @@ bool Rsp::mem_write_ascii(int socket_client, char* data, size_t len)
   char* buffer;
   int buffer_len;
 
-  if (sscanf(data, "%x,%d:", &addr, &length) != 2) {
+  if (sscanf(data, "%x,%x:", &addr, &length) != 2) {
     top->log->print(LOG_ERROR, "Could not parse packet\n");
     return false;
   }
@@ -332,13 +359,13 @@ bool Rsp::mem_write_ascii(int socket_client, char* data, size_t len)
       else if (c >= 'A' && c <= 'F')
         hex = c - 'A' + 10;
 
-      wdata |= hex << (4 * i);
+      wdata = (wdata << 4) | hex;
     }
 
     buffer[j] = wdata;
   }
 
-  top->cable->access(true, addr, buffer_len, buffer);
+  top->target->mem_write(addr, buffer_len, buffer);
 
   free(buffer);
 
@@ -369,11 +396,16 @@ bool Rsp::mem_write(int socket_client, char* data, size_t len)
   if (i == len)
     return false;
 
-  // align to hex data
+  // align to binary data, which has already been unescaped when the packet
+  // was received
   data = &data[i+1];
   len = len - i - 1;
 
-  top->cable->access(write, addr, len, data);
+  if (length > len)
+    length = len;
+
+  if (length > 0 && !top->target->mem_write(addr, length, data))
+    return this->send_str(socket_client, "E01");
 
   return this->send_str(socket_client,  "OK");
 }
@@ -581,52 +613,24 @@ bool Rsp::step(int socket_client, char* data, size_t len)
 
 
 
-bool Rsp::wait(int socket_client, Target_core *core)
+bool Rsp::wait(int socket_client)
 {
-  int ret;
   char pkt;
 
-  fd_set rfds;
-  struct timeval tv;
-
   while(1) {
 
-    // Check if a cluster power state has changed
-    this->top->target->update_power();
-
-    //First check if one core has stopped
-    if (core) {
-      if (core->is_stopped()) {
-        this->top->target->halt();
-        return this->signal(socket_client);
-      }
-    } else {
-      for (auto &core: this->top->target->get_threads()) {
-        if (core->is_stopped()) {
-          this->top->target->halt();
-          return this->signal(socket_client);
-        }
-      }
+    // Wait until one core stops or until GDB sends something, typically a
+    // stop request
+    if (!this->recv_pending() && this->top->target->wait(socket_client)) {
+      this->top->target->halt();
+      return this->signal(socket_client);
     }
 
-    // Otherwise wait for a stop request from gdb side for a while
-
-    FD_ZERO(&rfds);
-    FD_SET(socket_client, &rfds);
-
-    tv.tv_sec = 0;
-    tv.tv_usec = 100 * 1000;
+    if (!this->recv_char(socket_client, &pkt))
+      return false;
 
-    if (select(socket_client+1, &rfds, NULL, NULL, &tv)) {
-      ret = recv(socket_client, &pkt, 1, 0);
-      if (ret == 1 && pkt == 0x3) {
-        if (core) {
-          core->halt();
-          return this->signal(socket_client);
-        } else {
-          top->target->halt();
-        }
-      }
+    if (pkt == 0x3) {
+      top->target->halt();
     }
   }
 
@@ -671,6 +675,7 @@ bool Rsp::decode(int socket_client, char* data, size_t len)
 
   switch (data[0]) {
   case 'q':
+  case 'Q':
     return this->query(socket_client, &data[0], len);
 
   case 'g':
@@ -731,185 +736,191 @@ bool Rsp::decode(int socket_client, char* data, size_t len)
 
 
 
+bool Rsp::recv_char(int socket_client, char *c)
+{
+  // Refill the buffer with whatever is available on the socket, so that
+  // packets are not received one byte at a time
+  while (this->rx_pos == this->rx_len)
+  {
+    int ret = recv(socket_client, this->rx_buf.data(), this->rx_buf.size(), 0);
+
+    if((ret == -1 && errno != EWOULDBLOCK && errno != EINTR) || (ret == 0)) {
+      top->log->print(LOG_ERROR, "RSP: Error receiving\n");
+      return false;
+    }
+
+    if (ret == -1)
+      continue;
+
+    this->rx_pos = 0;
+    this->rx_len = ret;
+  }
+
+  *c = this->rx_buf[this->rx_pos++];
+  return true;
+}
+
 bool
 Rsp::get_packet(int socket_client, char* pkt, size_t* p_pkt_len) {
   char c;
   char check_chars[2];
-  char buffer[PACKET_MAX_LEN];
-  int  buffer_len = 0;
   int  pkt_len;
-  bool escaped = false;
-  int ret;
+  unsigned int checksum;
+  bool escaped;
   // packets follow the format: $packet-data#checksum
   // checksum is two-digit
 
-  // poison packet
-  memset(pkt, 0, PACKET_MAX_LEN);
-  pkt_len = 0;
-
-  // first look for start bit
-  do {
-    ret = recv(socket_client, &c, 1, 0);
-
-    if((ret == -1 && errno != EWOULDBLOCK) || (ret == 0)) {
-      top->log->print(LOG_ERROR, "RSP: Error receiving\n");
-      return false;
-    }
+  while(1) {
+    pkt_len = 0;
+    checksum = 0;
+    escaped = false;
 
-    if(ret == -1 && errno == EWOULDBLOCK) {
-      // no data available
-      continue;
-    }
+    // first look for start bit
+    do {
+      if (!this->recv_char(socket_client, &c))
+        return false;
 
-    // special case for 0x03 (asynchronous break)
-    if (c == 0x03) {
-      pkt[0]  = c;
-      *p_pkt_len = 1;
-      return true;
-    }
-  } while(c != '$');
+      // special case for 0x03 (asynchronous break)
+      if (c == 0x03) {
+        pkt[0]  = c;
+        *p_pkt_len = 1;
+        return true;
+      }
+    } while(c != '$');
 
-  buffer[0] = c;
+    // now store data as long as we don't see #
+    while(1) {
+      if (!this->recv_char(socket_client, &c))
+        return false;
 
-  // now store data as long as we don't see #
-  do {
-    if (buffer_len >= PACKET_MAX_LEN || pkt_len >= PACKET_MAX_LEN) {
-      top->log->print(LOG_ERROR, "RSP: Too many characters received\n");
-      return false;
-    }
+      if (c == '#')
+        break;
 
-    ret = recv(socket_client, &c, 1, 0);
+      if (pkt_len >= PACKET_MAX_LEN) {
+        top->log->print(LOG_ERROR, "RSP: Too many characters received\n");
+        return false;
+      }
 
-    if((ret == -1 && errno != EWOULDBLOCK) || (ret == 0)) {
-      top->log->print(LOG_ERROR, "RSP: Error receiving\n");
-      return false;
-    }
+      checksum += (unsigned char)c;
 
-    if(ret == -1 && errno == EWOULDBLOCK) {
-      // no data available
-      continue;
-    }
+      // check for 0x7d = '}'
+      if (c == 0x7d) {
+        escaped = true;
+        continue;
+      }
 
-    buffer[buffer_len++] = c;
+      if (escaped)
+        pkt[pkt_len++] = c ^ 0x20;
+      else
+        pkt[pkt_len++] = c;
 
-    // check for 0x7d = '}'
-    if (c == 0x7d) {
-      escaped = true;
-      continue;
+      escaped = false;
     }
 
-    if (escaped)
-      pkt[pkt_len++] = c ^ 0x20;
-    else
-      pkt[pkt_len++] = c;
-
-    escaped = false;
-  } while(c != '#');
-
-  buffer_len--;
-  pkt_len--;
+    // checksum, 2 bytes
+    if (!this->recv_char(socket_client, &check_chars[0]) || !this->recv_char(socket_client, &check_chars[1]))
+      return false;
 
-  // checksum, 2 bytes
-  ret = recv(socket_client, &check_chars[0], 1, 0);
-  if((ret == -1 && errno != EWOULDBLOCK) || (ret == 0)) {
-    top->log->print(LOG_ERROR, "RSP: Error receiving\n");
-    return false;
-  }
+    // NULL terminate the string
+    pkt[pkt_len] = '\0';
 
-  ret = recv(socket_client, &check_chars[1], 1, 0);
-  if((ret == -1 && errno != EWOULDBLOCK) || (ret == 0)) {
-    top->log->print(LOG_ERROR, "RSP: Error receiving\n");
-    return false;
-  }
+    // Checksums are meaningless once acknowledgements are disabled
+    if (this->no_ack)
+      break;
 
-  // check the checksum
-  unsigned int checksum = 0;
-  for(int i = 0; i < buffer_len; i++) {
-    checksum += buffer[i];
-  }
+    checksum = checksum % 256;
 
-  checksum = checksum % 256;
-  char checksum_str[3];
-  snprintf(checksum_str, 3, "%02x", checksum);
+    if (check_chars[0] == hex_digits[checksum >> 4] && check_chars[1] == hex_digits[checksum & 0xf])
+      break;
 
-  if (check_chars[0] != checksum_str[0] || check_chars[1] != checksum_str[1]) {
     top->log->print(LOG_ERROR, "RSP: Checksum failed; received %.*s; checksum should be %02x\n", pkt_len, pkt, checksum);
-    return false;
+
+    // Ask GDB to send the packet again
+    if (!this->send_raw(socket_client, "-", 1))
+      return false;
   }
 
   // now send ACK
-  char ack = '+';
-  if (::send(socket_client, &ack, 1, 0) != 1) {
+  if (!this->no_ack && !this->send_raw(socket_client, "+", 1)) {
     top->log->print(LOG_ERROR, "RSP: Sending ACK failed\n");
     return false;
   }
 
-  // NULL terminate the string
-  pkt[pkt_len] = '\0';
   *p_pkt_len = pkt_len;
 
   return true;
 }
 
+bool Rsp::send_raw(int socket_client, const char* data, size_t len)
+{
+  while (len > 0)
+  {
+    int ret = ::send(socket_client, data, len, 0);
+    if (ret == -1 && (errno == EINTR || errno == EWOULDBLOCK))
+      continue;
+
+    if (ret <= 0)
+    {
+      top->log->print(LOG_ERROR, "Unable to send data to client\n");
+      return false;
+    }
+
+    data += ret;
+    len -= ret;
+  }
+
+  return true;
+}
+
 bool Rsp::send(int socket_client, const char* data, size_t len)
 {
-  int ret;
-  int i;
   size_t raw_len = 0;
-  char* raw = (char*)malloc(len * 2 + 4);
   unsigned int checksum = 0;
 
+  if (this->tx_buf.size() < len * 2 + 4)
+    this->tx_buf.resize(len * 2 + 4);
+
+  char *raw = this->tx_buf.data();
+
   raw[raw_len++] = '$';
 
-  for (i = 0; i < len; i++) {
+  for (size_t i = 0; i < len; i++) {
     char c = data[i];
 
     // check if escaping needed
-    if (c == '#' || c == '%' || c == '}' || c == '*') {
+    if (c == '#' || c == '$' || c == '}' || c == '*') {
       raw[raw_len++] = '}';
-      raw[raw_len++] = c;
+      raw[raw_len++] = c ^ 0x20;
       checksum += '}';
-      checksum += c;
+      checksum += (unsigned char)(c ^ 0x20);
     } else {
       raw[raw_len++] = c;
-      checksum += c;
+      checksum += (unsigned char)c;
     }
   }
 
   // add checksum
   checksum = checksum % 256;
-  char checksum_str[3];
-  snprintf(checksum_str, 3, "%02x", checksum);
 
   raw[raw_len++] = '#';
-  raw[raw_len++] = checksum_str[0];
-  raw[raw_len++] = checksum_str[1];
+  raw[raw_len++] = hex_digits[checksum >> 4];
+  raw[raw_len++] = hex_digits[checksum & 0xf];
 
   char ack;
   do {
     top->log->print(LOG_DEBUG, "Sending %.*s\n", raw_len, raw);
 
-    if (::send(socket_client, raw, raw_len, 0) != raw_len) {
-      free(raw);
-      top->log->print(LOG_ERROR, "Unable to send data to client\n");
+    if (!this->send_raw(socket_client, raw, raw_len))
       return false;
-    }
 
-    ret = recv(socket_client, &ack, 1, 0);
-    if((ret == -1 && errno != EWOULDBLOCK) || (ret == 0)) {
-      free(raw);
-      top->log->print(LOG_ERROR, "RSP: Error receiving\n");
-      return false;
-    }
+    if (this->no_ack)
+      break;
 
-    if(ret == -1 && errno == EWOULDBLOCK) {
-      // no data available
-      continue;
-    }
+    if (!this->recv_char(socket_client, &ack))
+      return false;
 
   } while (ack != '+');
 
-  free(raw);
   return true;
 }
 
@@ -920,14 +931,17 @@ bool Rsp::send_str(int socket_client, const char* data)
 
 void Rsp::client_routine(int socket_client)
 {
+  Cable_stats::set_context(CABLE_STATS_CTX_GDB);
+
+  // A new connection always starts in acknowledgement mode
+  this->rx_pos = this->rx_len = 0;
+  this->no_ack = false;
+
   while(1)
   {
-    char pkt[PACKET_MAX_LEN];
+    char *pkt = this->pkt_buf.data();
     size_t len;
 
-    fd_set rfds;
-    struct timeval tv;
-
     while (this->get_packet(socket_client, pkt, &len)) {
       top->log->print(LOG_DEBUG, "Received $%.*s\n", len, pkt);
       if (!this->decode(socket_client, pkt, len)) {
@@ -939,6 +953,8 @@ void Rsp::client_routine(int socket_client)
 
 void Rsp::listener_routine()
 {
+  Cable_stats::set_context(CABLE_STATS_CTX_GDB);
+
   while(1)
   {
     int socket_client;
@@ -20,6 +20,21 @@
 
 #include "gdb-server/gdb-server.hpp"
 #include <unistd.h>
+#include <algorithm>
+
+#define TARGET_MEM_CACHE_LINE_SIZE 256
+#define TARGET_MEM_CACHE_NB_LINES  1024
+
+// Cluster controller registers, relative to the cross-trigger base.
+// Reading DBG_STATUS gives the mask of halted cores, writing it resumes
+// the cores of the mask.
+#define CLUSTER_CTRL_OFFSET          0x00200000
+#define CLUSTER_CTRL_DBG_STATUS      0x28
+#define CLUSTER_CTRL_DBG_HALT_MASK   0x38
+
+// Bounds of the interval at which the target is polled while GDB waits for a stop
+#define TARGET_WAIT_MIN_US 1000
+#define TARGET_WAIT_MAX_US 100000
 
 
 class Target_cache
@@ -54,6 +69,31 @@ private:
 
 
 
+// Cache of the target memory lines read by GDB while the target is stopped.
+// Only memories are cached, as reading peripherals can have side effects.
+// Writes done through the cable by the loader or the request loop drop the
+// whole cache, as they can modify the memory behind GDB.
+class Target_mem_cache
+{
+public:
+  Target_mem_cache(Gdb_server *top);
+  void add_region(uint32_t base, uint32_t size);
+  bool read(uint32_t addr, int size, char *data);
+  bool write(uint32_t addr, int size, char *data);
+  void invalidate();
+
+private:
+  bool is_cacheable(uint32_t addr, int size);
+  void check_other_writes();
+
+  Gdb_server *top;
+  uint64_t other_writes = 0;
+  std::vector<std::pair<uint32_t, uint32_t>> regions;
+  std::map<uint32_t, std::vector<char>> lines;
+};
+
+
+
 class Target_cluster_power
 {
 public:
@@ -80,7 +120,7 @@ private:
 class Target_cluster_ctrl
 {
 public:
-  virtual bool init() {}
+  virtual bool init() { return true; }
 };
 
 
@@ -128,6 +168,131 @@ void Target_fc_cache::flush()
 }
 
 
+Target_mem_cache::Target_mem_cache(Gdb_server *top)
+: top(top)
+{
+}
+
+void Target_mem_cache::add_region(uint32_t base, uint32_t size)
+{
+  this->top->log->debug("Adding cacheable memory region (base: 0x%x, size: 0x%x)\n", base, size);
+  this->regions.push_back(std::make_pair(base, size));
+}
+
+bool Target_mem_cache::is_cacheable(uint32_t addr, int size)
+{
+  // The whole lines containing the access must be inside the same memory
+  uint32_t start = addr & ~(TARGET_MEM_CACHE_LINE_SIZE - 1);
+  uint64_t end = ((uint64_t)addr + size + TARGET_MEM_CACHE_LINE_SIZE - 1) & ~(uint64_t)(TARGET_MEM_CACHE_LINE_SIZE - 1);
+
+  for (auto &region: this->regions)
+  {
+    if (start >= region.first && end <= (uint64_t)region.first + region.second)
+      return true;
+  }
+  return false;
+}
+
+void Target_mem_cache::check_other_writes()
+{
+  Cable_stats *stats = this->top->cable->get_stats();
+  uint64_t writes = 0;
+
+  for (int ctx=0; ctx<CABLE_STATS_NB_CTX; ctx++)
+  {
+    if (ctx != CABLE_STATS_CTX_GDB)
+      writes += stats->get_writes(ctx);
+  }
+
+  if (writes != this->other_writes)
+  {
+    this->invalidate();
+    this->other_writes = writes;
+  }
+}
+
+bool Target_mem_cache::read(uint32_t addr, int size, char *data)
+{
+  if (!this->is_cacheable(addr, size))
+    return this->top->cable->access(false, addr, size, data);
+
+  this->check_other_writes();
+
+  if (this->lines.size() >= TARGET_MEM_CACHE_NB_LINES)
+    this->invalidate();
+
+  // Fetch all the missing lines in one batch before copying from the cache
+  std::vector<Cable_io_req> reqs;
+  uint32_t first_line = addr & ~(TARGET_MEM_CACHE_LINE_SIZE - 1);
+  for (uint32_t line = first_line; line < addr + size; line += TARGET_MEM_CACHE_LINE_SIZE)
+  {
+    if (this->lines.find(line) == this->lines.end())
+    {
+      std::vector<char> &line_data = this->lines[line];
+      line_data.resize(TARGET_MEM_CACHE_LINE_SIZE);
+      reqs.push_back(Cable_io_req(false, line, TARGET_MEM_CACHE_LINE_SIZE, line_data.data()));
+    }
+  }
+
+  if (reqs.size() && !this->top->cable->access_batch(reqs))
+  {
+    for (auto &req: reqs)
+      this->lines.erase(req.addr);
+    return false;
+  }
+
+  while (size > 0)
+  {
+    uint32_t line = addr & ~(TARGET_MEM_CACHE_LINE_SIZE - 1);
+    int offset = addr - line;
+    int iter_size = std::min(size, TARGET_MEM_CACHE_LINE_SIZE - offset);
+
+    memcpy(data, &this->lines[line][offset], iter_size);
+
+    data += iter_size;
+    addr += iter_size;
+    size -= iter_size;
+  }
+
+  return true;
+}
+
+bool Target_mem_cache::write(uint32_t addr, int size, char *data)
+{
+  this->check_other_writes();
+
+  // Write-through, the cached lines are just updated
+  if (!this->top->cable->access(true, addr, size, data))
+  {
+    this->invalidate();
+    return false;
+  }
+
+  while (size > 0)
+  {
+    uint32_t line = addr & ~(TARGET_MEM_CACHE_LINE_SIZE - 1);
+    int offset = addr - line;
+    int iter_size = std::min(size, TARGET_MEM_CACHE_LINE_SIZE - offset);
+
+    auto it = this->lines.find(line);
+    if (it != this->lines.end())
+      memcpy(&it->second[offset], data, iter_size);
+
+    data += iter_size;
+    addr += iter_size;
+    size -= iter_size;
+  }
+
+  return true;
+}
+
+void Target_mem_cache::invalidate()
+{
+  this->lines.clear();
+}
+
+
+
 Target_cluster_ctrl_xtrigger::Target_cluster_ctrl_xtrigger(Gdb_server *top, uint32_t cluster_ctrl_addr)
 : top(top), cluster_ctrl_addr(cluster_ctrl_addr)
 {
@@ -141,7 +306,7 @@ bool Target_cluster_ctrl_xtrigger::init()
   uint32_t info;
   // set all-stop mode, so that all cores go to debug when one enters debug mode
   info = 0xFFFFFFFF;
-  top->cable->access(true, cluster_ctrl_addr + 0x000038, 4, (char*)&info);
+  return top->cable->access(true, cluster_ctrl_addr + CLUSTER_CTRL_DBG_HALT_MASK, 4, (char*)&info);
 }
 
 
@@ -170,8 +335,10 @@ public:
   Target_core *get_core(int i) { return cores[i]; }
   void update_power();
   void set_power(bool is_on);
-  void resume();
-  void halt();
+  void resume(std::vector<Cable_io_req> &reqs);
+  void halt(std::vector<Cable_io_req> &reqs);
+  void get_status_req(std::vector<Cable_io_req> &reqs);
+  bool update_status();
   void flush();
 
 protected:
@@ -186,6 +353,10 @@ protected:
   uint32_t cluster_addr;
   uint32_t xtrigger_addr;
   Target_cache *cache = NULL;
+  // Buffers of the batched cluster-level accesses
+  uint32_t resume_mask = 0xFFFFFFFF;
+  uint32_t halted_mask;
+  std::vector<uint32_t> cores_ctrl;
 };
 
 class Target_cluster : public Target_cluster_common
@@ -225,11 +396,15 @@ void Target_core::flush()
 
 void Target_core::read_ppc(uint32_t *ppc)
 {
-  if (!ppc_is_cached) {
-    read(DBG_PPC_REG, &ppc_cached);
-    ppc_is_cached = true;
-  }
-  *ppc = ppc_cached;
+  this->read(DBG_PPC_REG, ppc);
+}
+
+
+
+void Target_core::invalidate_cache()
+{
+  this->gpr_is_cached = false;
+  this->regs_cached.clear();
 }
 
 
@@ -237,39 +412,69 @@ void Target_core::read_ppc(uint32_t *ppc)
 bool Target_core::gpr_read_all(uint32_t *data)
 {
   if (!is_on) return false;
-  this->top->log->debug("Reading all registers (cluster: %d, core: %d)\n", cluster_id, core_id);
 
-  // Write back the valu
-  return top->cable->access(false, dbg_unit_addr + 0x0400, 32 * 4, (char*)data);
+  if (!this->gpr_is_cached)
+  {
+    this->top->log->debug("Reading all registers (cluster: %d, core: %d)\n", cluster_id, core_id);
+
+    if (!top->cable->access(false, dbg_unit_addr + 0x0400, 32 * 4, (char*)this->gpr_cached))
+      return false;
+
+    this->gpr_is_cached = true;
+  }
+
+  memcpy(data, this->gpr_cached, sizeof(this->gpr_cached));
+  return true;
 }
 
 
 
 bool Target_core::gpr_read(unsigned int i, uint32_t *data)
 {
-  if (!is_on) return false;
-  return this->read(0x0400 + i * 4, data);
+  if (!is_on || i >= 32) return false;
+
+  // Fetching all registers costs the same JTAG transaction as a single one
+  // and GDB usually reads several of them
+  uint32_t gprs[32];
+  if (!this->gpr_read_all(gprs))
+    return false;
+
+  *data = gprs[i];
+  return true;
 }
 
 
 
 bool Target_core::gpr_write(unsigned int i, uint32_t data)
 {
-  if (!is_on) return false;
-  return this->write(0x0400 + i * 4, data);
+  if (!is_on || i >= 32) return false;
+
+  if (!this->write(0x0400 + i * 4, data))
+    return false;
+
+  this->gpr_cached[i] = data;
+  return true;
 }
 
 
 
-void Target_core::commit_resume()
+void Target_core::commit_resume(std::vector<Cable_io_req> &reqs)
 {
   this->stopped = false;
 
   if (!this->is_on) return;
 
-  this->ppc_is_cached = false;
-  this->commit_step_mode();
-  this->write(DBG_HIT_REG, 0);
+  this->invalidate_cache();
+
+  if (this->commit_step) {
+    this->top->log->debug("Committing step mode (cluster: %d, core: %d, step: %d)\n",  cluster_id, core_id, step);
+    this->ctrl_value = (1<<16) | step;
+    reqs.push_back(Cable_io_req(true, dbg_unit_addr + DBG_CTRL_REG, 4, (char *)&this->ctrl_value));
+    this->commit_step = false;
+  }
+
+  this->hit_value = 0;
+  reqs.push_back(Cable_io_req(true, dbg_unit_addr + DBG_HIT_REG, 4, (char *)&this->hit_value));
 }
 
 
@@ -302,8 +507,26 @@ void Target_core::set_power(bool is_on)
 bool Target_core::read(uint32_t addr, uint32_t* rdata)
 {
   if (!is_on) return false;
+
+  // The control register tells if the core is running and is never cached
+  if (addr != DBG_CTRL_REG)
+  {
+    auto it = this->regs_cached.find(addr);
+    if (it != this->regs_cached.end())
+    {
+      *rdata = it->second;
+      return true;
+    }
+  }
+
   top->log->print(LOG_DEBUG, "Reading register (addr: 0x%x)\n", dbg_unit_addr + addr);
-  return top->cable->access(false, dbg_unit_addr + addr, 4, (char*)rdata);
+  if (!top->cable->access(false, dbg_unit_addr + addr, 4, (char*)rdata))
+    return false;
+
+  if (addr != DBG_CTRL_REG)
+    this->regs_cached[addr] = *rdata;
+
+  return true;
 }
 
 
@@ -311,6 +534,20 @@ bool Target_core::read(uint32_t addr, uint32_t* rdata)
 bool Target_core::write(uint32_t addr, uint32_t wdata)
 {
   if (!is_on) return false;
+
+  // Writing the control register can make the core execute, e.g. for a
+  // single-step, so nothing we read before can be trusted anymore.
+  // For other registers, just make sure the next read gets the value seen
+  // by the hardware.
+  if (addr == DBG_CTRL_REG)
+    this->invalidate_cache();
+  else
+  {
+    this->regs_cached.erase(addr);
+    if (addr >= 0x0400 && addr < 0x0400 + 32 * 4)
+      this->gpr_is_cached = false;
+  }
+
   top->log->print(LOG_DEBUG, "Writing register (addr: 0x%x, value: 0x%x)\n", dbg_unit_addr + addr, wdata);
   return top->cable->access(true, dbg_unit_addr + addr, 4, (char*)&wdata);
 }
@@ -334,7 +571,7 @@ bool Target_core::is_stopped() {
     return false;
   }
 
-  this->stopped = data & 0x10000;
+  this->set_stopped(data & 0x10000);
 
   top->log->debug("Checking core status (cluster: %d, core: %d, stopped: %d)\n", cluster_id, core_id, this->stopped);
 
@@ -342,6 +579,21 @@ bool Target_core::is_stopped() {
 }
 
 
+void Target_core::set_stopped(bool stopped)
+{
+  // Anything cached while the core was running may be stale, including the
+  // memory it may have modified
+  if (stopped && !this->stopped)
+  {
+    this->invalidate_cache();
+    this->top->target->invalidate_mem_cache();
+  }
+
+  this->stopped = stopped;
+}
+
+
+
 bool Target_core::stop()
 {
   if (!is_on) return false;
@@ -368,30 +620,35 @@ bool Target_core::halt()
 
 
 
-void Target_core::set_step_mode(bool new_step)
+// Same as stop, except that the control register is written in a batch
+// together with other cores. The core is running, so the step mode has been
+// committed and no read-modify-write is needed to keep it.
+bool Target_core::get_halt_req(std::vector<Cable_io_req> &reqs)
 {
-  this->top->log->debug("Setting step mode (cluster: %d, core: %d, step: %d, new_step: %d)\n",  cluster_id, core_id, step, new_step);
+  if (!is_on) return false;
+  if (this->stopped) return false;
 
-  if (new_step != step) {
-    this->step = new_step;
-    this->commit_step = true;
-  }
+  this->top->log->debug("Halting core (cluster: %d, core: %d, is_on: %d)\n", cluster_id, core_id, is_on);
+
+  this->invalidate_cache();
+  this->ctrl_value = (1<<16) | this->step;
+  reqs.push_back(Cable_io_req(true, dbg_unit_addr + DBG_CTRL_REG, 4, (char *)&this->ctrl_value));
+  return true;
 }
 
 
-void Target_core::commit_step_mode()
+
+void Target_core::set_step_mode(bool new_step)
 {
-  if (!is_on) return;
+  this->top->log->debug("Setting step mode (cluster: %d, core: %d, step: %d, new_step: %d)\n",  cluster_id, core_id, step, new_step);
 
-  if (commit_step) {
-    this->top->log->debug("Committing step mode (cluster: %d, core: %d, step: %d)\n",  cluster_id, core_id, step);
-    this->write(DBG_CTRL_REG, (1<<16) | step);
-    this->commit_step = false;
+  if (new_step != step) {
+    this->step = new_step;
+    this->commit_step = true;
   }
 }
 
 
-
 void Target_core::prepare_resume(bool step)
 {
 
@@ -428,6 +685,16 @@ void Target_core::prepare_resume(bool step)
 
 
 void Target_core::resume()
+{
+  std::vector<Cable_io_req> reqs;
+  this->resume(reqs);
+  if (reqs.size())
+    this->top->cable->access_batch(reqs);
+}
+
+
+
+void Target_core::resume(std::vector<Cable_io_req> &reqs)
 {
   this->stopped = false;
 
@@ -436,12 +703,14 @@ void Target_core::resume()
   this->top->log->debug("Resuming core and committing step mode (cluster: %d, core: %d, step: %d)\n",  cluster_id, core_id, step);
 
   // clear hit register, has to be done before CTRL
-  this->write(DBG_HIT_REG, 0);
+  this->hit_value = 0;
+  reqs.push_back(Cable_io_req(true, dbg_unit_addr + DBG_HIT_REG, 4, (char *)&this->hit_value));
 
-  this->write(DBG_CTRL_REG, step);
+  this->ctrl_value = step;
+  reqs.push_back(Cable_io_req(true, dbg_unit_addr + DBG_CTRL_REG, 4, (char *)&this->ctrl_value));
 
   this->commit_step = false;
-  this->ppc_is_cached = false;
+  this->invalidate_cache();
 }
 
 
@@ -527,7 +796,7 @@ void Target_cluster_common::flush()
 
 
 
-void Target_cluster_common::resume()
+void Target_cluster_common::resume(std::vector<Cable_io_req> &reqs)
 {
   this->top->log->debug("Resuming cluster (cluster: %d)\n", cluster_id);
 
@@ -538,24 +807,68 @@ void Target_cluster_common::resume()
     // debug register, we have to commit it now before resuming the core through the 
     // global register
     for (auto &core: cores) {
-      core->commit_resume();
+      core->commit_resume(reqs);
     }
 
     if (is_on) {
       this->top->log->debug("Resuming cluster through global register (cluster: %d)\n", cluster_id);
-      uint32_t info = 0xFFFFFFFF;
-      this->top->cable->access(true, xtrigger_addr + 0x00200000 + 0x28, 4, (char*)&info);
+      this->resume_mask = 0xFFFFFFFF;
+      reqs.push_back(Cable_io_req(true, xtrigger_addr + CLUSTER_CTRL_OFFSET + CLUSTER_CTRL_DBG_STATUS, 4, (char*)&this->resume_mask));
     }
   } else {
     // Otherwise, just resume them individually
     for (auto &core: cores) {
-      core->resume();
+      core->resume(reqs);
+    }
+  }
+}
+
+
+
+// Add the accesses needed to know which cores are halted. With the
+// cross-trigger matrix, the cluster controller gives it for all cores in one
+// register, otherwise each core debug unit is read.
+void Target_cluster_common::get_status_req(std::vector<Cable_io_req> &reqs)
+{
+  if (!is_on) return;
+
+  if (xtrigger_addr != -1) {
+    reqs.push_back(Cable_io_req(false, xtrigger_addr + CLUSTER_CTRL_OFFSET + CLUSTER_CTRL_DBG_STATUS, 4, (char*)&this->halted_mask));
+  } else {
+    this->cores_ctrl.resize(cores.size());
+    for (unsigned int i=0; i<cores.size(); i++) {
+      reqs.push_back(Cable_io_req(false, cores[i]->get_dbg_unit_addr() + DBG_CTRL_REG, 4, (char*)&this->cores_ctrl[i]));
     }
   }
 }
 
 
 
+// Update the state of the cores from the result of the accesses returned by
+// get_status_req, and return true if at least one core is halted.
+bool Target_cluster_common::update_status()
+{
+  if (!is_on) return false;
+
+  bool stopped = false;
+  for (unsigned int i=0; i<cores.size(); i++) {
+    bool core_stopped;
+    if (xtrigger_addr != -1)
+      core_stopped = (this->halted_mask >> i) & 1;
+    else
+      core_stopped = (this->cores_ctrl[i] >> 16) & 1;
+
+    cores[i]->set_stopped(core_stopped);
+    stopped |= core_stopped;
+  }
+
+  this->top->log->debug("Checked cluster status (cluster: %d, stopped: %d)\n", cluster_id, stopped);
+
+  return stopped;
+}
+
+
+
 void Target_cluster_common::update_power()
 {
   set_power(power->is_on());
@@ -585,12 +898,12 @@ void Target_cluster_common::set_power(bool is_on)
 
 
 
-void Target_cluster_common::halt()
+void Target_cluster_common::halt(std::vector<Cable_io_req> &reqs)
 {
   this->top->log->debug("Halting cluster (cluster: %d)\n", cluster_id);
   // Either the core is alone (FC) or the cluster is using a cross-trigger matrix to stop all cores
   // thus only stop the first one
-  cores.front()->halt();
+  cores.front()->get_halt_req(reqs);
 }
 
 
@@ -632,6 +945,12 @@ Target::Target(Gdb_server *top)
 {
   js::config *config = top->config;
 
+  this->mem_cache = new Target_mem_cache(top);
+
+  js::config *l2_config = config->get("**/soc/l2");
+  if (l2_config != NULL && l2_config->get("base") != NULL && l2_config->get("size") != NULL)
+    this->mem_cache->add_region(l2_config->get("base")->get_int(), l2_config->get("size")->get_int());
+
   js::config *fc_config = config->get("**/soc/fc");
   if (fc_config != NULL)
   {
@@ -662,6 +981,10 @@ Target::Target(Gdb_server *top)
 
       Target_cluster *cluster = new Target_cluster(config, cluster_config, top, cluster_base + 0x400000 * i, cluster_base + 0x400000 * i, i);
 
+      js::config *l1_config = cluster_config->get("l1");
+      if (l1_config != NULL && l1_config->get("base") != NULL && l1_config->get("size") != NULL)
+        this->mem_cache->add_region(l1_config->get("base")->get_int() + 0x400000 * i, l1_config->get("size")->get_int());
+
       clusters.push_back(cluster);
       for (int j=0; j<cluster->get_nb_core(); j++)
       {
@@ -685,12 +1008,66 @@ void Target::flush()
 
 
 
+// The memory can only be cached when no core can modify it
+bool Target::is_all_stopped()
+{
+  for (auto &core: this->cores)
+  {
+    if (core->is_running())
+      return false;
+  }
+  return true;
+}
+
+
+
+void Target::invalidate_mem_cache()
+{
+  this->mem_cache->invalidate();
+}
+
+
+
+bool Target::mem_read(uint32_t addr, int size, char *data)
+{
+  if (!this->is_all_stopped())
+  {
+    this->mem_cache->invalidate();
+    return this->top->cable->access(false, addr, size, data);
+  }
+
+  return this->mem_cache->read(addr, size, data);
+}
+
+
+
+bool Target::mem_write(uint32_t addr, int size, char *data)
+{
+  if (!this->is_all_stopped())
+  {
+    this->mem_cache->invalidate();
+    return this->top->cable->access(true, addr, size, data);
+  }
+
+  return this->mem_cache->write(addr, size, data);
+}
+
+
+
 void Target::resume_all()
 {
+  this->mem_cache->invalidate();
+
+  // All clusters are resumed in one batch, so that they restart as close as
+  // possible to each other
+  std::vector<Cable_io_req> reqs;
   for (auto &cluster : this->clusters)
   {
-    cluster->resume();
+    cluster->resume(reqs);
   }
+
+  if (reqs.size())
+    this->top->cable->access_batch(reqs);
 }
 
 
@@ -702,23 +1079,68 @@ void Target::resume(bool step, int tid)
     for (auto &thread : this->get_threads())
     {
       thread->prepare_resume(step);
-      this->resume_all();
     }
+    this->resume_all();
   }
   else
   {
     auto *thread = this->get_thread(tid);
     thread->prepare_resume(step);
+    this->mem_cache->invalidate();
     thread->resume();
   }
 
 }
 
+bool Target::check_stopped()
+{
+  std::vector<Cable_io_req> reqs;
+  for (auto &cluster: this->clusters) {
+    cluster->get_status_req(reqs);
+  }
+
+  if (reqs.size() == 0 || !this->top->cable->access_batch(reqs))
+    return false;
+
+  bool stopped = false;
+  for (auto &cluster: this->clusters) {
+    stopped |= cluster->update_status();
+  }
+
+  return stopped;
+}
+
+
+
+// Wait until either a core is halted, in which case true is returned, or
+// until something is received from GDB. The target is polled with an
+// increasing interval, while the socket wakes us up immediately.
 bool Target::wait(int socket_client)
 {
-  printf("UNIMPLEMENTED AT %s %d\n", __FILE__, __LINE__);
-  exit(1);
-  return true;
+  int delay = TARGET_WAIT_MIN_US;
+
+  while(1) {
+    // Check if a cluster power state has changed
+    this->update_power();
+
+    if (this->check_stopped())
+      return true;
+
+    fd_set rfds;
+    struct timeval tv;
+
+    FD_ZERO(&rfds);
+    FD_SET(socket_client, &rfds);
+
+    tv.tv_sec = delay / 1000000;
+    tv.tv_usec = delay % 1000000;
+
+    int ret = select(socket_client+1, &rfds, NULL, NULL, &tv);
+    if (ret > 0 || (ret < 0 && errno != EINTR))
+      return false;
+
+    delay = std::min(delay * 2, TARGET_WAIT_MAX_US);
+  }
 }
 
 
@@ -734,8 +1156,12 @@ void Target::update_power()
 
 void Target::halt()
 {
+  std::vector<Cable_io_req> reqs;
   for (auto &cluster: this->clusters)
   {
-    cluster->halt();
+    cluster->halt(reqs);
   }
+
+  if (reqs.size())
+    this->top->cable->access_batch(reqs);
 }
\ No newline at end of file
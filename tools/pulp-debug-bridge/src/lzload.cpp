@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2018 ETH Zurich and University of Bologna
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* 
+ * Authors: Germain Haugou, ETH (germain.haugou@iis.ee.ethz.ch)
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+// Host side of the compressed load, see include/debug_bridge/lzload.h.
+// This produces raw LZ4 blocks (no frame) which are decoded on the target
+// by the decompression stub. This is a simple greedy compressor, speed
+// matters more than ratio since it runs while the cable is busy.
+
+#define LZ4_MIN_MATCH    4
+#define LZ4_LAST_LITERALS 5
+// A match must not start in the last 12 bytes of the block
+#define LZ4_MF_LIMIT     12
+#define LZ4_MAX_OFFSET   65535
+#define LZ4_HASH_BITS    14
+
+static inline uint32_t lz4_read32(const uint8_t *ptr)
+{
+  uint32_t value;
+  memcpy(&value, ptr, 4);
+  return value;
+}
+
+static inline uint32_t lz4_hash(uint32_t value)
+{
+  return (value * 2654435761U) >> (32 - LZ4_HASH_BITS);
+}
+
+static inline bool lz4_put_len(uint8_t *&dst, uint8_t *dst_end, int len)
+{
+  for (; len >= 255; len -= 255)
+  {
+    if (dst >= dst_end) return false;
+    *dst++ = 255;
+  }
+  if (dst >= dst_end) return false;
+  *dst++ = len;
+  return true;
+}
+
+static bool lz4_put_sequence(uint8_t *&dst, uint8_t *dst_end, const uint8_t *literals, int nb_literals, int offset, int match_len)
+{
+  if (dst >= dst_end) return false;
+
+  uint8_t *token = dst++;
+  *token = (nb_literals >= 15 ? 15 : nb_literals) << 4;
+
+  if (nb_literals >= 15 && !lz4_put_len(dst, dst_end, nb_literals - 15)) return false;
+
+  if (dst_end - dst < nb_literals) return false;
+  memcpy(dst, literals, nb_literals);
+  dst += nb_literals;
+
+  if (match_len == 0) return true;
+
+  if (dst_end - dst < 2) return false;
+  *dst++ = offset & 0xff;
+  *dst++ = offset >> 8;
+
+  match_len -= LZ4_MIN_MATCH;
+  *token |= match_len >= 15 ? 15 : match_len;
+  if (match_len >= 15 && !lz4_put_len(dst, dst_end, match_len - 15)) return false;
+
+  return true;
+}
+
+// Compresses size bytes from src into dst, returns the size of the block
+// or -1 if it does not fit into capacity bytes, in which case the data
+// should rather be sent uncompressed.
+extern "C" int bridge_lz4_compress(const char *_src, int size, char *_dst, int capacity)
+{
+  const uint8_t *src = (const uint8_t *)_src;
+  const uint8_t *src_end = src + size;
+  uint8_t *dst = (uint8_t *)_dst;
+  uint8_t *dst_end = dst + capacity;
+  const uint8_t *anchor = src;
+  std::vector<int32_t> table(1 << LZ4_HASH_BITS, -1);
+
+  if (size > LZ4_MF_LIMIT)
+  {
+    const uint8_t *match_limit = src_end - LZ4_LAST_LITERALS;
+    const uint8_t *ip = src;
+
+    while (ip < src_end - LZ4_MF_LIMIT)
+    {
+      uint32_t sequence = lz4_read32(ip);
+      uint32_t hash = lz4_hash(sequence);
+      int32_t ref = table[hash];
+      table[hash] = ip - src;
+
+      if (ref < 0 || ip - (src + ref) > LZ4_MAX_OFFSET || lz4_read32(src + ref) != sequence)
+      {
+        ip++;
+        continue;
+      }
+
+      const uint8_t *match = src + ref;
+      const uint8_t *end = ip + LZ4_MIN_MATCH;
+      match += LZ4_MIN_MATCH;
+      while (end < match_limit && *end == *match)
+      {
+        end++;
+        match++;
+      }
+
+      if (!lz4_put_sequence(dst, dst_end, anchor, ip - anchor, ip - (src + ref), end - ip))
+        return -1;
+
+      ip = anchor = end;
+    }
+  }
+
+  if (!lz4_put_sequence(dst, dst_end, anchor, src_end - anchor, 0, 0))
+    return -1;
+
+  int result = dst - (uint8_t *)_dst;
+  return result < size ? result : -1;
+}
@@ -27,6 +27,7 @@
 #include "cables/log.h"
 #include "cables/adv_dbg_itf/adv_dbg_itf.hpp"
 #include "cables/jtag-proxy/jtag-proxy.hpp"
+#include "cables/loopback/loopback.hpp"
 #ifdef __USE_FTDI__
 #include "cables/ftdi/ftdi.hpp"
 #endif
@@ -94,6 +95,7 @@ void Log::error(const char *str, ...)
 extern "C" void *cable_new(const char *config_string, const char *system_config_string)
 {
   const char *cable_name = NULL;
+  std::string cable_type;
   js::config *config = NULL;
   js::config *system_config = js::import_config_from_string(std::string(system_config_string));
 
@@ -103,7 +105,8 @@ extern "C" void *cable_new(const char *config_string, const char *system_config_
     js::config *type_config = config->get("type");
     if (type_config != NULL)
     {
-      cable_name = type_config->get_str().c_str();
+      cable_type = type_config->get_str();
+      cable_name = cable_type.c_str();
     }
   }
 
@@ -132,6 +135,12 @@ extern "C" void *cable_new(const char *config_string, const char *system_config_
     Adv_dbg_itf *adu = new Adv_dbg_itf(system_config, config, log, new Jtag_proxy(log));
     return (void *)static_cast<Cable *>(adu);
   }
+  else if (strcmp(cable_name, "loopback") == 0)
+  {
+    Log *log = new Log();
+    Loopback *loopback = new Loopback(system_config, config, log);
+    return (void *)static_cast<Cable *>(loopback);
+  }
   else
   {
     fprintf(stderr, "Unknown cable: %s\n", cable_name);
@@ -141,51 +150,94 @@ extern "C" void *cable_new(const char *config_string, const char *system_config_
   return NULL;
 }
 
-extern "C" void cable_write(void *cable, unsigned int addr, int size, const char *data)
+// Fills buffer with the serial numbers of the FTDI devices matching the
+// cable configuration, separated by new lines, and returns their number.
+extern "C" int cable_ftdi_list(const char *config_string, char *buffer, int size)
+{
+#ifdef __USE_FTDI__
+  js::config *config = js::import_config_from_string(std::string(config_string));
+  std::vector<std::string> serials;
+  std::string result;
+
+  Ftdi::get_serials(config, serials);
+
+  for (std::string &serial: serials)
+  {
+    result += serial + "\n";
+  }
+
+  snprintf(buffer, size, "%s", result.c_str());
+
+  return serials.size();
+#else
+  bridge_error = "Debug bridge has not been compiled with FTDI support";
+  return -1;
+#endif
+}
+
+extern "C" int cable_write(void *cable, unsigned int addr, int size, const char *data)
 {
-  Adv_dbg_itf *adu = (Adv_dbg_itf *)cable;
-  adu->access(true, addr, size, (char *)data);
+  Cable *adu = (Cable *)cable;
+  return adu->access(true, addr, size, (char *)data) ? 0 : -1;
 }
 
-extern "C" void cable_read(void *cable, unsigned int addr, int size, const char *data)
+extern "C" int cable_read(void *cable, unsigned int addr, int size, const char *data)
 {
-  Adv_dbg_itf *adu = (Adv_dbg_itf *)cable;
-  adu->access(false, addr, size, (char *)data);
+  Cable *adu = (Cable *)cable;
+  return adu->access(false, addr, size, (char *)data) ? 0 : -1;
+}
+
+// Scatter/gather access, all the regions are transferred in one batch.
+// The request i accesses sizes[i] bytes at addrs[i], from or to buffers[i],
+// depending on is_write[i]. The buffers are directly the ones given by the
+// caller, so that python buffer objects can be used without any copy.
+extern "C" int cable_access_vector(void *cable, int nb_reqs, const int *is_write, const unsigned int *addrs, const int *sizes, char **buffers)
+{
+  Cable *adu = (Cable *)cable;
+  std::vector<Cable_io_req> reqs;
+
+  reqs.reserve(nb_reqs);
+  for (int i=0; i<nb_reqs; i++)
+  {
+    reqs.push_back(Cable_io_req(is_write[i], addrs[i], sizes[i], buffers[i]));
+  }
+
+  return adu->access_batch(reqs) ? 0 : -1;
 }
 
 extern "C" void cable_reg_write(void *cable, unsigned int addr, const char *data, int device)
 {
-  Adv_dbg_itf *adu = (Adv_dbg_itf *)cable;
+  Cable *adu = (Cable *)cable;
   adu->reg_access(true, addr, (char *)data, device);
 }
 
 extern "C" void cable_reg_read(void *cable, unsigned int addr, const char *data, int device)
 {
-  Adv_dbg_itf *adu = (Adv_dbg_itf *)cable;
+  Cable *adu = (Cable *)cable;
   adu->reg_access(false, addr, (char *)data, device);
 }
 
 extern "C" void chip_reset(void *handler, bool active, int duration)
 {
-  Adv_dbg_itf *cable = (Adv_dbg_itf *)handler;
+  Cable *cable = (Cable *)handler;
   cable->chip_reset(active, duration);
 }
 
 extern "C" void chip_config(void *handler, uint32_t value)
 {
-  Adv_dbg_itf *cable = (Adv_dbg_itf *)handler;
+  Cable *cable = (Cable *)handler;
   cable->chip_config(value);
 }
 
 extern "C" void jtag_reset(void *handler, bool active)
 {
-  Adv_dbg_itf *cable = (Adv_dbg_itf *)handler;
+  Cable *cable = (Cable *)handler;
   cable->jtag_reset(active);
 }
 
 extern "C" void jtag_soft_reset(void *handler)
 {
-  Adv_dbg_itf *cable = (Adv_dbg_itf *)handler;
+  Cable *cable = (Cable *)handler;
   cable->jtag_soft_reset();
 }
 
@@ -214,6 +266,51 @@ extern "C" void cable_unlock(void *handler)
   cable->unlock();
 }
 
+// Copies the counters and the latency histogram of the given context,
+// returns the number of counters, or -1 if the context does not exist.
+extern "C" int cable_stats_get(void *handler, int ctx, uint64_t *counters, int nb_counters, uint64_t *latency, int nb_buckets)
+{
+  Cable *cable = (Cable *)handler;
+  Cable_stats *stats = cable->get_stats();
+
+  if (ctx < 0 || ctx >= CABLE_STATS_NB_CTX) return -1;
+
+  for (int i=0; i<nb_counters && i<CABLE_STATS_NB_COUNTERS; i++)
+  {
+    counters[i] = stats->get(ctx, i);
+  }
+
+  for (int i=0; i<nb_buckets && i<CABLE_STATS_LATENCY_BUCKETS; i++)
+  {
+    latency[i] = stats->get_latency(ctx, i);
+  }
+
+  return CABLE_STATS_NB_COUNTERS;
+}
+
+extern "C" const char *cable_stats_counter_name(int counter)
+{
+  return Cable_stats::get_counter_name(counter);
+}
+
+extern "C" const char *cable_stats_context_name(int ctx)
+{
+  return Cable_stats::get_context_name(ctx);
+}
+
+extern "C" void cable_stats_reset(void *handler)
+{
+  Cable *cable = (Cable *)handler;
+  cable->get_stats()->reset();
+}
+
+extern "C" void cable_stats_dump(void *handler)
+{
+  Cable *cable = (Cable *)handler;
+  cable->get_stats()->dump(stdout);
+  fflush(stdout);
+}
+
 
 
 
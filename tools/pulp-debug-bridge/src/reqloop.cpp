@@ -27,14 +27,37 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <netdb.h>
+#include <sys/socket.h>
 #include <mutex>
 #include <queue>
+#include <chrono>
+#include <atomic>
+#include <algorithm>
 #include <condition_variable>
 
 #if defined(__USE_SDL__)
 #include <SDL.h>
 #endif
 
+// Bounds of the delay between 2 polls of the target when it is idle. The
+// delay is doubled each time nothing is found and reset as soon as something
+// is found.
+#define REQLOOP_POLL_MIN_US 10
+#define REQLOOP_POLL_MAX_US 5000
+
+// Host file transfers are cut into chunks of this size, with this number of
+// chunks in flight between the host file thread and the cable
+#define REQLOOP_FILE_CHUNK_SIZE (64*1024)
+#define REQLOOP_FILE_NB_CHUNKS  4
+
+// Maximum length of a stream channel name, including the terminating 0
+#define REQLOOP_STREAM_NAME_LEN 32
+
+// Size of the target buffer used to compare and program the flash in
+// differential mode
+#define REQLOOP_FLASH_DIFF_CHUNK_SIZE 4096
+
 typedef enum 
 {
   TARGET_SYNC_FSM_STATE_INIT,
@@ -52,10 +75,82 @@ public:
   hal_bridge_req_t target_req;
 };
 
+class File_chunk
+{
+public:
+  char *data;
+  int size;
+};
+
+typedef enum
+{
+  FILE_JOB_NONE,
+  FILE_JOB_READ,
+  FILE_JOB_WRITE,
+  FILE_JOB_EXIT
+} file_job_e;
+
+// Moves data between a host file and the target. The host file accesses are
+// done by a worker thread working on a ring of chunks, so that they overlap
+// with the cable accesses done by the caller. Transfers fitting in one chunk
+// are done directly by the caller, as there is nothing to overlap.
+class File_pipeline
+{
+public:
+  File_pipeline(int nb_chunks, int chunk_size);
+  ~File_pipeline();
+  int file_to_target(Cable *cable, int file, unsigned int addr, int len);
+  int target_to_file(Cable *cable, int file, unsigned int addr, int len);
+
+private:
+  File_chunk *pop_chunk(std::queue<File_chunk *> &queue);
+  void push_chunk(std::queue<File_chunk *> &queue, File_chunk *chunk);
+  void start_job(file_job_e job, int file, int len);
+  void wait_job();
+  void worker_routine();
+  void file_read_routine(int file, int len);
+  void file_write_routine(int file);
+  int file_write(int file, char *data, int size);
+
+  std::thread *thread;
+  file_job_e job = FILE_JOB_NONE;
+  int job_file;
+  int job_len;
+  int chunk_size;
+  std::vector<File_chunk> chunks;
+  std::queue<File_chunk *> free_chunks;
+  std::queue<File_chunk *> ready_chunks;
+  std::mutex mutex;
+  std::condition_variable cond;
+  std::atomic<bool> write_failed;
+  int written;
+};
+
+// Host side of a target stream channel. The data drained from the target
+// ring buffer is forwarded to a file, a standard output or a TCP socket,
+// depending on the configuration.
+class Bridge_stream
+{
+public:
+  Bridge_stream(Log *log, std::string name, std::string output);
+  ~Bridge_stream();
+  void push(const char *data, int size);
+
+  std::string name;
+  int fd = -1;
+  bool is_socket = false;
+  uint32_t dropped = 0;
+  std::vector<char> data;
+
+private:
+  Log *log;
+};
+
 class Reqloop
 {
 public:
   Reqloop(Cable *cable, unsigned int debug_struct_addr);
+  ~Reqloop();
   void reqloop_routine();
   int stop(bool kill);
   void activate();
@@ -66,10 +161,14 @@ public:
   int flash_erase(int32_t type, uint32_t itf, uint32_t cs, uint32_t addr, int32_t size);
   int flash_erase_sector(int32_t type, uint32_t itf, uint32_t cs, uint32_t addr);
   int flash_erase_chip(int32_t type, uint32_t itf, uint32_t cs);
+  int flash_write_diff(int32_t type, uint32_t itf, uint32_t cs, uint32_t addr, const char *data, uint32_t size, uint32_t sector_size);
   void buffer_free(uint32_t addr, uint32_t size);
   uint32_t buffer_alloc(uint32_t size);
 
 private:
+  int flash_read_to_host(int32_t type, uint32_t itf, uint32_t cs, uint32_t addr, char *data, uint32_t size, uint32_t buffer);
+  int flash_write_from_host(int32_t type, uint32_t itf, uint32_t cs, uint32_t addr, const char *data, uint32_t size, uint32_t buffer);
+
   void reply_req(hal_debug_struct_t *debug_struct, hal_bridge_req_t *target_req, hal_bridge_req_t *req);
   bool handle_req_connect(hal_debug_struct_t *debug_struct, hal_bridge_req_t *target_req, hal_bridge_req_t *req);
   bool handle_req_open(hal_debug_struct_t *debug_struct, hal_bridge_req_t *target_req, hal_bridge_req_t *req);
@@ -87,9 +186,15 @@ private:
 
   void notif_target(hal_debug_struct_t *debug_struct);
   void handle_target_req(hal_debug_struct_t *debug_struct, Target_req *target_req);
-  void handle_bridge_to_target_reqs(hal_debug_struct_t *debug_struct);
+  bool handle_bridge_to_target_reqs(hal_debug_struct_t *debug_struct);
+
+  void streams_open(hal_debug_struct_t *state);
+  bool streams_drain();
+  void streams_close();
 
   bool wait_target_request();
+  void poll_wait(bool active);
+  void push_target_req(Target_req *req);
   unsigned int get_target_state();
   void send_target_ack();
   void clear_target_ack();
@@ -110,6 +215,9 @@ private:
   std::mutex mutex;
   std::condition_variable cond;
 
+  int poll_delay = 0;
+  bool wakeup = false;
+
   target_sync_fsm_state_e target_sync_fsm_state;
   unsigned int jtag_val;
 
@@ -118,17 +226,25 @@ private:
   bool target_jtag_sync;
 
   int confreg_instr;
+
+  File_pipeline *file_pipeline;
+
+  uint32_t protocol_version = 0;
+  uint32_t streams_addr = 0;
+  std::vector<Bridge_stream *> streams;
+  std::vector<hal_bridge_stream_t> streams_state;
 };
 
 class Framebuffer
 {
 public:
   Framebuffer(Cable *cable, std::string name, int width, int height, int format);
-  void update(uint32_t addr, int posx, int posy, int width, int height);
+  void update(uint32_t addr, int posx, int posy, int width, int height, uint32_t dirty=0, int dirty_rows=0);
   bool open();
 
 private:
   void fb_routine();
+  void convert_line(uint8_t *src, int posx, int posy, int width, int line, int height);
 
   std::string name;
   int width;
@@ -138,6 +254,11 @@ private:
   Cable *cable;
   std::thread *thread;
   uint32_t *pixels;
+  // Copy of the target framebuffer content, used to only convert and blit
+  // the lines which really changed since the previous update
+  std::vector<uint8_t> cache;
+  bool cache_valid = false;
+  std::vector<uint8_t> buffer;
 #if defined(__USE_SDL__)
   SDL_Surface *screen;
   SDL_Texture * texture;
@@ -196,6 +317,7 @@ bool Framebuffer::open()
   }
 
   pixels = new uint32_t[width*height];
+  cache.resize(width*height*pixel_size);
   SDL_Init(SDL_INIT_VIDEO);
 
   window = SDL_CreateWindow(name.c_str(),
@@ -223,7 +345,57 @@ bool Framebuffer::open()
 #endif
 }
 
-void Framebuffer::update(uint32_t addr, int posx, int posy, int width, int height)
+// Converts one line of the updated area, line being relative to the area
+void Framebuffer::convert_line(uint8_t *src, int posx, int posy, int width, int line, int height)
+{
+  uint32_t *dst = &pixels[(line+posy)*this->width + posx];
+
+  if (this->format == HAL_BRIDGE_REQ_FB_FORMAT_GRAY)
+  {
+    for (int i=0; i<width; i++)
+    {
+      unsigned int value = src[i];
+      dst[i] = (0xff << 24) | (value << 16) | (value << 8) | value;
+    }
+  }
+  else if (this->format == HAL_BRIDGE_REQ_FB_FORMAT_RAW)
+  {
+    int bayer_line = height - line - 1;
+    for (int i=0; i<width; i++)
+    {
+      int shift;
+      if (bayer_line & 1)
+      {
+        if (i & 1)
+          shift = 16;
+        else
+          shift = 8;
+      }
+      else
+      {
+        if (i & 1)
+          shift = 8;
+        else
+          shift = 0;
+      }
+
+      unsigned int value = src[i];
+
+      dst[i] = (0xff << 24) | (value << shift);
+    }
+  }
+  else
+  {
+    for (int i=0; i<width; i++)
+    {
+      uint32_t value;
+      memcpy(&value, &src[i*4], 4);
+      dst[i] = (0xff << 24) | value;
+    }
+  }
+}
+
+void Framebuffer::update(uint32_t addr, int posx, int posy, int width, int height, uint32_t dirty, int dirty_rows)
 {
 #if defined(__USE_SDL__)
 
@@ -234,94 +406,373 @@ void Framebuffer::update(uint32_t addr, int posx, int posy, int width, int heigh
     height = this->height;
   }
 
-  int size = width*height*pixel_size;
+  if (posx < 0 || posy < 0 || width <= 0 || height <= 0 || posx + width > this->width || posy + height > this->height)
+  {
+    printf("Invalid framebuffer update area (posx: %d, posy: %d, width: %d, height: %d)\n", posx, posy, width, height);
+    return;
+  }
+
+  int line_size = width*pixel_size;
 
-  if (this->format == HAL_BRIDGE_REQ_FB_FORMAT_GRAY)
+  // Without dirty bitmap, the whole area is considered dirty, which is
+  // handled as a single band
+  int nb_bands = 1;
+  if (dirty == 0 || dirty_rows <= 0)
+  {
+    dirty_rows = height;
+  }
+  else
+  {
+    nb_bands = (height + dirty_rows - 1) / dirty_rows;
+  }
+
+  std::vector<uint8_t> bands((nb_bands + 7) / 8, 0xff);
+  if (dirty != 0 && nb_bands > 1)
+  {
+    this->cable->access(false, dirty, bands.size(), (char *)bands.data());
+  }
+
+  // Fetch all contiguous runs of dirty bands in a single batch
+  this->buffer.resize(height*line_size);
+  std::vector<Cable_io_req> reqs;
+  for (int band=0; band<nb_bands;)
+  {
+    if (!(bands[band/8] & (1 << (band%8))))
+    {
+      band++;
+      continue;
+    }
+    int first = band;
+    while (band < nb_bands && (bands[band/8] & (1 << (band%8))))
+      band++;
+
+    int first_line = first*dirty_rows;
+    int last_line = std::min(band*dirty_rows, height);
+    int offset = first_line*line_size;
+    reqs.push_back(Cable_io_req(false, addr + offset, (last_line - first_line)*line_size, (char *)&this->buffer[offset]));
+  }
+
+  if (reqs.size() == 0)
+    return;
+
+  this->cable->access_batch(reqs);
+
+  // Now only convert the lines which are different from what we already
+  // displayed, and blit the smallest vertical span containing them
+  int min_line = height, max_line = -1;
+  for (auto &req: reqs)
   {
-    uint8_t buffer[size];
-    this->cable->access(false, addr, size, (char*)buffer);
-
-#if 0
-    static int count = 0;
-    char name[64];
-    sprintf(name, "fb%d", count++);
-    FILE *file = fopen(name, "w");
-    fprintf(file, "P5\n%d %d\n255\n", this->width, this->height);
-    fwrite(buffer, 1, size, file);
-    fclose(file);
+    int first_line = (req.addr - addr) / line_size;
+    int nb_lines = req.size / line_size;
+    for (int j=first_line; j<first_line+nb_lines; j++)
+    {
+      uint8_t *src = &this->buffer[j*line_size];
+      uint8_t *cached = &this->cache[((j+posy)*this->width + posx)*pixel_size];
+
+      if (this->cache_valid && memcmp(src, cached, line_size) == 0)
+        continue;
+
+      memcpy(cached, src, line_size);
+      this->convert_line(src, posx, posy, width, j, height);
+
+      if (j < min_line) min_line = j;
+      if (j > max_line) max_line = j;
+    }
+  }
+
+  if (posx == 0 && posy == 0 && width == this->width && height == this->height && nb_bands == 1)
+    this->cache_valid = true;
+
+  if (max_line < 0)
+    return;
+
+  SDL_Rect rect = { posx, posy + min_line, width, max_line - min_line + 1 };
+  SDL_UpdateTexture(texture, &rect, &pixels[rect.y*this->width + rect.x], this->width * sizeof(Uint32));
+
+  SDL_RenderClear(renderer);
+  SDL_RenderCopy(renderer, texture, NULL, NULL);
+  SDL_RenderPresent(renderer);
 #endif
+}
+
+
+
+File_pipeline::File_pipeline(int nb_chunks, int chunk_size)
+: chunk_size(chunk_size), chunks(nb_chunks)
+{
+  for (auto &chunk: this->chunks)
+  {
+    chunk.data = new char[chunk_size];
+    this->free_chunks.push(&chunk);
+  }
+
+  this->thread = new std::thread(&File_pipeline::worker_routine, this);
+}
+
+File_pipeline::~File_pipeline()
+{
+  this->start_job(FILE_JOB_EXIT, -1, 0);
+  this->thread->join();
+  delete this->thread;
+
+  for (auto &chunk: this->chunks)
+  {
+    delete[] chunk.data;
+  }
+}
 
-    for (int j=0; j<height; j++)
+File_chunk *File_pipeline::pop_chunk(std::queue<File_chunk *> &queue)
+{
+  std::unique_lock<std::mutex> lock(this->mutex);
+
+  while (queue.size() == 0)
+  {
+    this->cond.wait(lock);
+  }
+
+  File_chunk *chunk = queue.front();
+  queue.pop();
+  return chunk;
+}
+
+void File_pipeline::push_chunk(std::queue<File_chunk *> &queue, File_chunk *chunk)
+{
+  std::unique_lock<std::mutex> lock(this->mutex);
+  queue.push(chunk);
+  this->cond.notify_all();
+}
+
+void File_pipeline::start_job(file_job_e job, int file, int len)
+{
+  std::unique_lock<std::mutex> lock(this->mutex);
+  this->job = job;
+  this->job_file = file;
+  this->job_len = len;
+  this->cond.notify_all();
+}
+
+void File_pipeline::wait_job()
+{
+  std::unique_lock<std::mutex> lock(this->mutex);
+
+  while (this->job != FILE_JOB_NONE)
+  {
+    this->cond.wait(lock);
+  }
+}
+
+void File_pipeline::worker_routine()
+{
+  std::unique_lock<std::mutex> lock(this->mutex);
+
+  while(1)
+  {
+    while (this->job == FILE_JOB_NONE)
+    {
+      this->cond.wait(lock);
+    }
+
+    if (this->job == FILE_JOB_EXIT)
+      break;
+
+    file_job_e job = this->job;
+    int file = this->job_file;
+    int len = this->job_len;
+
+    lock.unlock();
+
+    if (job == FILE_JOB_READ)
+      this->file_read_routine(file, len);
+    else
+      this->file_write_routine(file);
+
+    lock.lock();
+
+    this->job = FILE_JOB_NONE;
+    this->cond.notify_all();
+  }
+}
+
+void File_pipeline::file_read_routine(int file, int len)
+{
+  // A chunk with a size lower or equal to 0 is pushed to notify the end of
+  // the file or an error
+  while(1)
+  {
+    File_chunk *chunk = this->pop_chunk(this->free_chunks);
+
+    int iter_size = len;
+    if (iter_size > this->chunk_size)
+      iter_size = this->chunk_size;
+
+    chunk->size = iter_size ? read(file, (void *)chunk->data, iter_size) : 0;
+
+    this->push_chunk(this->ready_chunks, chunk);
+
+    if (chunk->size <= 0)
+      break;
+
+    len -= chunk->size;
+  }
+}
+
+int File_pipeline::file_to_target(Cable *cable, int file, unsigned int addr, int len)
+{
+  int res = 0;
+
+  if (len <= this->chunk_size)
+  {
+    File_chunk *chunk = &this->chunks[0];
+
+    while (res < len)
     {
-      for (int i=0; i<width; i++)
+      int iter_size = read(file, (void *)(chunk->data + res), len - res);
+
+      if (iter_size <= 0)
       {
-        unsigned int value = buffer[j*width+i];
-        pixels[(j+posy)*this->width + i + posx] = (0xff << 24) | (value << 16) | (value << 8) | value;
+        if (iter_size == -1 && res == 0) res = -1;
+        break;
       }
+
+      res += iter_size;
     }
+
+    if (res > 0)
+      cable->access(true, addr, res, chunk->data);
+
+    return res;
   }
-  else if (this->format == HAL_BRIDGE_REQ_FB_FORMAT_RAW)
+
+  this->start_job(FILE_JOB_READ, file, len);
+
+  while(1)
   {
-    uint8_t buffer[size];
-    this->cable->access(false, addr, size, (char*)buffer);
+    File_chunk *chunk = this->pop_chunk(this->ready_chunks);
+    int size = chunk->size;
+
+    if (size > 0)
+      cable->access(true, addr, size, chunk->data);
 
-    for (int j=0; j<height; j++)
+    this->push_chunk(this->free_chunks, chunk);
+
+    if (size <= 0)
     {
-      for (int i=0; i<width; i++)
-      {
-        int shift;
-        int line = height - j - 1;
-        if (line & 1)
-        {
-          if (i & 1)
-            shift = 16;
-          else
-            shift = 8;
-        }
-        else
-        {
-          if (i & 1)
-            shift = 8;
-          else
-            shift = 0;
-        }
+      if (size == -1 && res == 0) res = -1;
+      break;
+    }
 
-        unsigned int value = buffer[j*width+i];
+    res += size;
+    addr += size;
+  }
 
-        pixels[(j+posy)*this->width + i + posx] = (0xff << 24) | (value << shift);
-      }
+  this->wait_job();
+
+  return res;
+}
+
+void File_pipeline::file_write_routine(int file)
+{
+  // A chunk with a size of 0 is pushed to notify the end of the transfer.
+  // In case of error, the remaining chunks are just dropped.
+  while(1)
+  {
+    File_chunk *chunk = this->pop_chunk(this->ready_chunks);
+    int size = chunk->size;
+
+    if (!this->write_failed)
+      this->file_write(file, chunk->data, size);
+
+    this->push_chunk(this->free_chunks, chunk);
+
+    if (size == 0)
+      break;
+  }
+}
+
+int File_pipeline::file_write(int file, char *data, int size)
+{
+  int offset = 0;
+  while (offset < size)
+  {
+    int iter_size = write(file, (void *)&data[offset], size - offset);
+    if (iter_size <= 0)
+    {
+      this->write_failed = true;
+      break;
     }
+
+    offset += iter_size;
+    this->written += iter_size;
   }
-  else
+
+  return offset;
+}
+
+int File_pipeline::target_to_file(Cable *cable, int file, unsigned int addr, int len)
+{
+  this->written = 0;
+  this->write_failed = false;
+
+  if (len <= this->chunk_size)
   {
-    uint32_t buffer[size];
-    this->cable->access(false, addr, size*4, (char*)buffer);
+    File_chunk *chunk = &this->chunks[0];
 
-    for (int j=0; j<height; j++)
+    if (len > 0)
     {
-      for (int i=0; i<width; i++)
-      {
-        unsigned int value = buffer[j*width+i];
-        pixels[(j+posy)*this->width + i + posx] = (0xff << 24) | value;
-      }
+      cable->access(false, addr, len, chunk->data);
+      this->file_write(file, chunk->data, len);
     }
+
+    return this->written;
   }
 
+  this->start_job(FILE_JOB_WRITE, file, 0);
 
-  SDL_UpdateTexture(texture, NULL, pixels, this->width * sizeof(Uint32));
+  while (len > 0 && !this->write_failed)
+  {
+    File_chunk *chunk = this->pop_chunk(this->free_chunks);
 
-  SDL_RenderClear(renderer);
-  SDL_RenderCopy(renderer, texture, NULL, NULL);
-  SDL_RenderPresent(renderer);
-#endif
+    int iter_size = len;
+    if (iter_size > this->chunk_size)
+      iter_size = this->chunk_size;
+
+    cable->access(false, addr, iter_size, chunk->data);
+    chunk->size = iter_size;
+
+    this->push_chunk(this->ready_chunks, chunk);
+
+    addr += iter_size;
+    len -= iter_size;
+  }
+
+  File_chunk *chunk = this->pop_chunk(this->free_chunks);
+  chunk->size = 0;
+  this->push_chunk(this->ready_chunks, chunk);
+
+  this->wait_job();
+
+  return this->written;
 }
 
 
 
 int Reqloop::stop(bool kill)
 {
-  if (kill) end = true;
+  if (kill)
+  {
+    std::unique_lock<std::mutex> lock(this->mutex);
+    end = true;
+    this->wakeup = true;
+    this->cond.notify_all();
+  }
   thread->join();
+  this->streams_close();
+
+  // The pipeline is only used by the reqloop thread, its worker can be
+  // released as soon as this one is over
+  delete this->file_pipeline;
+  this->file_pipeline = NULL;
+
   return status;
 }
 
@@ -336,12 +787,16 @@ void Reqloop::activate()
       uint32_t protocol_version;
       cable->access(false, (unsigned int)(long)&this->debug_struct->protocol_version, 4, (char*)&protocol_version);
       
-      if (protocol_version != PROTOCOL_VERSION_4)
+      // Stream channels are an extension of the previous version, runtimes
+      // not providing them are still supported
+      if (protocol_version != PROTOCOL_VERSION_5 && protocol_version != PROTOCOL_VERSION_6)
       {
-        this->log->error("Protocol version mismatch between bridge and runtime (bridge: %d, runtime: %d)\n", PROTOCOL_VERSION_4, protocol_version);
+        this->log->error("Protocol version mismatch between bridge and runtime (bridge: %d, runtime: %d)\n", PROTOCOL_VERSION_6, protocol_version);
         throw std::logic_error("Unable to connect to runtime");
       }
 
+      this->protocol_version = protocol_version;
+
       int32_t is_connected;
       this->cable->access(false, (unsigned int)(long)&this->debug_struct->target.connected, 4, (char*)&is_connected);
       this->connected = is_connected;
@@ -440,29 +895,7 @@ bool Reqloop::handle_req_open(hal_debug_struct_t *debug_struct, hal_bridge_req_t
 
 bool Reqloop::handle_req_read(hal_debug_struct_t *debug_struct, hal_bridge_req_t *req, hal_bridge_req_t *target_req)
 {
-  char buffer[4096];
-  int size = req->read.len;
-  char *ptr = (char *)(long)req->read.ptr;
-  int res = 0;
-  while (size)
-  {
-    int iter_size = size;
-    if (iter_size > 4096)
-      iter_size = 4096;
-
-    iter_size = read(req->read.file, (void *)buffer, iter_size);
-
-    if (iter_size <= 0) {
-      if (iter_size == -1 && res == 0) res = -1;
-      break;
-    }
-
-    cable->access(true, (unsigned int)(long)ptr, iter_size, (char*)buffer);
-
-    res += iter_size;
-    ptr += iter_size;
-    size -= iter_size;
-  }
+  int res = this->file_pipeline->file_to_target(this->cable, req->read.file, req->read.ptr, req->read.len);
 
   cable->access(true, (unsigned int)(long)&target_req->read.retval, 4, (char*)&res);
 
@@ -472,27 +905,7 @@ bool Reqloop::handle_req_read(hal_debug_struct_t *debug_struct, hal_bridge_req_t
 
 bool Reqloop::handle_req_write(hal_debug_struct_t *debug_struct, hal_bridge_req_t *req, hal_bridge_req_t *target_req)
 {
-  char buffer[4096];
-  int size = req->write.len;
-  char *ptr = (char *)(long)req->write.ptr;
-  int res = 0;
-  while (size)
-  {
-    int iter_size = size;
-    if (iter_size > 4096)
-      iter_size = 4096;
-
-    cable->access(false, (unsigned int)(long)ptr, iter_size, (char*)buffer);
-
-    iter_size = write(req->write.file, (void *)buffer, iter_size);
-
-    if (iter_size <= 0)
-      break;
-
-    res += iter_size;
-    ptr += iter_size;
-    size -= iter_size;
-  }
+  int res = this->file_pipeline->target_to_file(this->cable, req->write.file, req->write.ptr, req->write.len);
 
   if (res == 0)
     res = -1;
@@ -552,7 +965,8 @@ bool Reqloop::handle_req_fb_update(hal_debug_struct_t *debug_struct, hal_bridge_
   Framebuffer *fb = (Framebuffer *)req->fb_update.screen;
 
   fb->update(
-    req->fb_update.addr, req->fb_update.posx, req->fb_update.posy, req->fb_update.width, req->fb_update.height
+    req->fb_update.addr, req->fb_update.posx, req->fb_update.posy, req->fb_update.width, req->fb_update.height,
+    req->fb_update.dirty, req->fb_update.dirty_rows
   );
 #endif
 
@@ -745,25 +1159,39 @@ void Reqloop::handle_target_req(hal_debug_struct_t *debug_struct, Target_req *ta
 
   uint32_t next;
   this->cable->access(false, (unsigned int)(long)&req->next, 4, (char*)&next);
-  this->cable->access(true, (unsigned int)(long)&debug_struct->first_bridge_free_req, 4, (char*)&next);
-  this->cable->access(true, (unsigned int)(long)req, sizeof(hal_bridge_req_t), (char*)&target_req->target_req);
-  this->cable->access(true, (unsigned int)(long)&req->bridge_data, sizeof(target_req), (char*)&target_req);
 
+  std::vector<Cable_io_req> reqs;
+  reqs.push_back(Cable_io_req(true, (unsigned int)(long)&debug_struct->first_bridge_free_req, 4, (char*)&next));
+  reqs.push_back(Cable_io_req(true, (unsigned int)(long)req, sizeof(hal_bridge_req_t), (char*)&target_req->target_req));
+  reqs.push_back(Cable_io_req(true, (unsigned int)(long)&req->bridge_data, sizeof(target_req), (char*)&target_req));
 
   // Store it to the debug structure
-  this->cable->access(true, (unsigned int)(long)&debug_struct->target_req, 4, (char*)&req);
+  reqs.push_back(Cable_io_req(true, (unsigned int)(long)&debug_struct->target_req, 4, (char*)&req));
+
+  this->cable->access_batch(reqs);
 
   // And notify the target so that it is processed
   this->notif_target(debug_struct);
 }
 
-void Reqloop::handle_bridge_to_target_reqs(hal_debug_struct_t *debug_struct)
+// Returns true if at least one request was handed to the target
+bool Reqloop::handle_bridge_to_target_reqs(hal_debug_struct_t *debug_struct)
 {
+  bool pushed = false;
+
   if (!this->connected)
-    return;
+    return false;
 
-  while(this->target_reqs.size())
+  while(1)
   {
+    // The queue is filled by other threads, but only this one pops it, so
+    // it cannot become empty once checked
+    {
+      std::unique_lock<std::mutex> lock(this->mutex);
+      if (this->target_reqs.empty())
+        break;
+    }
+
     // Runtime can only handle one request, first check if no request is already
     // pushed.
     uint32_t target_req;
@@ -776,11 +1204,268 @@ void Reqloop::handle_bridge_to_target_reqs(hal_debug_struct_t *debug_struct)
     this->target_reqs.pop();
     this->handle_target_req(debug_struct, bridge_target_req);
     this->mutex.unlock();
+
+    pushed = true;
+  }
+
+  return pushed;
+}
+
+Bridge_stream::Bridge_stream(Log *log, std::string name, std::string output) : name(name), log(log)
+{
+  if (output == "stdout")
+  {
+    this->fd = 1;
+  }
+  else if (output == "stderr")
+  {
+    this->fd = 2;
+  }
+  else if (output.compare(0, 4, "tcp:") == 0)
+  {
+    // tcp:<host>:<port>, the bridge connects to a server run by the user
+    std::string addr = output.substr(4);
+    size_t pos = addr.rfind(':');
+    struct addrinfo hints, *result;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    if (pos == std::string::npos || getaddrinfo(addr.substr(0, pos).c_str(), addr.substr(pos + 1).c_str(), &hints, &result) != 0)
+    {
+      log->warning("Invalid address for stream %s: %s\n", name.c_str(), output.c_str());
+      return;
+    }
+
+    for (struct addrinfo *info = result; info != NULL; info = info->ai_next)
+    {
+      int fd = socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+      if (fd < 0) continue;
+      if (connect(fd, info->ai_addr, info->ai_addrlen) == 0)
+      {
+        this->fd = fd;
+        this->is_socket = true;
+        break;
+      }
+      close(fd);
+    }
+
+    freeaddrinfo(result);
+
+    if (this->fd < 0)
+      log->warning("Unable to connect stream %s to %s\n", name.c_str(), output.c_str());
+  }
+  else
+  {
+    this->fd = open(output.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (this->fd < 0)
+      log->warning("Unable to open output of stream %s: %s\n", name.c_str(), output.c_str());
   }
 }
 
+Bridge_stream::~Bridge_stream()
+{
+  if (this->fd > 2)
+    close(this->fd);
+}
+
+void Bridge_stream::push(const char *data, int size)
+{
+  while (size > 0 && this->fd >= 0)
+  {
+    int len = this->is_socket ? send(this->fd, data, size, MSG_NOSIGNAL) : write(this->fd, data, size);
+    if (len <= 0)
+    {
+      // Stop forwarding but keep draining, the target must not be blocked
+      this->log->warning("Unable to forward stream %s, dropping its output\n", this->name.c_str());
+      if (this->fd > 2)
+        close(this->fd);
+      this->fd = -1;
+      return;
+    }
+    data += len;
+    size -= len;
+  }
+}
+
+void Reqloop::streams_open(hal_debug_struct_t *state)
+{
+  js::config *config = this->cable->get_config()->get("**/debug_bridge/streams");
+  int nb_streams = state->nb_streams;
+
+  this->streams_state.resize(nb_streams);
+  if (!this->cable->access(false, state->streams, nb_streams * sizeof(hal_bridge_stream_t), (char *)this->streams_state.data()))
+    return;
+
+  // Get all the names in one batch
+  std::vector<char> names(nb_streams * REQLOOP_STREAM_NAME_LEN);
+  std::vector<Cable_io_req> reqs;
+  for (int i=0; i<nb_streams; i++)
+  {
+    reqs.push_back(Cable_io_req(false, this->streams_state[i].name, REQLOOP_STREAM_NAME_LEN - 1, &names[i*REQLOOP_STREAM_NAME_LEN]));
+  }
+  if (!this->cable->access_batch(reqs))
+    return;
+
+  for (int i=0; i<nb_streams; i++)
+  {
+    std::string name(&names[i*REQLOOP_STREAM_NAME_LEN]);
+    js::config *output = config != NULL ? config->get(name) : NULL;
+    Bridge_stream *stream = NULL;
+
+    // Channels with no output are not drained, the target then just drops
+    // what it writes once the buffer is full
+    if (output != NULL)
+    {
+      this->log->debug("Opening stream (name: %s, output: %s, size: 0x%x)\n", name.c_str(), output->get_str().c_str(), this->streams_state[i].size);
+      stream = new Bridge_stream(this->log, name, output->get_str());
+      stream->data.resize(this->streams_state[i].size);
+    }
+    else
+    {
+      this->log->debug("Ignoring stream with no output (name: %s)\n", name.c_str());
+    }
+
+    this->streams.push_back(stream);
+  }
+
+  this->streams_addr = state->streams;
+}
+
+bool Reqloop::streams_drain()
+{
+  // Streams are drained with 3 batches whatever the number of channels,
+  // one to get the indexes, one to get the data and one to release it.
+  if (this->streams_addr == 0)
+    return false;
+
+  int nb_streams = this->streams.size();
+  if (!this->cable->access(false, this->streams_addr, nb_streams * sizeof(hal_bridge_stream_t), (char *)this->streams_state.data()))
+    return false;
+
+  std::vector<Cable_io_req> reqs;
+  std::vector<int> sizes(nb_streams, 0);
+
+  for (int i=0; i<nb_streams; i++)
+  {
+    Bridge_stream *stream = this->streams[i];
+    hal_bridge_stream_t *state = &this->streams_state[i];
+    uint32_t size = state->size;
+
+    if (stream == NULL || state->write >= size || state->read >= size || state->write == state->read)
+      continue;
+
+    if (state->write > state->read)
+    {
+      sizes[i] = state->write - state->read;
+      reqs.push_back(Cable_io_req(false, state->buffer + state->read, sizes[i], stream->data.data()));
+    }
+    else
+    {
+      // Data is wrapping, get it in 2 parts
+      sizes[i] = size - state->read + state->write;
+      reqs.push_back(Cable_io_req(false, state->buffer + state->read, size - state->read, stream->data.data()));
+      if (state->write)
+        reqs.push_back(Cable_io_req(false, state->buffer, state->write, &stream->data[size - state->read]));
+    }
+  }
+
+  if (reqs.size() == 0)
+    return false;
+
+  if (!this->cable->access_batch(reqs))
+    return false;
+
+  reqs.clear();
+
+  for (int i=0; i<nb_streams; i++)
+  {
+    if (sizes[i] == 0)
+      continue;
+
+    hal_bridge_stream_t *state = &this->streams_state[i];
+
+    reqs.push_back(Cable_io_req(true, this->streams_addr + i*sizeof(hal_bridge_stream_t) + offsetof(hal_bridge_stream_t, read), 4, (char *)&state->write));
+  }
+
+  // The space is released before forwarding the data so that the target can
+  // already reuse it
+  if (!this->cable->access_batch(reqs))
+    return false;
+
+  for (int i=0; i<nb_streams; i++)
+  {
+    if (sizes[i] == 0)
+      continue;
+
+    Bridge_stream *stream = this->streams[i];
+    hal_bridge_stream_t *state = &this->streams_state[i];
+
+    stream->push(stream->data.data(), sizes[i]);
+
+    if (state->dropped != stream->dropped)
+    {
+      this->log->warning("Stream %s dropped %d bytes\n", stream->name.c_str(), state->dropped - stream->dropped);
+      stream->dropped = state->dropped;
+    }
+  }
+
+  return true;
+}
+
+void Reqloop::streams_close()
+{
+  for (Bridge_stream *stream: this->streams)
+  {
+    delete stream;
+  }
+  this->streams.clear();
+  this->streams_addr = 0;
+}
+
+void Reqloop::poll_wait(bool active)
+{
+  // Do not wait at all as long as there is some activity, otherwise
+  // exponentially increase the delay to lower the traffic on the cable.
+  if (active)
+  {
+    this->poll_delay = 0;
+    return;
+  }
+
+  if (this->poll_delay == 0)
+    this->poll_delay = REQLOOP_POLL_MIN_US;
+  else if (this->poll_delay < REQLOOP_POLL_MAX_US)
+  {
+    this->poll_delay *= 2;
+    if (this->poll_delay > REQLOOP_POLL_MAX_US)
+      this->poll_delay = REQLOOP_POLL_MAX_US;
+  }
+
+  // The wait is interrupted when a bridge to target request is pushed or
+  // when the loop is stopped
+  std::unique_lock<std::mutex> lock(this->mutex);
+  this->cond.wait_for(lock, std::chrono::microseconds(this->poll_delay), [this]{ return this->wakeup; });
+  if (this->wakeup)
+  {
+    this->wakeup = false;
+    this->poll_delay = 0;
+  }
+}
+
+void Reqloop::push_target_req(Target_req *req)
+{
+  // Must be called with the mutex locked
+  this->target_reqs.push(req);
+  this->wakeup = true;
+  this->cond.notify_all();
+}
+
 void Reqloop::reqloop_routine()
 {
+  Cable_stats::set_context(CABLE_STATS_CTX_REQLOOP);
+
   // In case the birdge is not yet connected, do extra init steps to
   // connect once the target becomes available
   this->target_sync_fsm_state = this->debug_struct ? TARGET_SYNC_FSM_STATE_WAIT_AVAILABLE : TARGET_SYNC_FSM_STATE_INIT;
@@ -793,67 +1478,87 @@ void Reqloop::reqloop_routine()
     // from runtime
     while(!end)
     {
-      uint32_t value;
+      hal_debug_struct_t state;
+      bool active = false;
 
       // Wait until the target is available and has a request.
       // This will poll the target through the JTAG register.
       if (!this->wait_target_request())
       {
+        // Streams do not need any request from the target, they can be
+        // drained as soon as it is available
+        bool streams_active = false;
+        if (this->target_sync_fsm_state == TARGET_SYNC_FSM_STATE_WAIT_REQUEST)
+          streams_active = this->streams_drain();
+
         // If not, just wait a bit and retry
-        usleep(100);
+        this->poll_wait(streams_active);
         continue;
       }
 
+      // Get the whole debug structure at once, all the fields we need to
+      // check are then taken from this snapshot.
+      if (!cable->access(false, (unsigned int)(long)debug_struct, sizeof(hal_debug_struct_t), (char*)&state)) goto end;
+
+      if (this->streams_addr == 0 && this->protocol_version >= PROTOCOL_VERSION_6 && state.nb_streams != 0)
+        this->streams_open(&state);
+
+      if (this->streams_drain())
+        active = true;
+
       // First check if the application has exited
-      cable->access(false, (unsigned int)(long)&debug_struct->exit_status, 4, (char*)&value);
-      if (value >> 31) {
-        status = ((int)value << 1) >> 1;
+      if (state.exit_status >> 31) {
+        // Get what the target pushed just before exiting
+        while (this->streams_drain());
+
+        status = ((int)state.exit_status << 1) >> 1;
         printf("Detected end of application, exiting with status: %d\n", status);
         return;
       }
 
       // Check printf
-      // The target application should quickly dumps the characters, so we can loop on printf
-      // until we don't find anything
-      while(1) {
-        cable->access(false, (unsigned int)(long)&debug_struct->pending_putchar, 4, (char*)&value);
-        if (value == 0) break;
-        char buff[value+1];
-        cable->access(false, (unsigned int)(long)&debug_struct->putc_buffer, value, (char*)buff);
+      // The target fills the buffer before updating the pending counter, and
+      // the counter is located before the buffer, so the buffer in the
+      // snapshot is complete.
+      if (state.pending_putchar) {
+        unsigned int pending = state.pending_putchar;
+        if (pending > HAL_PRINTF_BUF_SIZE)
+          pending = HAL_PRINTF_BUF_SIZE;
         unsigned int zero = 0;
         cable->access(true, (unsigned int)(long)&debug_struct->pending_putchar, 4, (char*)&zero);
-        for (int i=0; i<value; i++) putchar(buff[i]);
+        for (int i=0; i<pending; i++) putchar(state.putc_buffer[i]);
         fflush(NULL);
+        active = true;
       }
 
       // Handle target to bridge requests
-      while(1) {
-        hal_bridge_req_t *first_bridge_req=NULL, *last_req=NULL, *next=NULL, *next_next=NULL;
-
-        if (!cable->access(false, (unsigned int)(long)&debug_struct->first_bridge_req, 4, (char*)&first_bridge_req)) goto end;
-
-        if (first_bridge_req == NULL)
-          break;
+      hal_bridge_req_t *first_bridge_req = (hal_bridge_req_t *)(long)state.first_bridge_req;
 
+      while(first_bridge_req != NULL) {
         hal_bridge_req_t req;
         if (!this->cable->access(false, (unsigned int)(long)first_bridge_req, sizeof(hal_bridge_req_t), (char*)&req)) goto end;
 
-        value = 1;
-        if (!cable->access(true, (unsigned int)(long)&first_bridge_req->popped, sizeof(first_bridge_req->popped), (char*)&value)) goto end;
-        if (!cable->access(true, (unsigned int)(long)&debug_struct->first_bridge_req, 4, (char*)&req.next)) goto end;
+        uint32_t value = 1;
+        std::vector<Cable_io_req> reqs;
+        reqs.push_back(Cable_io_req(true, (unsigned int)(long)&first_bridge_req->popped, sizeof(first_bridge_req->popped), (char*)&value));
+        reqs.push_back(Cable_io_req(true, (unsigned int)(long)&debug_struct->first_bridge_req, 4, (char*)&req.next));
+        if (!cable->access_batch(reqs)) goto end;
 
         if (this->handle_req(debug_struct, &req, first_bridge_req))
           return;
-      }
 
-      // Handle bridge to target requests
-      this->handle_bridge_to_target_reqs(debug_struct);
+        active = true;
 
-      if (!this->target_jtag_sync)
-      {
-        // Small sleep to not poll too often
-        usleep(500);
+        first_bridge_req = NULL;
+        if (!cable->access(false, (unsigned int)(long)&debug_struct->first_bridge_req, 4, (char*)&first_bridge_req)) goto end;
       }
+
+      // Handle bridge to target requests. As long as the target still holds
+      // the previous one, the loop keeps waiting between polls.
+      if (this->handle_bridge_to_target_reqs(debug_struct))
+        active = true;
+
+      this->poll_wait(active);
     }
   }
   else
@@ -880,7 +1585,7 @@ void Reqloop::efuse_access(bool write, int id, uint32_t value, uint32_t mask)
 
   std::unique_lock<std::mutex> lock(this->mutex);
 
-  this->target_reqs.push(req);
+  this->push_target_req(req);
 
   while(!req->done)
   {
@@ -904,7 +1609,7 @@ int Reqloop::eeprom_access(uint32_t itf, uint32_t cs, bool write, uint32_t addr,
   req->target_req.eeprom_access.size = size;
 
   std::unique_lock<std::mutex> lock(this->mutex);
-  this->target_reqs.push(req);
+  this->push_target_req(req);
 
   while(!req->done)
   {
@@ -935,7 +1640,7 @@ int Reqloop::flash_access(int type, uint32_t itf, uint32_t cs, bool write, uint3
   req->target_req.flash_access.size = size;
 
   std::unique_lock<std::mutex> lock(this->mutex);
-  this->target_reqs.push(req);
+  this->push_target_req(req);
 
   while(!req->done)
   {
@@ -964,7 +1669,7 @@ int Reqloop::flash_erase(int type, uint32_t itf, uint32_t cs, uint32_t addr, int
   req->target_req.flash_erase.size = size;
 
   std::unique_lock<std::mutex> lock(this->mutex);
-  this->target_reqs.push(req);
+  this->push_target_req(req);
 
   while(!req->done)
   {
@@ -992,7 +1697,7 @@ int Reqloop::flash_erase_sector(int type, uint32_t itf, uint32_t cs, uint32_t ad
   req->target_req.flash_erase_sector.addr = addr;
 
   std::unique_lock<std::mutex> lock(this->mutex);
-  this->target_reqs.push(req);
+  this->push_target_req(req);
 
   while(!req->done)
   {
@@ -1019,7 +1724,7 @@ int Reqloop::flash_erase_chip(int type, uint32_t itf, uint32_t cs)
   req->target_req.flash_erase_chip.cs = cs;
 
   std::unique_lock<std::mutex> lock(this->mutex);
-  this->target_reqs.push(req);
+  this->push_target_req(req);
 
   while(!req->done)
   {
@@ -1035,6 +1740,134 @@ int Reqloop::flash_erase_chip(int type, uint32_t itf, uint32_t cs)
   return retval;
 }
 
+int Reqloop::flash_read_to_host(int32_t type, uint32_t itf, uint32_t cs, uint32_t addr, char *data, uint32_t size, uint32_t buffer)
+{
+  while (size > 0)
+  {
+    uint32_t iter_size = std::min(size, (uint32_t)REQLOOP_FLASH_DIFF_CHUNK_SIZE);
+
+    if (this->flash_access(type, itf, cs, false, addr, buffer, (iter_size + 7) & ~7))
+      return -1;
+
+    if (!this->cable->access(false, buffer, iter_size, data))
+      return -1;
+
+    addr += iter_size;
+    data += iter_size;
+    size -= iter_size;
+  }
+
+  return 0;
+}
+
+int Reqloop::flash_write_from_host(int32_t type, uint32_t itf, uint32_t cs, uint32_t addr, const char *data, uint32_t size, uint32_t buffer)
+{
+  char chunk[REQLOOP_FLASH_DIFF_CHUNK_SIZE];
+
+  while (size > 0)
+  {
+    uint32_t iter_size = std::min(size, (uint32_t)REQLOOP_FLASH_DIFF_CHUNK_SIZE);
+    // The flasher works on 8 bytes units, pad with the erased value
+    uint32_t aligned_size = (iter_size + 7) & ~7;
+
+    memcpy(chunk, data, iter_size);
+    memset(&chunk[iter_size], 0xff, aligned_size - iter_size);
+
+    if (!this->cable->access(true, buffer, aligned_size, chunk))
+      return -1;
+
+    if (this->flash_access(type, itf, cs, true, addr, buffer, aligned_size))
+      return -1;
+
+    addr += iter_size;
+    data += iter_size;
+    size -= iter_size;
+  }
+
+  return 0;
+}
+
+// Program the flash with the specified image, only erasing and programming
+// the sectors whose content is different. Each sector is read back and
+// compared with the image, which is much faster than erasing and programming
+// it, and the comparison stops at the first different chunk.
+// The parts of the first and last sectors which are outside the image are
+// preserved.
+int Reqloop::flash_write_diff(int32_t type, uint32_t itf, uint32_t cs, uint32_t addr, const char *data, uint32_t size, uint32_t sector_size)
+{
+  if (sector_size == 0 || sector_size % REQLOOP_FLASH_DIFF_CHUNK_SIZE || (sector_size & (sector_size - 1)))
+  {
+    this->log->error("Invalid flash sector size: 0x%x\n", sector_size);
+    return -1;
+  }
+
+  uint32_t buffer = this->buffer_alloc(REQLOOP_FLASH_DIFF_CHUNK_SIZE);
+  if (buffer == 0)
+    return -1;
+
+  std::vector<char> sector(sector_size);
+  int nb_sectors = 0, nb_programmed = 0;
+  int retval = 0;
+  uint32_t end = addr + size;
+
+  for (uint32_t sector_addr = addr & ~(sector_size - 1); sector_addr < end; sector_addr += sector_size)
+  {
+    // Part of the sector covered by the image
+    uint32_t first = std::max(sector_addr, addr);
+    uint32_t last = std::min(sector_addr + sector_size, end);
+    const char *image = &data[first - addr];
+
+    nb_sectors++;
+
+    bool differ = false;
+    for (uint32_t pos = first; pos < last && !differ; pos += REQLOOP_FLASH_DIFF_CHUNK_SIZE)
+    {
+      uint32_t iter_size = std::min(last - pos, (uint32_t)REQLOOP_FLASH_DIFF_CHUNK_SIZE);
+      char *flash_data = &sector[pos - sector_addr];
+
+      if (this->flash_read_to_host(type, itf, cs, pos, flash_data, iter_size, buffer))
+        goto error;
+
+      differ = memcmp(flash_data, &image[pos - first], iter_size) != 0;
+    }
+
+    if (!differ)
+      continue;
+
+    nb_programmed++;
+
+    this->log->debug("Programming flash sector (addr: 0x%x)\n", sector_addr);
+
+    // Save what the erase would destroy outside the image
+    if (first > sector_addr && this->flash_read_to_host(type, itf, cs, sector_addr, &sector[0], first - sector_addr, buffer))
+      goto error;
+
+    if (last < sector_addr + sector_size && this->flash_read_to_host(type, itf, cs, last, &sector[last - sector_addr], sector_addr + sector_size - last, buffer))
+      goto error;
+
+    memcpy(&sector[first - sector_addr], image, last - first);
+
+    // Only the range which was saved is erased, whatever the erase
+    // granularity of the flash, as the sector size comes from the user
+    if (this->flash_erase(type, itf, cs, sector_addr, sector_size))
+      goto error;
+
+    if (this->flash_write_from_host(type, itf, cs, sector_addr, &sector[0], sector_size, buffer))
+      goto error;
+  }
+
+  this->log->user("Flash programmed (sectors: %d, programmed: %d, unchanged: %d)\n", nb_sectors, nb_programmed, nb_sectors - nb_programmed);
+  goto end;
+
+error:
+  this->log->error("Failed to program flash (addr: 0x%x)\n", addr);
+  retval = -1;
+
+end:
+  this->buffer_free(buffer, REQLOOP_FLASH_DIFF_CHUNK_SIZE);
+  return retval;
+}
+
 void Reqloop::buffer_free(uint32_t addr, uint32_t size)
 {
   Target_req *req = new Target_req();
@@ -1045,7 +1878,7 @@ void Reqloop::buffer_free(uint32_t addr, uint32_t size)
   req->target_req.buffer_free.buffer = addr;
 
   std::unique_lock<std::mutex> lock(this->mutex);
-  this->target_reqs.push(req);
+  this->push_target_req(req);
 
   while(!req->done)
   {
@@ -1066,7 +1899,7 @@ uint32_t Reqloop::buffer_alloc(uint32_t size)
   req->target_req.buffer_alloc.size = size;
 
   std::unique_lock<std::mutex> lock(this->mutex);
-  this->target_reqs.push(req);
+  this->push_target_req(req);
 
   while(!req->done)
   {
@@ -1086,6 +1919,8 @@ Reqloop::Reqloop(Cable *cable, unsigned int debug_struct_addr) : cable(cable), d
 {
   log = new Log();
 
+  this->file_pipeline = new File_pipeline(REQLOOP_FILE_NB_CHUNKS, REQLOOP_FILE_CHUNK_SIZE);
+
   js::config *config = cable->get_config();
 
   this->target_jtag_sync = config->get_child_bool("**/debug_bridge/target_jtag_sync");
@@ -1109,15 +1944,20 @@ Reqloop::Reqloop(Cable *cable, unsigned int debug_struct_addr) : cable(cable), d
   thread = new std::thread(&Reqloop::reqloop_routine, this);
 }
 
+Reqloop::~Reqloop()
+{
+  delete this->file_pipeline;
+}
+
 extern "C" void *bridge_reqloop_open(void *cable, unsigned int debug_struct_addr)
 {
   return (void *)new Reqloop((Cable *)cable, debug_struct_addr);
 }
 
-extern "C" void bridge_reqloop_close(void *arg, int kill)
+extern "C" int bridge_reqloop_close(void *arg, int kill)
 {
   Reqloop *reqloop = (Reqloop *)arg;
-  reqloop->stop(kill);
+  return reqloop->stop(kill);
 }
 
 extern "C" void bridge_reqloop_efuse_access(void *arg, bool write, int id, uint32_t value, uint32_t mask)
@@ -1165,6 +2005,13 @@ extern "C" int bridge_reqloop_flash_erase_chip(void *arg, int type, uint32_t itf
 }
 
 
+extern "C" int bridge_reqloop_flash_write_diff(void *arg, int type, uint32_t itf, uint32_t cs, uint32_t addr, const char *data, uint32_t size, uint32_t sector_size)
+{
+  Reqloop *reqloop = (Reqloop *)arg;
+  return reqloop->flash_write_diff(type, itf, cs, addr, data, size, sector_size);
+}
+
+
 extern "C" uint32_t bridge_reqloop_buffer_alloc(void *arg, uint32_t size)
 {
   Reqloop *reqloop = (Reqloop *)arg;
@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2018 ETH Zurich and University of Bologna
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* 
+ * Authors: Germain Haugou, ETH (germain.haugou@iis.ee.ethz.ch)
+ */
+
+#include "debug_bridge/lzload.h"
+
+// Zero-initialized as the whole image, including bss, is loaded by the bridge
+lzload_mailbox_t lzload_mailbox;
+
+// Decompresses an LZ4 block, returns 0 if it exactly fills the destination
+static int lzload_lz4(const uint8_t *src, uint32_t src_size, uint8_t *dst, uint32_t dst_size)
+{
+  const uint8_t *src_end = src + src_size;
+  uint8_t *dst_start = dst;
+  uint8_t *dst_end = dst + dst_size;
+
+  while (src < src_end)
+  {
+    uint32_t token = *src++;
+    uint32_t len = token >> 4;
+
+    if (len == 15)
+    {
+      uint32_t value;
+      do
+      {
+        if (src >= src_end) return -1;
+        value = *src++;
+        len += value;
+      } while (value == 255);
+    }
+
+    if (len > (uint32_t)(src_end - src) || len > (uint32_t)(dst_end - dst)) return -1;
+
+    while (len--)
+      *dst++ = *src++;
+
+    // The last sequence only has literals
+    if (src == src_end)
+      break;
+
+    if (src_end - src < 2) return -1;
+
+    uint32_t offset = src[0] | (src[1] << 8);
+    src += 2;
+
+    if (offset == 0 || offset > (uint32_t)(dst - dst_start)) return -1;
+
+    len = token & 0xf;
+    if (len == 15)
+    {
+      uint32_t value;
+      do
+      {
+        if (src >= src_end) return -1;
+        value = *src++;
+        len += value;
+      } while (value == 255);
+    }
+    len += 4;
+
+    if (len > (uint32_t)(dst_end - dst)) return -1;
+
+    // Byte copy as the match can overlap the bytes it produces
+    const uint8_t *match = dst - offset;
+    while (len--)
+      *dst++ = *match++;
+  }
+
+  return dst == dst_end ? 0 : -1;
+}
+
+static void lzload_fill(uint8_t *dst, uint32_t size)
+{
+  while (size && ((uint32_t)dst & 3))
+  {
+    *dst++ = 0;
+    size--;
+  }
+
+  uint32_t *dst32 = (uint32_t *)dst;
+  for (; size >= 4; size -= 4)
+    *dst32++ = 0;
+
+  dst = (uint8_t *)dst32;
+  while (size--)
+    *dst++ = 0;
+}
+
+void lzload_main(volatile lzload_mailbox_t *mailbox)
+{
+  int slot_id = 0;
+
+  mailbox->state = LZLOAD_STATE_READY;
+
+  while (1)
+  {
+    volatile lzload_slot_t *slot = &mailbox->slots[slot_id];
+    uint32_t cmd;
+
+    while ((cmd = slot->cmd) == LZLOAD_CMD_NONE);
+
+    if (cmd == LZLOAD_CMD_DONE)
+      break;
+
+    if (cmd == LZLOAD_CMD_LZ4)
+    {
+      if (lzload_lz4((const uint8_t *)slot->src, slot->src_size, (uint8_t *)slot->dst, slot->dst_size))
+        mailbox->errors++;
+    }
+    else if (cmd == LZLOAD_CMD_FILL)
+    {
+      lzload_fill((uint8_t *)slot->dst, slot->dst_size);
+    }
+    else
+    {
+      mailbox->errors++;
+    }
+
+    // Releasing the slot tells the bridge the command is over
+    slot->cmd = LZLOAD_CMD_NONE;
+    slot_id = (slot_id + 1) % LZLOAD_NB_SLOTS;
+  }
+
+  mailbox->slots[slot_id].cmd = LZLOAD_CMD_NONE;
+  mailbox->state = LZLOAD_STATE_DONE;
+}